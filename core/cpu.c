@@ -19,6 +19,8 @@
 #include <ccan/str/str.h>
 #include <ccan/container_of/container_of.h>
 #include <xscom.h>
+#include <cmpxchg.h>
+#include <debug_descriptor.h>
 
 /* The cpu_threads array is static and indexed by PIR in
  * order to speed up lookup from asm entry points
@@ -46,6 +48,21 @@ static bool current_hile_mode;
 static bool current_radix_mode = true;
 static bool tm_suspend_enabled;
 
+/*
+ * Built by init_all_cpus() so the find_cpu_by_*() helpers don't have to
+ * scan every thread: a table from server number to thread, and the range
+ * of PIRs each chip's threads fall in. Availability is still checked when
+ * looking up, so threads being disabled doesn't change them; a cpu node
+ * being removed takes its threads out of the server table.
+ */
+static struct cpu_thread **cpu_by_server;
+static uint32_t cpu_max_server;
+static struct {
+	uint32_t	first_pir;
+	uint32_t	last_pir;
+} cpu_chip_pirs[MAX_CHIPS];
+static bool cpu_chip_pirs_valid;
+
 unsigned long cpu_secondary_start __force_data = 0;
 
 struct cpu_job {
@@ -53,10 +70,58 @@ struct cpu_job {
 	void			(*func)(void *data);
 	void			*data;
 	const char		*name;
-	bool			complete;
+	uint32_t		complete;
 	bool		        no_return;
+
+	/* Only for jobs in a cpu_job_group */
+	struct cpu_job_group	*group;
+	struct list_node	group_link;
+	int32_t			chip_id;
+	struct cpu_thread	*target;
+};
+
+/*
+ * A batch of jobs, queued in one go and waited for as a whole. Jobs
+ * in a group can be stolen by any idle thread, see cpu_steal_job().
+ */
+struct cpu_job_group {
+	struct list_head	jobs;
+	unsigned int		count;
+	uint32_t		pending;
+	uint64_t		submit_tb;
+	uint64_t		done_tb;	/* Latest completion */
 };
 
+enum cpu_wake_cause {
+	cpu_wake_on_job,
+	cpu_wake_on_dec,
+	cpu_wake_on_job_done,
+};
+
+static void cpu_idle_pm(enum cpu_wake_cause wake_on);
+
+/* Group jobs sitting in a queue somewhere, so worth stealing */
+static uint32_t cpu_jobs_stealable;
+
+/*
+ * job->complete is one of these, or CPU_JOB_WAITER() for a job that a
+ * thread has gone to sleep waiting for, which the completing CPU then
+ * has to wake up.
+ */
+#define CPU_JOB_PENDING		0
+#define CPU_JOB_DONE		1
+#define CPU_JOB_WAITER(pir)	((pir) + 2)
+
+/* Most jobs waited for are short, so spin for a while before sleeping */
+#define CPU_JOB_SPIN_US		50
+#define CPU_JOB_GROUP_WAIT_US	20
+#define CPU_JOB_POLL_MS		5
+
+/* What cpu_wait_job() cost, against the old 10ms polling loop */
+static uint32_t cpu_wait_count;
+static uint32_t cpu_wait_us;
+static uint32_t cpu_wait_saved_us;
+
 /* attribute const as cpu_stacks is constant. */
 unsigned long __attrconst cpu_stack_bottom(unsigned int pir)
 {
@@ -218,7 +283,7 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 	job->func = func;
 	job->data = data;
 	job->name = name;
-	job->complete = false;
+	job->complete = CPU_JOB_PENDING;
 	job->no_return = no_return;
 
 	/* Pick a candidate. Returns with target queue locked */
@@ -234,7 +299,7 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 		if (!this_cpu()->job_has_no_return)
 			this_cpu()->job_has_no_return = no_return;
 		func(data);
-		job->complete = true;
+		job->complete = CPU_JOB_DONE;
 		return job;
 	}
 
@@ -256,7 +321,7 @@ struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 	job->func = func;
 	job->data = data;
 	job->name = name;
-	job->complete = false;
+	job->complete = CPU_JOB_PENDING;
 	job->no_return = false;
 
 	/* Pick a candidate. Returns with target queue locked */
@@ -268,7 +333,7 @@ struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 		if (cpu->chip_id == chip_id) {
 			/* Run it now if we're the right node. */
 			func(data);
-			job->complete = true;
+			job->complete = CPU_JOB_DONE;
 			return job;
 		}
 		/* Otherwise fail. */
@@ -284,37 +349,425 @@ struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 bool cpu_poll_job(struct cpu_job *job)
 {
 	lwsync();
-	return job->complete;
+	return job->complete == CPU_JOB_DONE;
+}
+
+static void job_counter_add(uint32_t *counter, int32_t val)
+{
+	uint32_t old;
+
+	do {
+		old = *counter;
+	} while (__cmpxchg32(counter, old, old + val) != old);
+}
+
+/*
+ * CPUs finish their jobs in any order, so only move done_tb forward. This
+ * is ordered before the caller drops pending, which the waiter reads it
+ * after.
+ */
+static void job_group_done_at(struct cpu_job_group *grp, uint64_t tb)
+{
+	uint64_t old;
+
+	do {
+		old = grp->done_tb;
+		if (old && tb_compare(old, tb) != TB_ABEFOREB)
+			break;
+	} while (__cmpxchg64(&grp->done_tb, old, tb) != old);
+	lwsync();
+}
+
+/* Run the OPAL pollers when time_wait() would */
+static void job_wait_poll(struct cpu_thread *cpu)
+{
+	if (list_empty(&cpu->locks_held) &&
+	    (cpu == boot_cpu || !opal_booting()))
+		opal_run_pollers();
+}
+
+/*
+ * Sleep until the job completes or the timebase reaches end, whichever
+ * comes first. If we're registered as the job's waiter, the CPU that
+ * completes it will send us an IPI or doorbell.
+ */
+static void cpu_wait_job_sleep(struct cpu_job *job, unsigned long end)
+{
+	struct cpu_thread *cpu = this_cpu();
+	unsigned long now = mftb();
+	unsigned long delay = end - now;
+
+	if (cpu->tb_invalid) {
+		cpu_relax();
+		return;
+	}
+	if (tb_compare(now, end) != TB_ABEFOREB)
+		return;
+
+	if (pm_enabled && delay > usecs_to_tb(10)) {
+		if (delay >= 0x7fffffff)
+			delay = 0x7fffffff;
+		mtspr(SPR_DEC, delay);
+
+		cpu->wait_job = job;
+		cpu_idle_pm(cpu_wake_on_job_done);
+		cpu->wait_job = NULL;
+		return;
+	}
+
+	smt_lowest();
+	while (!cpu_poll_job(job) && tb_compare(mftb(), end) == TB_ABEFOREB)
+		barrier();
+	smt_medium();
 }
 
 void cpu_wait_job(struct cpu_job *job, bool free_it)
 {
-	unsigned long time_waited = 0;
+	struct cpu_thread *cpu = this_cpu();
+	unsigned long start = mftb(), now;
+	unsigned long next_poll = start + msecs_to_tb(CPU_JOB_POLL_MS);
+	unsigned long next_warn = start + secs_to_tb(30);
+	unsigned long time_waited, polled;
 
 	if (!job)
 		return;
 
-	while (!job->complete) {
-		/* This will call OPAL pollers for us */
-		time_wait_ms(10);
-		time_waited += 10;
-		lwsync();
-		if ((time_waited % 30000) == 0) {
+	smt_lowest();
+	while (!cpu_poll_job(job) &&
+	       tb_to_usecs(mftb() - start) < CPU_JOB_SPIN_US)
+		barrier();
+	smt_medium();
+
+	/*
+	 * Still running, ask to be woken up when it's done. Only one
+	 * thread can be registered, anybody else waiting just wakes up
+	 * for the pollers and has another look.
+	 */
+	if (!cpu_poll_job(job))
+		__cmpxchg32(&job->complete, CPU_JOB_PENDING,
+			    CPU_JOB_WAITER(cpu->pir));
+
+	while (!cpu_poll_job(job)) {
+		now = mftb();
+		if (tb_compare(now, next_poll) != TB_ABEFOREB) {
+			job_wait_poll(cpu);
+			next_poll = now + msecs_to_tb(CPU_JOB_POLL_MS);
+		}
+		if (tb_compare(now, next_warn) != TB_ABEFOREB) {
 			prlog(PR_INFO, "cpu_wait_job(%s) for %lums\n",
-			      job->name, time_waited);
+			      job->name, tb_to_msecs(now - start));
 			backtrace();
+			next_warn = now + secs_to_tb(30);
 		}
+		cpu_wait_job_sleep(job, next_poll);
 	}
 	lwsync();
 
-	if (time_waited > 1000)
+	/* Polling every 10ms cost a whole number of periods, if any */
+	time_waited = tb_to_usecs(mftb() - start);
+	polled = (time_waited + 9999) / 10000 * 10000;
+	job_counter_add(&cpu_wait_count, 1);
+	job_counter_add(&cpu_wait_us, time_waited);
+	job_counter_add(&cpu_wait_saved_us, polled - time_waited);
+
+	if (time_waited > 1000000)
 		prlog(PR_DEBUG, "cpu_wait_job(%s) for %lums\n",
-		      job->name, time_waited);
+		      job->name, time_waited / 1000);
 
 	if (free_it)
 		free(job);
 }
 
+void cpu_wait_job_report(void)
+{
+	prlog(PR_INFO, "CPU: %u job waits took %ums, saving ~%ums over"
+	      " 10ms polling\n", cpu_wait_count, cpu_wait_us / 1000,
+	      cpu_wait_saved_us / 1000);
+}
+
+/*
+ * Mark a job complete. Once that's done its waiter may free it, so only
+ * the waiter's PIR, if any, is left to wake it with.
+ */
+static void cpu_job_complete(struct cpu_job *job)
+{
+	struct cpu_thread *waiter;
+	uint32_t old;
+
+	do {
+		old = job->complete;
+	} while (__cmpxchg32(&job->complete, old, CPU_JOB_DONE) != old);
+
+	if (old == CPU_JOB_PENDING)
+		return;
+
+	/* Pairs with the waiter marking itself in_sleep then checking */
+	sync();
+	waiter = find_cpu_by_pir(old - CPU_JOB_WAITER(0));
+	if (!waiter || !waiter->in_sleep)
+		return;
+
+	if (proc_gen == proc_gen_p8)
+		icp_kick_cpu(waiter);
+	else if (proc_gen == proc_gen_p9)
+		p9_dbell_send(waiter->pir);
+}
+
+struct cpu_job_group *cpu_job_group_alloc(void)
+{
+	struct cpu_job_group *grp;
+
+	grp = zalloc(sizeof(struct cpu_job_group));
+	if (!grp)
+		return NULL;
+	list_head_init(&grp->jobs);
+
+	return grp;
+}
+
+bool cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id,
+		       const char *name,
+		       void (*func)(void *data), void *data)
+{
+	struct cpu_job *job;
+
+	job = zalloc(sizeof(struct cpu_job));
+	if (!job)
+		return false;
+	job->func = func;
+	job->data = data;
+	job->name = name;
+	job->group = grp;
+	job->chip_id = chip_id;
+	list_add_tail(&grp->jobs, &job->group_link);
+	grp->count++;
+
+	return true;
+}
+
+/*
+ * Pick the least loaded candidate on the wanted chip, or anywhere if
+ * that chip has no candidate. Ties go to the earlier candidate, which
+ * puts primary threads first.
+ */
+static int job_group_pick(struct cpu_thread **cands, unsigned int *load,
+			  unsigned int n, int32_t chip_id)
+{
+	unsigned int i, cost, best_cost = -1u;
+	int best = -1;
+
+	for (i = 0; i < n; i++) {
+		if (chip_id >= 0 && cands[i]->chip_id != chip_id)
+			continue;
+		cost = cands[i]->job_count + load[i];
+		if (cost < best_cost) {
+			best = i;
+			best_cost = cost;
+		}
+	}
+
+	if (best < 0 && chip_id >= 0)
+		return job_group_pick(cands, load, n, -1);
+
+	return best;
+}
+
+/*
+ * Queue all the jobs added to the group. The targets are picked in a
+ * single pass over the CPUs, and each target queue is locked only once
+ * however many jobs it gets. With nobody else to run them, the jobs
+ * are run here and now.
+ */
+void cpu_job_group_submit(struct cpu_job_group *grp)
+{
+	struct cpu_thread *cpu, *me = this_cpu();
+	struct cpu_thread **cands = NULL;
+	unsigned int *load = NULL;
+	unsigned int i, n = 0, queued = 0;
+	struct cpu_job *job;
+	bool ran_here = false;
+	int t;
+
+	grp->submit_tb = mftb();
+
+#ifndef DEBUG_SERIALIZE_CPU_JOBS
+	for_each_available_cpu(cpu)
+		if (cpu != me && !cpu->job_has_no_return)
+			n++;
+	if (n) {
+		cands = zalloc(n * sizeof(*cands));
+		load = zalloc(n * sizeof(*load));
+	}
+	if (!cands || !load)
+		n = 0;
+#endif
+
+	/* Primary threads first, siblings only get work on busy cores */
+	i = 0;
+	for_each_available_cpu(cpu)
+		if (i < n && cpu != me && !cpu->job_has_no_return &&
+		    cpu_is_thread0(cpu))
+			cands[i++] = cpu;
+	for_each_available_cpu(cpu)
+		if (i < n && cpu != me && !cpu->job_has_no_return &&
+		    !cpu_is_thread0(cpu))
+			cands[i++] = cpu;
+	n = i;
+
+	list_for_each(&grp->jobs, job, group_link) {
+		t = job_group_pick(cands, load, n, job->chip_id);
+		if (t < 0)
+			continue;
+		job->target = cands[t];
+		load[t]++;
+		queued++;
+	}
+
+	/* Account for everything before the first job can complete */
+	grp->pending = queued;
+	job_counter_add(&cpu_jobs_stealable, queued);
+	lwsync();
+
+	/*
+	 * Only targets need waking. An idle thread has an empty queue so
+	 * it's picked before anyone gets a second job, one left out here
+	 * is on the wrong chip for every job and couldn't steal them.
+	 */
+	for (i = 0; i < n; i++) {
+		if (!load[i])
+			continue;
+		cpu = cands[i];
+		lock(&cpu->job_lock);
+		list_for_each(&grp->jobs, job, group_link) {
+			if (job->target != cpu)
+				continue;
+			list_add_tail(&cpu->job_queue, &job->link);
+			cpu->job_count++;
+		}
+		if (pm_enabled)
+			cpu_wake(cpu);
+		unlock(&cpu->job_lock);
+	}
+
+	free(cands);
+	free(load);
+
+	/* Can't be scheduled, run them now */
+	list_for_each(&grp->jobs, job, group_link) {
+		if (job->target)
+			continue;
+		job->func(job->data);
+		job->complete = CPU_JOB_DONE;
+		ran_here = true;
+	}
+	if (ran_here)
+		job_group_done_at(grp, mftb());
+}
+
+bool cpu_job_group_done(struct cpu_job_group *grp)
+{
+	lwsync();
+	return grp->pending == 0;
+}
+
+/*
+ * Wait for every job in the group, then free it. This returns as soon
+ * as the last job completes, and runs the OPAL pollers every few ms
+ * where time_wait() would. Returns how long the jobs took, in us from
+ * submission to the last one completing.
+ */
+unsigned long cpu_job_group_wait(struct cpu_job_group *grp)
+{
+	struct cpu_thread *cpu = this_cpu();
+	unsigned long start = mftb(), now, took;
+	unsigned long next_poll = start + msecs_to_tb(CPU_JOB_POLL_MS);
+	unsigned long next_warn = start + secs_to_tb(30);
+	struct cpu_job *job;
+
+	if (!grp)
+		return 0;
+
+	while (!cpu_job_group_done(grp)) {
+		now = mftb();
+		if (tb_compare(now, next_poll) == TB_AAFTERB) {
+			job_wait_poll(cpu);
+			next_poll = now + msecs_to_tb(CPU_JOB_POLL_MS);
+		}
+		if (tb_compare(now, next_warn) == TB_AAFTERB) {
+			prlog(PR_INFO, "cpu_job_group_wait: %u/%u jobs pending"
+			      " for %lums\n", grp->pending, grp->count,
+			      tb_to_msecs(now - start));
+			backtrace();
+			next_warn = now + secs_to_tb(30);
+		}
+		time_wait_us_nopoll(CPU_JOB_GROUP_WAIT_US);
+	}
+	lwsync();
+
+	took = grp->count ? tb_to_usecs(grp->done_tb - grp->submit_tb) : 0;
+	prlog(PR_DEBUG, "cpu_job_group_wait: %u jobs done in %lums\n",
+	      grp->count, took / 1000);
+
+	while ((job = list_pop(&grp->jobs, struct cpu_job, group_link)))
+		free(job);
+	free(grp);
+
+	return took;
+}
+
+/*
+ * Move a group job from another CPU's queue onto ours, preferring CPUs
+ * on our own chip. Jobs with a chip hint are only taken by threads on
+ * that chip, and we take from the tail, as that will be run last.
+ */
+bool cpu_steal_job(struct cpu_thread *me)
+{
+	struct cpu_thread *cpu;
+	struct cpu_job *job, *j;
+	int pass;
+
+	if (!cpu_jobs_stealable || me->job_has_no_return)
+		return false;
+
+	for (pass = 0; pass < 2; pass++) {
+		for_each_available_cpu(cpu) {
+			if (cpu == me || list_empty_nocheck(&cpu->job_queue))
+				continue;
+			if ((cpu->chip_id == me->chip_id) != (pass == 0))
+				continue;
+
+			job = NULL;
+			lock(&cpu->job_lock);
+			list_for_each_rev(&cpu->job_queue, j, link) {
+				if (j->group && (j->chip_id < 0 ||
+						 j->chip_id == me->chip_id)) {
+					job = j;
+					break;
+				}
+			}
+			if (job) {
+				list_del(&job->link);
+				cpu->job_count--;
+			}
+			unlock(&cpu->job_lock);
+
+			if (!job)
+				continue;
+
+			lock(&me->job_lock);
+			list_add_tail(&me->job_queue, &job->link);
+			me->job_count++;
+			unlock(&me->job_lock);
+
+			prlog(PR_TRACE, "job %s stolen from %x by %x\n",
+			      job->name, cpu->pir, me->pir);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool cpu_check_jobs(struct cpu_thread *cpu)
 {
 	return !list_empty_nocheck(&cpu->job_queue);
@@ -333,6 +786,7 @@ void cpu_process_jobs(void)
 
 	lock(&cpu->job_lock);
 	while (true) {
+		struct cpu_job_group *grp;
 		bool no_return;
 
 		job = list_pop(&cpu->job_queue, struct cpu_job, link);
@@ -342,7 +796,10 @@ void cpu_process_jobs(void)
 		func = job->func;
 		data = job->data;
 		no_return = job->no_return;
+		grp = job->group;
 		unlock(&cpu->job_lock);
+		if (grp)
+			job_counter_add(&cpu_jobs_stealable, -1);
 		prlog(PR_TRACE, "running job %s on %x\n", job->name, cpu->pir);
 		if (no_return)
 			free(job);
@@ -360,17 +817,17 @@ void cpu_process_jobs(void)
 		if (!no_return) {
 			cpu->job_count--;
 			lwsync();
-			job->complete = true;
+			cpu_job_complete(job);
+			/* The group, and job, may be freed once this hits 0 */
+			if (grp) {
+				job_group_done_at(grp, mftb());
+				job_counter_add(&grp->pending, -1);
+			}
 		}
 	}
 	unlock(&cpu->job_lock);
 }
 
-enum cpu_wake_cause {
-	cpu_wake_on_job,
-	cpu_wake_on_dec,
-};
-
 static unsigned int cpu_idle_p8(enum cpu_wake_cause wake_on)
 {
 	uint64_t lpcr = mfspr(SPR_LPCR) & ~SPR_LPCR_P8_PECE;
@@ -406,8 +863,9 @@ static unsigned int cpu_idle_p8(enum cpu_wake_cause wake_on)
 		cpu->in_sleep = true;
 		sync();
 
-		/* Check if PM got disabled */
-		if (!pm_enabled)
+		/* Check if PM got disabled, or the job we wait for is done */
+		if (!pm_enabled || (wake_on == cpu_wake_on_job_done &&
+				    cpu_poll_job(cpu->wait_job)))
 			goto skip_sleep;
 
 		/* EE and DEC */
@@ -460,8 +918,9 @@ static unsigned int cpu_idle_p9(enum cpu_wake_cause wake_on)
 		cpu->in_sleep = true;
 		sync();
 
-		/* Check if PM got disabled */
-		if (!pm_enabled)
+		/* Check if PM got disabled, or the job we wait for is done */
+		if (!pm_enabled || (wake_on == cpu_wake_on_job_done &&
+				    cpu_poll_job(cpu->wait_job)))
 			goto skip_sleep;
 
 		/* HV DBELL and DEC */
@@ -710,10 +1169,17 @@ struct dt_node *get_cpu_node(u32 pir)
 /* This only covers primary, active cpus */
 struct cpu_thread *find_cpu_by_chip_id(u32 chip_id)
 {
+	uint32_t pir = 0, last = cpu_max_pir;
 	struct cpu_thread *t;
 
-	for_each_available_cpu(t) {
-		if (t->is_secondary)
+	if (cpu_chip_pirs_valid && chip_id < MAX_CHIPS) {
+		pir = cpu_chip_pirs[chip_id].first_pir;
+		last = cpu_chip_pirs[chip_id].last_pir;
+	}
+
+	for (; pir <= last; pir++) {
+		t = &cpu_stacks[pir].cpu;
+		if (t->is_secondary || !cpu_is_available(t))
 			continue;
 		if (t->chip_id == chip_id)
 			return t;
@@ -724,9 +1190,18 @@ struct cpu_thread *find_cpu_by_chip_id(u32 chip_id)
 struct cpu_thread *find_cpu_by_node(struct dt_node *cpu)
 {
 	struct cpu_thread *t;
+	uint32_t pir;
+
+	/* A node's threads follow its primary, whose server# is in "reg" */
+	t = find_cpu_by_server(dt_prop_get_u32_def(cpu, "reg", ~0u));
+	if (!t || t->node != cpu)
+		return NULL;
 
-	for_each_available_cpu(t) {
-		if (t->node == cpu)
+	for (pir = t->pir; pir <= cpu_max_pir; pir++) {
+		t = &cpu_stacks[pir].cpu;
+		if (t->node != cpu)
+			break;
+		if (cpu_is_available(t))
 			return t;
 	}
 	return NULL;
@@ -750,6 +1225,11 @@ struct cpu_thread *find_cpu_by_server(u32 server_no)
 {
 	struct cpu_thread *t;
 
+	if (cpu_by_server)
+		return server_no <= cpu_max_server ?
+			cpu_by_server[server_no] : NULL;
+
+	/* Only before init_all_cpus(), or if the table didn't fit */
 	for_each_cpu(t) {
 		if (t->server_no == server_no)
 			return t;
@@ -867,6 +1347,55 @@ uint32_t cpu_get_core_index(struct cpu_thread *cpu)
 	return pir_to_core_id(cpu->pir);
 }
 
+static void init_cpu_lookup(void)
+{
+	struct cpu_thread *t;
+	uint32_t chip_id;
+
+	for (chip_id = 0; chip_id < MAX_CHIPS; chip_id++) {
+		cpu_chip_pirs[chip_id].first_pir = 1;
+		cpu_chip_pirs[chip_id].last_pir = 0;
+	}
+
+	cpu_max_server = 0;
+	for_each_cpu(t) {
+		if (t->server_no > cpu_max_server)
+			cpu_max_server = t->server_no;
+
+		/* for_each_cpu() goes up in PIR order */
+		chip_id = t->chip_id;
+		if (chip_id >= MAX_CHIPS)
+			continue;
+		if (cpu_chip_pirs[chip_id].first_pir >
+		    cpu_chip_pirs[chip_id].last_pir)
+			cpu_chip_pirs[chip_id].first_pir = t->pir;
+		cpu_chip_pirs[chip_id].last_pir = t->pir;
+	}
+	cpu_chip_pirs_valid = true;
+
+	free(cpu_by_server);
+	cpu_by_server = zalloc((cpu_max_server + 1) * sizeof(*cpu_by_server));
+	if (!cpu_by_server) {
+		prerror("CPU: No memory for server# lookup, will scan\n");
+		return;
+	}
+	for_each_cpu(t)
+		cpu_by_server[t->server_no] = t;
+}
+
+static void cpu_lookup_remove(struct dt_node *node)
+{
+	struct cpu_thread *t;
+
+	if (!cpu_by_server)
+		return;
+
+	for_each_cpu(t) {
+		if (t->node == node && cpu_by_server[t->server_no] == t)
+			cpu_by_server[t->server_no] = NULL;
+	}
+}
+
 void cpu_remove_node(const struct cpu_thread *t)
 {
 	struct dt_node *i;
@@ -881,6 +1410,7 @@ void cpu_remove_node(const struct cpu_thread *t)
 		if (!p)
 			continue;
 		if (dt_property_get_cell(p, 0) == t->pir) {
+			cpu_lookup_remove(i);
 			dt_free(i);
 			return;
 		}
@@ -1026,6 +1556,10 @@ void init_boot_cpu(void)
 		cpu_max_pir = mfspr(SPR_PIR);
 	}
 
+	/* Everything we know of has VSX, so big copies can use it */
+	if (proc_gen != proc_gen_unknown)
+		memcpy_enable_vsx();
+
 	if (is_power9n(pvr) && (PVR_VERS_MAJ(pvr) == 1)) {
 		prerror("CPU: POWER9N DD1 is not supported\n");
 		abort();
@@ -1223,6 +1757,11 @@ void init_all_cpus(void)
 		}
 		prlog(PR_INFO, "CPU:  %d secondary threads\n", thread);
 	}
+
+	init_cpu_lookup();
+
+	/* Every cpu_thread is set up, malloc can use their caches now */
+	malloc_cache_enable();
 }
 
 void cpu_bringup(void)
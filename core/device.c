@@ -9,6 +9,7 @@
 #include <device.h>
 #include <stdlib.h>
 #include <skiboot.h>
+#include <lock.h>
 #include <libfdt/libfdt.h>
 #include <libfdt/libfdt_internal.h>
 #include <ccan/str/str.h>
@@ -17,23 +18,439 @@
 
 /* Used to give unique handles. */
 u32 last_phandle = 0;
+u32 dt_flat_gen = 1;
 
 struct dt_node *dt_root;
 struct dt_node *dt_chosen;
 
+/*
+ * Protects what's shared between all the nodes below: the phandle index,
+ * the list of property hashes, the name table and the property arena.
+ * Nodes themselves are left to their users as before, but PCI hotplug
+ * on two PHBs at once, say, mustn't trip over each other in these.
+ */
+static struct lock dt_lock = LOCK_UNLOCKED;
+
+/*
+ * Every node, by phandle, so dt_find_by_phandle() doesn't have to walk
+ * the tree. Open addressing, updated whenever a node is created, freed
+ * or has its phandle changed. If it can't be grown we give up on it and
+ * go back to walking the tree.
+ */
+#define DT_PHANDLE_TOMB		((struct dt_node *)1)
+#define DT_PHANDLE_MIN_SLOTS	64
+
+static struct {
+	struct dt_node **slot;
+	u32 mask;
+	u32 used;	/* including tombstones */
+	u32 live;
+	bool broken;
+} dt_phandles;
+
+/*
+ * Nodes with at least this many properties get a hash table of them.
+ * It's only changed when the node's properties are, so looking things
+ * up doesn't write anything. All of them are on a list so that
+ * dt_resize_property(), which doesn't know the node, can fix them up.
+ */
+#define DT_PROP_HASH_MIN	16
+
+struct dt_prop_hash {
+	struct list_node link;
+	u32 mask;
+	u32 used;
+	struct dt_property *slot[];
+};
+
+static LIST_HEAD(dt_prop_hashes);
+
+static u32 dt_phandle_hash(u32 phandle)
+{
+	return phandle * 0x9e3779b1u;
+}
+
+static void dt_phandle_insert(struct dt_node **slot, u32 mask,
+			      struct dt_node *node)
+{
+	u32 i = dt_phandle_hash(node->phandle) & mask;
+
+	while (slot[i] && slot[i] != DT_PHANDLE_TOMB)
+		i = (i + 1) & mask;
+	slot[i] = node;
+}
+
+static bool dt_phandle_grow(void)
+{
+	u32 i, size = DT_PHANDLE_MIN_SLOTS;
+	struct dt_node **slot;
+
+	while (size < dt_phandles.live * 4)
+		size <<= 1;
+
+	slot = zalloc(size * sizeof(*slot));
+	if (!slot)
+		return false;
+
+	for (i = 0; dt_phandles.slot && i <= dt_phandles.mask; i++)
+		if (dt_phandles.slot[i] &&
+		    dt_phandles.slot[i] != DT_PHANDLE_TOMB)
+			dt_phandle_insert(slot, size - 1, dt_phandles.slot[i]);
+
+	free(dt_phandles.slot);
+	dt_phandles.slot = slot;
+	dt_phandles.mask = size - 1;
+	dt_phandles.used = dt_phandles.live;
+
+	return true;
+}
+
+/* Called with dt_lock held, as is dt_phandle_del() */
+static void dt_phandle_add(struct dt_node *node)
+{
+	if (dt_phandles.broken)
+		return;
+
+	/* Keep it no more than 3/4 full */
+	if (!dt_phandles.slot ||
+	    (dt_phandles.used + 1) * 4 > (dt_phandles.mask + 1) * 3) {
+		if (!dt_phandle_grow()) {
+			prlog(PR_WARNING, "DT: phandle index disabled\n");
+			free(dt_phandles.slot);
+			dt_phandles.slot = NULL;
+			dt_phandles.broken = true;
+			return;
+		}
+	}
+
+	dt_phandle_insert(dt_phandles.slot, dt_phandles.mask, node);
+	dt_phandles.used++;
+	dt_phandles.live++;
+}
+
+/* Must be called before node->phandle changes, with the old one there */
+static void dt_phandle_del(struct dt_node *node)
+{
+	u32 i;
+
+	if (!dt_phandles.slot)
+		return;
+
+	i = dt_phandle_hash(node->phandle) & dt_phandles.mask;
+	for (; dt_phandles.slot[i]; i = (i + 1) & dt_phandles.mask) {
+		if (dt_phandles.slot[i] == node) {
+			dt_phandles.slot[i] = DT_PHANDLE_TOMB;
+			dt_phandles.live--;
+			return;
+		}
+	}
+}
+
+static void dt_set_phandle(struct dt_node *node, u32 phandle)
+{
+	lock(&dt_lock);
+	dt_phandle_del(node);
+	node->phandle = phandle;
+	dt_phandle_add(node);
+	if (node->phandle >= last_phandle)
+		set_last_phandle(node->phandle);
+	unlock(&dt_lock);
+}
+
+static u32 dt_name_hash(const char *name)
+{
+	u32 hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (u8)*name++) * 16777619u;
+
+	return hash;
+}
+
+static void dt_prop_hash_free(struct dt_node *node)
+{
+	if (!node->prop_hash)
+		return;
+
+	lock(&dt_lock);
+	list_del_from(&dt_prop_hashes, &node->prop_hash->link);
+	unlock(&dt_lock);
+	free(node->prop_hash);
+	node->prop_hash = NULL;
+}
+
+static void dt_prop_hash_insert(struct dt_prop_hash *ph, struct dt_property *p)
+{
+	u32 i = dt_name_hash(p->name) & ph->mask;
+
+	while (ph->slot[i])
+		i = (i + 1) & ph->mask;
+	ph->slot[i] = p;
+	ph->used++;
+}
+
+/*
+ * (Re)build the node's property hash if it's big enough to want one.
+ * Without memory for it, lookups just walk the list.
+ */
+static void dt_prop_hash_build(struct dt_node *node)
+{
+	struct dt_prop_hash *ph;
+	struct dt_property *p;
+	u32 count = 0, size = 32;
+
+	dt_prop_hash_free(node);
+
+	list_for_each(&node->properties, p, list)
+		count++;
+	if (count < DT_PROP_HASH_MIN)
+		return;
+
+	while (size < count * 2)
+		size <<= 1;
+
+	ph = zalloc(sizeof(*ph) + size * sizeof(ph->slot[0]));
+	if (!ph)
+		return;
+
+	ph->mask = size - 1;
+	list_for_each(&node->properties, p, list)
+		dt_prop_hash_insert(ph, p);
+
+	lock(&dt_lock);
+	list_add(&dt_prop_hashes, &ph->link);
+	unlock(&dt_lock);
+	node->prop_hash = ph;
+}
+
+static void dt_prop_hash_add(struct dt_node *node, struct dt_property *p)
+{
+	struct dt_prop_hash *ph = node->prop_hash;
+
+	if (ph && (ph->used + 1) * 2 <= ph->mask + 1)
+		dt_prop_hash_insert(ph, p);
+	else
+		dt_prop_hash_build(node);
+}
+
+static struct dt_property *dt_prop_hash_find(const struct dt_prop_hash *ph,
+					     const char *name)
+{
+	u32 i = dt_name_hash(name) & ph->mask;
+
+	for (; ph->slot[i]; i = (i + 1) & ph->mask)
+		if (strcmp(ph->slot[i]->name, name) == 0)
+			return ph->slot[i];
+
+	return NULL;
+}
+
+/*
+ * Anything that changes how big a node flattens to marks it and its
+ * parents dirty. A dirty node's parents are always dirty too, so we
+ * can stop at the first one.
+ */
+static void dt_flat_dirty(struct dt_node *node)
+{
+	for (; node && node->flat_gen; node = node->parent)
+		node->flat_gen = 0;
+}
+
+/*
+ * Node and property names are kept once each in an append-only arena,
+ * so the thousands of "reg" and "compatible" cost a pointer apiece.
+ * Names in rodata are used as they are. Nothing in it is ever freed,
+ * which is fine as the set of names in a tree doesn't grow much.
+ */
+#define DT_NAME_CHUNK		512
+#define DT_NAME_MIN_SLOTS	32
+
+static struct {
+	const char **slot;
+	u32 mask;
+	u32 used;
+	char *free;	/* in the chunk we're filling */
+	size_t left;
+} dt_names;
+
+static void dt_name_insert(const char **slot, u32 mask, const char *name)
+{
+	u32 i = dt_name_hash(name) & mask;
+
+	while (slot[i])
+		i = (i + 1) & mask;
+	slot[i] = name;
+}
+
+static void dt_names_grow(void)
+{
+	u32 i, size = dt_names.slot ? (dt_names.mask + 1) * 2 :
+		DT_NAME_MIN_SLOTS;
+	const char **slot = zalloc(size * sizeof(*slot));
+
+	if (!slot) {
+		prerror("Failed to allocate DT name table\n");
+		abort();
+	}
+
+	for (i = 0; dt_names.slot && i <= dt_names.mask; i++)
+		if (dt_names.slot[i])
+			dt_name_insert(slot, size - 1, dt_names.slot[i]);
+
+	free(dt_names.slot);
+	dt_names.slot = slot;
+	dt_names.mask = size - 1;
+}
+
+static char *dt_names_alloc(size_t len)
+{
+	char *p;
+
+	/* Big ones get their own allocation rather than wasting a chunk */
+	if (len > DT_NAME_CHUNK / 4)
+		return malloc(len);
+
+	if (len > dt_names.left) {
+		dt_names.free = malloc(DT_NAME_CHUNK);
+		if (!dt_names.free)
+			return NULL;
+		dt_names.left = DT_NAME_CHUNK;
+	}
+
+	p = dt_names.free;
+	dt_names.free += len;
+	dt_names.left -= len;
+
+	return p;
+}
+
 static const char *take_name(const char *name)
 {
-	if (!is_rodata(name) && !(name = strdup(name))) {
+	size_t len;
+	char *copy;
+	u32 i;
+
+	if (is_rodata(name))
+		return name;
+
+	lock(&dt_lock);
+	if (dt_names.slot) {
+		i = dt_name_hash(name) & dt_names.mask;
+		for (; dt_names.slot[i]; i = (i + 1) & dt_names.mask) {
+			if (streq(dt_names.slot[i], name)) {
+				copy = (char *)dt_names.slot[i];
+				goto out;
+			}
+		}
+	}
+
+	len = strlen(name) + 1;
+	copy = dt_names_alloc(len);
+	if (!copy) {
 		prerror("Failed to allocate copy of name");
 		abort();
 	}
-	return name;
+	memcpy(copy, name, len);
+
+	if ((dt_names.used + 1) * 4 > (dt_names.mask + 1) * 3)
+		dt_names_grow();
+	dt_name_insert(dt_names.slot, dt_names.mask, copy);
+	dt_names.used++;
+out:
+	unlock(&dt_lock);
+
+	return copy;
+}
+
+/*
+ * Between dt_prop_arena_begin() and dt_prop_arena_end() properties are
+ * carved out of big chunks rather than each being malloc()ed, which is
+ * a lot less heap for the thousands of little ones HDAT parsing makes.
+ * They're never given back: deleting one, or growing it, leaves the old
+ * copy where it was.
+ */
+#define DT_PROP_CHUNK		(8 * 1024)
+
+struct dt_prop_chunk {
+	struct list_node link;
+	size_t size;
+	char data[];
+};
+
+static struct {
+	bool on;
+	struct list_head chunks;
+	char *free;	/* in the chunk we're filling */
+	size_t left;
+} dt_prop_arena = {
+	.chunks = LIST_HEAD_INIT(dt_prop_arena.chunks),
+};
+
+void dt_prop_arena_begin(void)
+{
+	lock(&dt_lock);
+	dt_prop_arena.on = true;
+	unlock(&dt_lock);
+}
+
+void dt_prop_arena_end(void)
+{
+	lock(&dt_lock);
+	dt_prop_arena.on = false;
+	unlock(&dt_lock);
+}
+
+static bool dt_prop_in_arena(const struct dt_property *p)
+{
+	const struct dt_prop_chunk *c;
+	bool found = false;
+
+	lock(&dt_lock);
+	list_for_each(&dt_prop_arena.chunks, c, link) {
+		if ((const char *)p >= c->data &&
+		    (const char *)p < c->data + c->size) {
+			found = true;
+			break;
+		}
+	}
+	unlock(&dt_lock);
+
+	return found;
+}
+
+static struct dt_property *dt_alloc_property(size_t size)
+{
+	struct dt_prop_chunk *c;
+	struct dt_property *p = NULL;
+
+	size = ALIGN_UP(sizeof(*p) + size, sizeof(u64));
+	if (size > DT_PROP_CHUNK / 8)
+		return malloc(size);
+
+	lock(&dt_lock);
+	if (dt_prop_arena.on && size > dt_prop_arena.left) {
+		c = malloc(sizeof(*c) + DT_PROP_CHUNK);
+		if (c) {
+			c->size = DT_PROP_CHUNK;
+			list_add_tail(&dt_prop_arena.chunks, &c->link);
+			dt_prop_arena.free = c->data;
+			dt_prop_arena.left = DT_PROP_CHUNK;
+		}
+	}
+	if (dt_prop_arena.on && size <= dt_prop_arena.left) {
+		p = (struct dt_property *)dt_prop_arena.free;
+		dt_prop_arena.free += size;
+		dt_prop_arena.left -= size;
+	}
+	unlock(&dt_lock);
+
+	return p ? p : malloc(size);
 }
 
-static void free_name(const char *name)
+static void dt_free_property(struct dt_property *p)
 {
-	if (!is_rodata(name))
-		free((char *)name);
+	if (!dt_prop_in_arena(p))
+		free(p);
 }
 
 static struct dt_node *new_node(const char *name)
@@ -46,10 +463,14 @@ static struct dt_node *new_node(const char *name)
 
 	node->name = take_name(name);
 	node->parent = NULL;
+	node->prop_hash = NULL;
+	node->flat_gen = 0;
 	list_head_init(&node->properties);
 	list_head_init(&node->children);
-	/* FIXME: locking? */
+	lock(&dt_lock);
 	node->phandle = new_phandle();
+	dt_phandle_add(node);
+	unlock(&dt_lock);
 	return node;
 }
 
@@ -100,6 +521,7 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 	if (list_empty(&parent->children)) {
 		list_add(&parent->children, &root->list);
 		root->parent = parent;
+		dt_flat_dirty(parent);
 
 		return true;
 	}
@@ -122,6 +544,7 @@ bool dt_attach_root(struct dt_node *parent, struct dt_node *root)
 
 	list_add_before(&parent->children, &root->list, &node->list);
 	root->parent = parent;
+	dt_flat_dirty(parent);
 
 	return true;
 }
@@ -131,7 +554,10 @@ static inline void dt_destroy(struct dt_node *dn)
 	if (!dn)
 		return;
 
-	free_name(dn->name);
+	lock(&dt_lock);
+	dt_phandle_del(dn);
+	unlock(&dt_lock);
+	dt_prop_hash_free(dn);
 	free(dn);
 }
 	
@@ -408,10 +834,44 @@ struct dt_node *dt_new_check(struct dt_node *parent, const char *name)
 }
 
 
+/* Is node somewhere below root? */
+static bool dt_is_below(const struct dt_node *root, const struct dt_node *node)
+{
+	for (node = node->parent; node; node = node->parent)
+		if (node == root)
+			return true;
+
+	return false;
+}
+
 struct dt_node *dt_find_by_phandle(struct dt_node *root, u32 phandle)
 {
-	struct dt_node *node;
+	struct dt_node *node, *found = NULL;
+	bool indexed;
+	u32 i;
+
+	lock(&dt_lock);
+	indexed = dt_phandles.slot != NULL;
+	i = dt_phandle_hash(phandle) & dt_phandles.mask;
+	for (; indexed && dt_phandles.slot[i]; i = (i + 1) & dt_phandles.mask) {
+		node = dt_phandles.slot[i];
+		if (node == DT_PHANDLE_TOMB || node->phandle != phandle ||
+		    !dt_is_below(root, node))
+			continue;
+
+		/* More than one, the first in the tree is the one we want */
+		if (found) {
+			indexed = false;
+			break;
+		}
+		found = node;
+	}
+	unlock(&dt_lock);
 
+	if (indexed)
+		return found;
+
+	/* No index, or it can't tell us which */
 	dt_for_each_node(root, node)
 		if (node->phandle == phandle)
 			return node;
@@ -421,7 +881,7 @@ struct dt_node *dt_find_by_phandle(struct dt_node *root, u32 phandle)
 static struct dt_property *new_property(struct dt_node *node,
 					const char *name, size_t size)
 {
-	struct dt_property *p = malloc(sizeof(*p) + size);
+	struct dt_property *p = dt_alloc_property(size);
 	char *path;
 
 	if (!p) {
@@ -443,6 +903,8 @@ static struct dt_property *new_property(struct dt_node *node,
 	p->name = take_name(name);
 	p->len = size;
 	list_add_tail(&node->properties, &p->list);
+	dt_prop_hash_add(node, p);
+	dt_flat_dirty(node);
 	return p;
 }
 
@@ -459,9 +921,7 @@ struct dt_property *dt_add_property(struct dt_node *node,
 	if (strcmp(name, "linux,phandle") == 0 ||
 	    strcmp(name, "phandle") == 0) {
 		assert(size == 4);
-		node->phandle = *(const u32 *)val;
-		if (node->phandle >= last_phandle)
-			set_last_phandle(node->phandle);
+		dt_set_phandle(node, *(const u32 *)val);
 		return NULL;
 	}
 
@@ -474,12 +934,39 @@ struct dt_property *dt_add_property(struct dt_node *node,
 void dt_resize_property(struct dt_property **prop, size_t len)
 {
 	size_t new_len = sizeof(**prop) + len;
+	struct dt_property *old = *prop;
+	struct dt_prop_hash *ph;
+	u32 i;
+
+	if (dt_prop_in_arena(old)) {
+		*prop = malloc(new_len);
+		memcpy(*prop, old, sizeof(*old) + MIN(old->len, len));
+	} else {
+		*prop = realloc(*prop, new_len);
+	}
 
-	*prop = realloc(*prop, new_len);
+	/* We don't know which node it's in, so every cached size goes */
+	dt_flat_gen++;
 
 	/* Fix up linked lists in case we moved. (note: not an empty list). */
 	(*prop)->list.next->prev = &(*prop)->list;
 	(*prop)->list.prev->next = &(*prop)->list;
+
+	/* And the property hash of whichever node it's in */
+	if (*prop == old)
+		return;
+	lock(&dt_lock);
+	list_for_each(&dt_prop_hashes, ph, link) {
+		i = dt_name_hash((*prop)->name) & ph->mask;
+		for (; ph->slot[i]; i = (i + 1) & ph->mask) {
+			if (ph->slot[i] == old) {
+				ph->slot[i] = *prop;
+				goto out;
+			}
+		}
+	}
+out:
+	unlock(&dt_lock);
 }
 
 struct dt_property *dt_add_property_string(struct dt_node *node,
@@ -582,8 +1069,10 @@ struct dt_property *__dt_add_property_strings(struct dt_node *node,
 void dt_del_property(struct dt_node *node, struct dt_property *prop)
 {
 	list_del_from(&node->properties, &prop->list);
-	free_name(prop->name);
-	free(prop);
+	if (node->prop_hash)
+		dt_prop_hash_build(node);
+	dt_flat_dirty(node);
+	dt_free_property(prop);
 }
 
 u32 dt_property_get_cell(const struct dt_property *prop, u32 index)
@@ -639,6 +1128,9 @@ struct dt_property *__dt_find_property(struct dt_node *node, const char *name)
 {
 	struct dt_property *i;
 
+	if (node->prop_hash)
+		return dt_prop_hash_find(node->prop_hash, name);
+
 	list_for_each(&node->properties, i, list)
 		if (strcmp(i->name, name) == 0)
 			return i;
@@ -650,6 +1142,9 @@ const struct dt_property *dt_find_property(const struct dt_node *node,
 {
 	const struct dt_property *i;
 
+	if (node->prop_hash)
+		return dt_prop_hash_find(node->prop_hash, name);
+
 	list_for_each(&node->properties, i, list)
 		if (strcmp(i->name, name) == 0)
 			return i;
@@ -826,13 +1321,15 @@ void dt_free(struct dt_node *node)
 	while ((child = list_top(&node->children, struct dt_node, list)))
 		dt_free(child);
 
+	dt_prop_hash_free(node);
 	while ((p = list_pop(&node->properties, struct dt_property, list))) {
-		free_name(p->name);
-		free(p);
+		dt_free_property(p);
 	}
 
-	if (node->parent)
+	if (node->parent) {
+		dt_flat_dirty(node->parent);
 		list_del_from(&node->parent->children, &node->list);
+	}
 	dt_destroy(node);
 }
 
@@ -1092,7 +1589,7 @@ void dt_adjust_subtree_phandle(struct dt_node *dev,
 
 	dt_for_each_node(dev, node) {
 		const char **props_to_update;
-		node->phandle += import_phandle;
+		dt_set_phandle(node, node->phandle + import_phandle);
 
 		/*
 		 * calculate max_phandle(new_tree), needed to update
@@ -133,6 +133,77 @@ static void flatten_dt_node(void *fdt, const struct dt_node *root,
 		dt_end_node(fdt);
 }
 
+/*
+ * Work out how much of the struct and strings blocks a subtree takes,
+ * counting every property name as if libfdt didn't dedup them. Sizes
+ * stay cached in the nodes until device.c marks them dirty, so only
+ * subtrees that changed since the last flatten get walked again.
+ */
+static void dt_flat_size(struct dt_node *dn)
+{
+	const struct dt_property *p;
+	struct dt_node *child;
+
+	if (dn->flat_gen == dt_flat_gen)
+		return;
+
+	/* FDT_BEGIN_NODE with the name, the phandle, and FDT_END_NODE */
+	dn->flat_struct = FDT_TAGSIZE +
+		ALIGN_UP(strlen(dn->name) + 1, FDT_TAGSIZE) +
+		sizeof(struct fdt_property) + sizeof(u32) + FDT_TAGSIZE;
+	dn->flat_strings = sizeof("phandle");
+
+	list_for_each(&dn->properties, p, list) {
+		if (strstarts(p->name, DT_PRIVATE))
+			continue;
+
+		dn->flat_struct += sizeof(struct fdt_property) +
+			ALIGN_UP(p->len, FDT_TAGSIZE);
+		dn->flat_strings += strlen(p->name) + 1;
+	}
+
+	list_for_each(&dn->children, child, list) {
+		dt_flat_size(child);
+		dn->flat_struct += child->flat_struct;
+		dn->flat_strings += child->flat_strings;
+	}
+
+	dn->flat_gen = dt_flat_gen;
+}
+
+/*
+ * The size of the FDT __create_dtb() will make. It's exact, other than
+ * the room saved by name dedup which we don't bother predicting.
+ */
+static size_t dtb_size(const struct dt_node *root, bool exclusive)
+{
+	struct dt_node *dn = (struct dt_node *)root;
+	const struct dt_property *prop;
+	const struct dt_node *i;
+	size_t size, entries = 1;
+
+	if (root == dt_root && !exclusive) {
+		prop = dt_find_property(root, "reserved-ranges");
+		if (prop)
+			entries += prop->len / (sizeof(uint64_t) * 2);
+	}
+
+	size = ALIGN_UP(sizeof(struct fdt_header),
+			sizeof(struct fdt_reserve_entry));
+	size += entries * sizeof(struct fdt_reserve_entry);
+
+	dt_flat_size(dn);
+	if (exclusive) {
+		list_for_each(&root->children, i, list)
+			size += i->flat_struct + i->flat_strings;
+	} else {
+		size += root->flat_struct + root->flat_strings;
+	}
+
+	/* FDT_END */
+	return size + FDT_TAGSIZE;
+}
+
 static void create_dtb_reservemap(void *fdt, const struct dt_node *root)
 {
 	uint64_t base, size;
@@ -188,28 +259,38 @@ err:
 
 void *create_dtb(const struct dt_node *root, bool exclusive)
 {
-	void *fdt = NULL;
-	size_t len = DEVICE_TREE_MAX_SIZE;
 	uint32_t old_last_phandle = get_last_phandle();
+	bool retried = false;
+	void *fdt;
+	size_t len;
 	int ret;
 
-	do {
-		set_last_phandle(old_last_phandle);
-		fdt_error = 0;
-		fdt = malloc(len);
-		if (!fdt) {
-			prerror("dtb: could not malloc %lu\n", (long)len);
-			return NULL;
-		}
+again:
+	len = dtb_size(root, exclusive);
+	fdt = malloc(len);
+	if (!fdt) {
+		prerror("dtb: could not malloc %lu\n", (long)len);
+		return NULL;
+	}
 
-		ret = __create_dtb(fdt, len, root, exclusive);
-		if (ret) {
-			free(fdt);
-			fdt = NULL;
+	fdt_error = 0;
+	ret = __create_dtb(fdt, len, root, exclusive);
+	if (ret) {
+		set_last_phandle(old_last_phandle);
+		free(fdt);
+		fdt = NULL;
+
+		/*
+		 * Something changed a property's length without telling
+		 * device.c, size the whole thing up again from scratch.
+		 */
+		if (ret == -FDT_ERR_NOSPACE && !retried) {
+			prerror("dtb: %lu bytes wasn't enough\n", (long)len);
+			dt_flat_gen++;
+			retried = true;
+			goto again;
 		}
-
-		len *= 2;
-	} while (ret == -FDT_ERR_NOSPACE);
+	}
 
 	return fdt;
 }
@@ -220,7 +301,6 @@ static int64_t opal_get_device_tree(uint32_t phandle,
 	struct dt_node *root;
 	void *fdt = (void *)buf;
 	uint32_t old_last_phandle;
-	int64_t totalsize;
 	int ret;
 
 	if (!opal_addr_valid(fdt))
@@ -230,14 +310,9 @@ static int64_t opal_get_device_tree(uint32_t phandle,
 	if (!root)
 		return OPAL_PARAMETER;
 
-	if (!fdt) {
-		fdt = create_dtb(root, true);
-		if (!fdt)
-			return OPAL_INTERNAL_ERROR;
-		totalsize = fdt_totalsize(fdt);
-		free(fdt);
-		return totalsize;
-	}
+	/* Enough to hold it, no need to flatten it to find out */
+	if (!fdt)
+		return dtb_size(root, true);
 
 	if (!len)
 		return OPAL_PARAMETER;
@@ -22,6 +22,7 @@
 #include <libflash/ecc.h>
 #include <libstb/secureboot.h>
 #include <libstb/trustedboot.h>
+#include <libstb/hashed-read.h>
 #include <libxz/xz.h>
 #include <elf.h>
 #include <timebase.h>
@@ -34,6 +35,13 @@ struct flash {
 	uint64_t		size;
 	uint32_t		block_size;
 	int			id;
+	/*
+	 * Parsed partition table, kept until something writes over where
+	 * it came from. NULL if it hasn't been read (or wasn't there).
+	 */
+	struct ffs_handle	*ffs;
+	uint32_t		toc_offset;
+	uint32_t		toc_size;
 };
 
 static struct {
@@ -59,6 +67,40 @@ static struct lock flash_lock;
 static struct flash *nvram_flash;
 static u32 nvram_offset, nvram_size;
 
+/* Called with flash_lock held, or before the flash is on the list */
+static struct ffs_handle *flash_get_ffs(struct flash *flash)
+{
+	int rc;
+
+	if (flash->ffs)
+		return flash->ffs;
+
+	rc = ffs_init(0, flash->size, flash->bl, &flash->ffs, 1);
+	if (rc) {
+		prerror("Can't open ffs handle: %d\n", rc);
+		return NULL;
+	}
+	ffs_toc_info(flash->ffs, &flash->toc_offset, &flash->toc_size);
+
+	return flash->ffs;
+}
+
+/* Drop the cached partition table if [offset, offset + size) overlaps it */
+static void flash_invalidate_ffs(struct flash *flash, uint64_t offset,
+				 uint64_t size)
+{
+	if (!flash->ffs)
+		return;
+
+	if (offset >= flash->toc_offset + flash->toc_size ||
+	    offset + size <= flash->toc_offset)
+		return;
+
+	prlog(PR_DEBUG, "Partition table changed, dropping cached copy\n");
+	ffs_close(flash->ffs);
+	flash->ffs = NULL;
+}
+
 bool flash_reserve(void)
 {
 	bool rc = false;
@@ -79,6 +121,8 @@ void flash_release(void)
 {
 	lock(&flash_lock);
 	system_flash->busy = false;
+	/* Whoever had it could have rewritten anything */
+	flash_invalidate_ffs(system_flash, 0, system_flash->size);
 	unlock(&flash_lock);
 }
 
@@ -177,6 +221,7 @@ static int flash_nvram_write(uint32_t dst, void *src, uint32_t len)
 
 	lock(&flash_lock);
 	nvram_flash->busy = false;
+	flash_invalidate_ffs(nvram_flash, nvram_offset + dst, len);
 out:
 	unlock(&flash_lock);
 	return rc;
@@ -257,15 +302,10 @@ static struct dt_node *flash_add_dt_node(struct flash *flash, int id)
 	dt_add_property_cells(partition_container_node, "#size-cells", 1);
 
 	/* Add partitions */
-	for (i = 0, name = NULL; i < ARRAY_SIZE(part_name_map); i++) {
+	ffs = flash->ffs;
+	for (i = 0, name = NULL; ffs && i < ARRAY_SIZE(part_name_map); i++) {
 		name = part_name_map[i].name;
 
-		rc = ffs_init(0, flash->size, flash->bl, &ffs, 1);
-		if (rc) {
-			prerror("Can't open ffs handle\n");
-			continue;
-		}
-
 		rc = ffs_lookup_part(ffs, name, &ffs_part_num);
 		if (rc) {
 			/* This is not an error per-se, some partitions
@@ -378,6 +418,7 @@ int flash_register(struct blocklevel_device *bl)
 	flash->size = size;
 	flash->block_size = block_size;
 	flash->id = num_flashes();
+	flash->ffs = NULL;
 
 	rc = ffs_init(0, flash->size, bl, &ffs, 1);
 	if (rc) {
@@ -390,15 +431,16 @@ int flash_register(struct blocklevel_device *bl)
 		prlog(PR_WARNING, "No ffs info; "
 				"using raw device only\n");
 		ffs = NULL;
+	} else {
+		/* Keep it for flash_load_resource() */
+		flash->ffs = ffs;
+		ffs_toc_info(ffs, &flash->toc_offset, &flash->toc_size);
 	}
 
 	node = flash_add_dt_node(flash, flash->id);
 
 	setup_system_flash(flash, node, name, ffs);
 
-	if (ffs)
-		ffs_close(ffs);
-
 	lock(&flash_lock);
 	list_add(&flashes, &flash->list);
 	unlock(&flash_lock);
@@ -455,9 +497,11 @@ static int64_t opal_flash_op(enum flash_op op, uint64_t id, uint64_t offset,
 		break;
 	case FLASH_OP_WRITE:
 		rc = blocklevel_raw_write(flash->bl, offset, (void *)buf, size);
+		flash_invalidate_ffs(flash, offset, size);
 		break;
 	case FLASH_OP_ERASE:
 		rc = blocklevel_erase(flash->bl, offset, size);
+		flash_invalidate_ffs(flash, offset, size);
 		break;
 	default:
 		assert(0);
@@ -544,8 +588,46 @@ static size_t sizeof_elf_from_hdr(void *buf)
 	return sz;
 }
 
+static int flash_hashed_read_fn(void *priv, uint64_t pos, void *buf,
+				uint64_t len)
+{
+	return blocklevel_read(priv, pos, buf, len);
+}
+
 /*
- * load a resource from FLASH
+ * Read what's going to be measured, hashing it along the way if it's
+ * going to be measured.
+ */
+static int flash_read_measured(struct flash *flash, struct hashed_read *h,
+			       uint64_t pos, void *buf, uint64_t len)
+{
+	if (!h)
+		return blocklevel_read(flash->bl, pos, buf, len);
+
+	return hashed_read(h, flash_hashed_read_fn, flash->bl, pos, buf, len);
+}
+
+struct flash_load_resource_item {
+	enum resource_id id;
+	uint32_t subid;
+	int result;
+	void *buf;
+	size_t *len;
+	/*
+	 * Where its partition starts, preloads are read in that order. Only
+	 * the loader looks it up, so queueing never waits on flash_lock.
+	 */
+	uint32_t part_start;
+	bool part_known;
+	/* Left by flash_read_resource() for flash_finish_resource() */
+	void *bufp;
+	int content_size;
+	struct hashed_read hash, *h;
+	struct list_node link;
+};
+
+/*
+ * read a resource from FLASH
  * buf and len shouldn't account for ECC even if partition is ECCed.
  *
  * The API here is a bit strange.
@@ -554,10 +636,16 @@ static size_t sizeof_elf_from_hdr(void *buf)
  * For trusted boot, the whole partition containing the subpart is measured.
  *
  * Additionally, the logic to work out how much to read from flash is insane.
+ *
+ * This only does the flash access, flash_finish_resource() does the rest
+ * so it can happen while the next resource is read.
  */
-static int flash_load_resource(enum resource_id id, uint32_t subid,
-			       void *buf, size_t *len)
+static int flash_read_resource(struct flash_load_resource_item *r)
 {
+	enum resource_id id = r->id;
+	uint32_t subid = r->subid;
+	void *buf = r->buf;
+	size_t *len = r->len;
 	int i;
 	int rc = OPAL_RESOURCE;
 	struct ffs_handle *ffs;
@@ -571,6 +659,8 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 	int ffs_part_num, ffs_part_start, ffs_part_size;
 	int content_size = 0;
 	int offset = 0;
+	struct hashed_read *h = NULL;
+	uint8_t digest[SHA512_DIGEST_LENGTH];
 
 	lock(&flash_lock);
 
@@ -610,9 +700,9 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		goto out_unlock;
 	}
 
-	rc = ffs_init(0, flash->size, flash->bl, &ffs, 1);
-	if (rc) {
-		prerror("Can't open ffs handle: %d\n", rc);
+	ffs = flash_get_ffs(flash);
+	if (!ffs) {
+		rc = OPAL_RESOURCE;
 		goto out_unlock;
 	}
 
@@ -622,13 +712,13 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		 * are purposefully absent, don't spam the logs
 		 */
 	        prlog(PR_DEBUG, "No %s partition\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	rc = ffs_part_info(ffs, ffs_part_num, NULL,
 			   &ffs_part_start, NULL, &ffs_part_size, &ecc);
 	if (rc) {
 		prerror("Failed to get %s partition info\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	prlog(PR_DEBUG,"%s partition %s ECC\n",
 	      name, ecc  ? "has" : "doesn't have");
@@ -640,7 +730,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 	if (ffs_part_size < SECURE_BOOT_HEADERS_SIZE) {
 		prerror("secboot headers bigger than "
 			"partition size 0x%x\n", ffs_part_size);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 
 	rc = blocklevel_read(flash->bl, ffs_part_start, bufp,
@@ -649,7 +739,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		prerror("failed to read the first 0x%x from "
 			"%s partition, rc %d\n", SECURE_BOOT_HEADERS_SIZE,
 			name, rc);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 
 	part_signed = stb_is_container(bufp, SECURE_BOOT_HEADERS_SIZE);
@@ -657,6 +747,16 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 	prlog(PR_DEBUG, "%s partition %s signed\n", name,
 	      part_signed ? "is" : "isn't");
 
+	/*
+	 * Hash what trustedboot_measure() would as we read it, so the hash
+	 * overlaps the (slow) flash reads instead of being another pass over
+	 * the whole resource afterwards.
+	 */
+	if (trustedboot_measuring(id)) {
+		h = &r->hash;
+		hashed_read_init(h);
+	}
+
 	/*
 	 * part_start/size are raw pointers into the partition.
 	 *  ie. they will account for ECC if included.
@@ -671,25 +771,25 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (content_size > bufsz) {
 			prerror("content size > buffer size\n");
 			rc = OPAL_PARAMETER;
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		if (*len > ffs_part_size) {
 			prerror("FLASH: Cannot load %s. Content is larger than the partition\n",
 					name);
 			rc = OPAL_PARAMETER;
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		ffs_part_start += SECURE_BOOT_HEADERS_SIZE;
 
-		rc = blocklevel_read(flash->bl, ffs_part_start, bufp,
-					  content_size);
+		rc = flash_read_measured(flash, h, ffs_part_start, bufp,
+					 content_size);
 		if (rc) {
 			prerror("failed to read content size %d"
 				" %s partition, rc %d\n",
 				content_size, name, rc);
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		if (subid == RESOURCE_SUBID_NONE)
@@ -700,7 +800,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (rc) {
 			prerror("Failed to parse subpart info for %s\n",
 				name);
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 		bufp += offset;
 		goto done_reading;
@@ -722,7 +822,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 					prerror("Invalid ELF header part"
 						" %s\n", name);
 					rc = OPAL_RESOURCE;
-					goto out_free_ffs;
+					goto out_unlock;
 				}
 			} else {
 				content_size = ffs_part_size;
@@ -732,17 +832,17 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 					" buffer size %lu\n", name,
 					content_size, bufsz);
 				rc = OPAL_PARAMETER;
-				goto out_free_ffs;
+				goto out_unlock;
 			}
 			prlog(PR_DEBUG, "computed %s size %u\n",
 			      name, content_size);
-			rc = blocklevel_read(flash->bl, ffs_part_start,
-						  buf, content_size);
+			rc = flash_read_measured(flash, h, ffs_part_start,
+						 buf, content_size);
 			if (rc) {
 				prerror("failed to read content size %d"
 					" %s partition, rc %d\n",
 					content_size, name, rc);
-				goto out_free_ffs;
+				goto out_unlock;
 			}
 			*len = content_size;
 			goto done_reading;
@@ -754,7 +854,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (rc) {
 			prerror("FAILED reading subpart info. rc=%d\n",
 				rc);
-			goto out_free_ffs;
+			goto out_unlock;
 		}
 
 		*len = ffs_part_size;
@@ -767,49 +867,55 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		 * Afterwards, we memmove() things back into place for
 		 * the caller.
 		 */
-		rc = blocklevel_read(flash->bl, ffs_part_start,
-					  buf, ffs_part_size);
+		rc = flash_read_measured(flash, h, ffs_part_start,
+					 buf, ffs_part_size);
 
 		bufp += offset;
 	}
 
 done_reading:
+	r->bufp = bufp;
+	r->content_size = content_size;
+	r->h = h;
+	h = NULL;
+	status = true;
+
+out_unlock:
+	if (h)
+		hashed_read_finish(h, digest);
+	unlock(&flash_lock);
+	return status ? OPAL_SUCCESS : rc;
+}
+
+static void flash_finish_resource(struct flash_load_resource_item *r)
+{
+	uint8_t digest[SHA512_DIGEST_LENGTH];
+
 	/*
 	 * Verify and measure the retrieved PNOR partition as part of the
 	 * secure boot and trusted boot requirements
 	 */
-	secureboot_verify(id, buf, *len);
-	trustedboot_measure(id, buf, *len);
+	secureboot_verify(r->id, r->buf, *r->len);
+	if (r->h && hashed_read_finish(r->h, digest))
+		trustedboot_measure_digest(r->id, digest);
+	else
+		trustedboot_measure(r->id, r->buf, *r->len);
+	r->h = NULL;
 
 	/* Find subpartition */
-	if (subid != RESOURCE_SUBID_NONE) {
-		memmove(buf, bufp, content_size);
-		*len = content_size;
+	if (r->subid != RESOURCE_SUBID_NONE) {
+		memmove(r->buf, r->bufp, r->content_size);
+		*r->len = r->content_size;
 	}
-
-	status = true;
-
-out_free_ffs:
-	ffs_close(ffs);
-out_unlock:
-	unlock(&flash_lock);
-	return status ? OPAL_SUCCESS : rc;
 }
 
 
-struct flash_load_resource_item {
-	enum resource_id id;
-	uint32_t subid;
-	int result;
-	void *buf;
-	size_t *len;
-	struct list_node link;
-};
-
 static LIST_HEAD(flash_load_resource_queue);
 static LIST_HEAD(flash_loaded_resources);
 static struct lock flash_load_resource_lock = LOCK_UNLOCKED;
 static struct cpu_job *flash_load_job = NULL;
+/* From queueing flash_load_job until it has nothing left to do */
+static bool flash_loading;
 
 int flash_resource_loaded(enum resource_id id, uint32_t subid)
 {
@@ -831,7 +937,7 @@ int flash_resource_loaded(enum resource_id id, uint32_t subid)
 		free(resource);
 	}
 
-	if (list_empty(&flash_load_resource_queue) && flash_load_job) {
+	if (!flash_loading && flash_load_job) {
 		cpu_wait_job(flash_load_job, true);
 		flash_load_job = NULL;
 	}
@@ -848,28 +954,111 @@ int flash_resource_loaded(enum resource_id id, uint32_t subid)
 #define FLASH_LOAD_WAIT_MS	5000
 #define FLASH_LOAD_RETRIES	(2 * 5 * (60 / (FLASH_LOAD_WAIT_MS / 1000)))
 
+/* Called with flash_load_resource_lock held */
+static void flash_resource_done(struct flash_load_resource_item *r,
+				int result)
+{
+	list_del(&r->link);
+	r->result = result;
+	list_add_tail(&flash_loaded_resources, &r->link);
+}
+
+static void flash_finish_resource_job(void *data)
+{
+	struct flash_load_resource_item *r = data;
+
+	flash_finish_resource(r);
+
+	lock(&flash_load_resource_lock);
+	flash_resource_done(r, OPAL_SUCCESS);
+	unlock(&flash_load_resource_lock);
+}
+
+/* Where the resource's partition starts, or UINT32_MAX if we can't tell */
+static uint32_t flash_resource_start(enum resource_id id)
+{
+	struct ffs_handle *ffs;
+	uint32_t part, start = UINT32_MAX;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(part_name_map); i++)
+		if (part_name_map[i].id == id)
+			break;
+	if (i == ARRAY_SIZE(part_name_map))
+		return start;
+
+	lock(&flash_lock);
+	if (system_flash && !system_flash->busy) {
+		ffs = flash_get_ffs(system_flash);
+		if (ffs && !ffs_lookup_part(ffs, part_name_map[i].name, &part) &&
+		    ffs_part_info(ffs, part, NULL, &start, NULL, NULL, NULL))
+			start = UINT32_MAX;
+	}
+	unlock(&flash_lock);
+
+	return start;
+}
+
+/*
+ * Called with flash_load_resource_lock held, which is dropped while
+ * looking partitions up. Queued items that aren't started yet are only
+ * touched by the loader, so they can't go away meanwhile.
+ */
+static struct flash_load_resource_item *flash_next_resource(void)
+{
+	struct flash_load_resource_item *r, *n;
+
+again:
+	r = NULL;
+	list_for_each(&flash_load_resource_queue, n, link) {
+		if (n->result != OPAL_EMPTY)
+			continue;
+		if (!n->part_known) {
+			unlock(&flash_load_resource_lock);
+			n->part_start = flash_resource_start(n->id);
+			n->part_known = true;
+			lock(&flash_load_resource_lock);
+			goto again;
+		}
+		/* Lowest in flash, first queued of equals */
+		if (!r || n->part_start < r->part_start)
+			r = n;
+	}
+
+	return r;
+}
+
+/*
+ * Reads the queued resources one after the other, in the order they are
+ * in flash. Verifying, measuring and unpacking each one is handed to
+ * another CPU, so it happens while the next one is read. Those are done
+ * one at a time, in the same order, so what's measured goes into the
+ * TPM event log in a repeatable order.
+ */
 static void flash_load_resources(void *data __unused)
 {
 	struct flash_load_resource_item *r;
+	struct cpu_job *finishing = NULL;
 	int retries = FLASH_LOAD_RETRIES;
 	int result = OPAL_RESOURCE;
 
 	lock(&flash_load_resource_lock);
 	do {
-		if (list_empty(&flash_load_resource_queue)) {
-			break;
+		r = flash_next_resource();
+		if (!r) {
+			if (!finishing)
+				break;
+			unlock(&flash_load_resource_lock);
+			cpu_wait_job(finishing, true);
+			finishing = NULL;
+			lock(&flash_load_resource_lock);
+			continue;
 		}
-		r = list_top(&flash_load_resource_queue,
-			     struct flash_load_resource_item, link);
-		if (r->result != OPAL_EMPTY)
-			prerror("flash_load_resources() list_top unexpected "
-				" result %d\n", r->result);
 		r->result = OPAL_BUSY;
 		unlock(&flash_load_resource_lock);
 
 		while (retries) {
-			result = flash_load_resource(r->id, r->subid, r->buf,
-						     r->len);
+			result = flash_read_resource(r);
 			if (result == OPAL_SUCCESS) {
 				retries = FLASH_LOAD_RETRIES;
 				break;
@@ -888,13 +1077,24 @@ static void flash_load_resources(void *data __unused)
 			      r->id, r->subid, retries);
 		}
 
-		lock(&flash_load_resource_lock);
-		r = list_pop(&flash_load_resource_queue,
-			     struct flash_load_resource_item, link);
-		/* Will reuse the result from when we hit retries == 0 */
-		r->result = result;
-		list_add_tail(&flash_loaded_resources, &r->link);
+		if (finishing) {
+			cpu_wait_job(finishing, true);
+			finishing = NULL;
+		}
+
+		if (result == OPAL_SUCCESS) {
+			finishing = cpu_queue_job(NULL, "flash_finish_resource",
+						  flash_finish_resource_job, r);
+			if (!finishing)
+				flash_finish_resource_job(r);
+			lock(&flash_load_resource_lock);
+		} else {
+			lock(&flash_load_resource_lock);
+			/* Will reuse the result from when we hit retries == 0 */
+			flash_resource_done(r, result);
+		}
 	} while(true);
+	flash_loading = false;
 	unlock(&flash_load_resource_lock);
 }
 
@@ -915,7 +1115,7 @@ int flash_start_preload_resource(enum resource_id id, uint32_t subid,
 	struct flash_load_resource_item *r;
 	bool start_thread = false;
 
-	r = malloc(sizeof(struct flash_load_resource_item));
+	r = zalloc(sizeof(struct flash_load_resource_item));
 
 	assert(r != NULL);
 	r->id = id;
@@ -928,7 +1128,8 @@ int flash_start_preload_resource(enum resource_id id, uint32_t subid,
 	      r->id, r->subid);
 
 	lock(&flash_load_resource_lock);
-	if (list_empty(&flash_load_resource_queue)) {
+	if (!flash_loading) {
+		flash_loading = true;
 		start_thread = true;
 	}
 	list_add_tail(&flash_load_resource_queue, &r->link);
@@ -952,7 +1153,93 @@ int flash_start_preload_resource(enum resource_id id, uint32_t subid,
  * When the decompression is successful, the xz_decompress->status will be
  * `OPAL_SUCCESS` else OPAL_PARAMETER, see definition of xz_decompress structure
  * for details.
+ *
+ * Images compressed as several blocks (xz --block-size) are decompressed a
+ * block per CPU.
+ */
+struct xz_block_job {
+	struct xz_decompress *xz;
+	struct xz_block *block;
+	enum xz_ret xz_error;
+};
+
+static void xz_decompress_block(void *data)
+{
+	struct xz_block_job *j = data;
+	struct xz_dec *s;
+
+	s = xz_dec_init(XZ_SINGLE, 0);
+	if (s == NULL) {
+		j->xz_error = XZ_MEM_ERROR;
+		return;
+	}
+
+	j->xz_error = xz_dec_block(s, j->xz->src, j->block,
+				   j->xz->dst + j->block->out_pos);
+	xz_dec_end(s);
+}
+
+/*
+ * The blocks of a multi-block stream (xz --block-size) are independent,
+ * so each one is decompressed by its own job into its own part of dst.
+ * Returns false, having done nothing, if it has to be done in one go.
  */
+static bool xz_decompress_blocks(struct xz_decompress *xz)
+{
+	struct cpu_job_group *grp;
+	struct xz_block_job *jobs;
+	struct xz_block *blocks;
+	size_t i, count = 0;
+
+	if (xz_dec_index(xz->src, xz->src_size, NULL, &count) != XZ_OK ||
+	    count < 2)
+		return false;
+
+	blocks = zalloc(count * sizeof(*blocks));
+	jobs = zalloc(count * sizeof(*jobs));
+	grp = cpu_job_group_alloc();
+	if (!blocks || !jobs || !grp)
+		goto fallback;
+
+	xz_dec_index(xz->src, xz->src_size, blocks, &count);
+	if (blocks[count - 1].out_pos + blocks[count - 1].out_size >
+	    xz->dst_size)
+		goto fallback;
+
+	for (i = 0; i < count; i++) {
+		jobs[i].xz = xz;
+		jobs[i].block = &blocks[i];
+		if (!cpu_job_group_add(grp, -1, "xz_decompress_block",
+				       xz_decompress_block, &jobs[i]))
+			xz_decompress_block(&jobs[i]);
+	}
+	cpu_job_group_submit(grp);
+	cpu_job_group_wait(grp);
+
+	xz->xz_error = XZ_STREAM_END;
+	for (i = 0; i < count; i++) {
+		if (jobs[i].xz_error != XZ_STREAM_END) {
+			prerror("failed to decompress block %zu of %zu\n",
+				i, count);
+			xz->xz_error = jobs[i].xz_error;
+			break;
+		}
+	}
+	xz->status = xz->xz_error == XZ_STREAM_END ?
+		OPAL_SUCCESS : OPAL_PARAMETER;
+
+	free(jobs);
+	free(blocks);
+	return true;
+
+fallback:
+	if (grp)
+		cpu_job_group_wait(grp);
+	free(jobs);
+	free(blocks);
+	return false;
+}
+
 static void xz_decompress(void *data)
 {
 	struct xz_decompress *xz = (struct xz_decompress *)data;
@@ -961,6 +1248,10 @@ static void xz_decompress(void *data)
 
 	/* Initialize the xz library first */
 	xz_crc32_init();
+
+	if (xz_decompress_blocks(xz))
+		return;
+
 	s = xz_dec_init(XZ_SINGLE, 0);
 	if (s == NULL) {
 		prerror("initialization error for xz\n");
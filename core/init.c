@@ -595,6 +595,8 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	op_display(OP_LOG, OP_MOD_INIT, 0x000C);
 
 	mem_dump_free();
+	lock_stats_dump(true);
+	cpu_wait_job_report();
 
 	/* Dump the selected console */
 	stdoutp = dt_prop_get_def(dt_chosen, "linux,stdout-path", NULL);
@@ -1232,6 +1234,9 @@ void __noreturn __nomcount main_cpu_entry(const void *fdt)
 	/* Set the console level */
 	console_log_level();
 
+	/* OPAL call latency histograms, if NVRAM asks for them */
+	opal_latency_init();
+
 	/* Secure/Trusted Boot init. We look for /ibm,secureboot in DT */
 	secureboot_init();
 	trustedboot_init();
@@ -1371,7 +1376,7 @@ void __noreturn __secondary_cpu_entry(void)
 
 	/* Wait for work to do */
 	while(true) {
-		if (cpu_check_jobs(cpu))
+		if (cpu_check_jobs(cpu) || cpu_steal_job(cpu))
 			cpu_process_jobs();
 		else
 			cpu_idle_job();
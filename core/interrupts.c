@@ -28,6 +28,108 @@ static LIST_HEAD(irq_sources);
 static LIST_HEAD(irq_sources2);
 static struct lock irq_lock = LOCK_UNLOCKED;
 
+/*
+ * Every source's range, sorted, for irq_find_source() to binary search
+ * without taking irq_lock. Where a secondary source overlaps a primary
+ * one only the parts the primary doesn't cover go in, so the ranges
+ * don't overlap and the primary wins like it does in the lists.
+ *
+ * A source coming or going drops it, and the next lookup rebuilds it
+ * under the lock, so a burst of registrations at boot only builds one.
+ * Nothing says when a lockless lookup is done with the one it found, so
+ * superseded indexes are never freed. Until there's an index, or if we
+ * can't allocate one, lookups walk the lists instead.
+ */
+struct irq_range {
+	uint32_t		start;
+	uint32_t		end;
+	struct irq_source	*is;
+};
+
+struct irq_index {
+	uint32_t		count;
+	struct irq_range	range[];
+};
+
+static struct irq_index *irq_index;
+static bool irq_index_stale;
+
+/* There are never more than a few hundred, and they're mostly in order */
+static void irq_index_sort(struct irq_range *r, uint32_t count)
+{
+	struct irq_range tmp;
+	uint32_t i, j;
+
+	for (i = 1; i < count; i++) {
+		tmp = r[i];
+		for (j = i; j > 0 && r[j - 1].start > tmp.start; j--)
+			r[j] = r[j - 1];
+		r[j] = tmp;
+	}
+}
+
+static void irq_index_add(struct irq_index *idx, uint32_t start,
+			  uint32_t end, struct irq_source *is)
+{
+	idx->range[idx->count].start = start;
+	idx->range[idx->count].end = end;
+	idx->range[idx->count].is = is;
+	idx->count++;
+}
+
+/* Call with irq_lock held */
+static void irq_index_rebuild(void)
+{
+	struct irq_source *is;
+	struct irq_index *idx;
+	uint32_t i, nprim, n = 0, cur;
+
+	list_for_each(&irq_sources, is, link)
+		n++;
+	nprim = n;
+	list_for_each(&irq_sources2, is, link)
+		n++;
+
+	/* A secondary can be split in nprim + 1 pieces at worst */
+	idx = malloc(sizeof(*idx) +
+		     (nprim + (n - nprim) * (nprim + 1)) * sizeof(idx->range[0]));
+	if (idx) {
+		idx->count = 0;
+		list_for_each(&irq_sources, is, link)
+			irq_index_add(idx, is->start, is->end, is);
+		irq_index_sort(idx->range, nprim);
+
+		list_for_each(&irq_sources2, is, link) {
+			cur = is->start;
+			for (i = 0; i < nprim && cur < is->end; i++) {
+				if (idx->range[i].end <= cur)
+					continue;
+				if (idx->range[i].start >= is->end)
+					break;
+				if (idx->range[i].start > cur)
+					irq_index_add(idx, cur,
+						      idx->range[i].start, is);
+				cur = idx->range[i].end;
+			}
+			if (cur < is->end)
+				irq_index_add(idx, cur, is->end, is);
+		}
+		irq_index_sort(idx->range, idx->count);
+	}
+
+	/* Make sure the ranges are there before the pointer to them */
+	lwsync();
+	irq_index = idx;
+	irq_index_stale = false;
+}
+
+/* Call with irq_lock held. The old index is left to any lookup using it */
+static void irq_index_drop(void)
+{
+	irq_index = NULL;
+	irq_index_stale = true;
+}
+
 void __register_irq_source(struct irq_source *is, bool secondary)
 {
 	struct irq_source *is1;
@@ -48,6 +150,7 @@ void __register_irq_source(struct irq_source *is, bool secondary)
 		}
 	}
 	list_add_tail(list, &is->link);
+	irq_index_drop();
 	unlock(&irq_lock);
 }
 
@@ -82,6 +185,7 @@ void unregister_irq_source(uint32_t start, uint32_t count)
 				assert(0);
 			}
 			list_del(&is->link);
+			irq_index_drop();
 			unlock(&irq_lock);
 			/* XXX Add synchronize / RCU */
 			free(is);
@@ -94,14 +198,11 @@ void unregister_irq_source(uint32_t start, uint32_t count)
 	assert(0);
 }
 
-struct irq_source *irq_find_source(uint32_t isn)
+static struct irq_source *irq_find_source_locked(uint32_t isn)
 {
 	struct irq_source *is;
 
 	lock(&irq_lock);
-	/*
-	 * XXX This really needs some kind of caching !
-	 */
 	list_for_each(&irq_sources, is, link) {
 		if (isn >= is->start && isn < is->end) {
 			unlock(&irq_lock);
@@ -119,6 +220,36 @@ struct irq_source *irq_find_source(uint32_t isn)
 	return NULL;
 }
 
+struct irq_source *irq_find_source(uint32_t isn)
+{
+	struct irq_index *idx = irq_index;
+	uint32_t lo = 0, hi, mid;
+
+	if (!idx && irq_index_stale) {
+		lock(&irq_lock);
+		if (irq_index_stale)
+			irq_index_rebuild();
+		idx = irq_index;
+		unlock(&irq_lock);
+	}
+	if (!idx)
+		return irq_find_source_locked(isn);
+
+	/* The last range starting at or below isn is the only candidate */
+	hi = idx->count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (idx->range[mid].start <= isn)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo && isn < idx->range[lo - 1].end)
+		return idx->range[lo - 1].is;
+
+	return NULL;
+}
+
 void irq_for_each_source(void (*cb)(struct irq_source *, void *), void *data)
 {
 	struct irq_source *is;
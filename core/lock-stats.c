@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Lock contention statistics (LOCK_STATS builds only)
+ *
+ * Copyright 2020 IBM Corp.
+ */
+
+#include <skiboot.h>
+#include <lock.h>
+#include <cmpxchg.h>
+#include <inttypes.h>
+
+#ifdef LOCK_STATS
+
+#define LOCK_STATS_ENTRIES	1024	/* Power of 2 */
+#define LOCK_STATS_DUMP_MAX	32
+
+/*
+ * Open addressed hash table of records keyed by (lock, call site). A
+ * free slot is claimed by cmpxchg on ->lock, anything else in a record
+ * is only written by whoever holds that lock, so no lock is needed here.
+ */
+static struct lock_stats lock_stats[LOCK_STATS_ENTRIES];
+static uint64_t lock_stats_dropped;
+
+static unsigned int lock_stats_hash(struct lock *l, const char *caller)
+{
+	uint64_t h = ((uint64_t)l >> 3) ^ ((uint64_t)caller << 7);
+
+	h *= 0x9e3779b97f4a7c15ull;
+	return h >> 32;
+}
+
+static struct lock_stats *lock_stats_find(struct lock *l, const char *caller)
+{
+	unsigned int h = lock_stats_hash(l, caller);
+	struct lock_stats *s;
+	unsigned int i;
+
+	for (i = 0; i < LOCK_STATS_ENTRIES; i++) {
+		s = &lock_stats[(h + i) & (LOCK_STATS_ENTRIES - 1)];
+
+		if (s->lock == l && s->caller == caller)
+			return s;
+		if (s->lock)
+			continue;
+		if (__cmpxchg64((uint64_t *)&s->lock, 0, (uint64_t)l))
+			continue;
+		s->caller = caller;
+		return s;
+	}
+
+	return NULL;
+}
+
+struct lock_stats *lock_stats_acquired(struct lock *l, const char *caller,
+				       bool contended, uint64_t spin_tb)
+{
+	struct lock_stats *s = lock_stats_find(l, caller);
+
+	if (!s) {
+		lock_stats_dropped++;
+		return NULL;
+	}
+
+	s->count++;
+	if (contended) {
+		s->contended++;
+		s->spin_tb += spin_tb;
+		if (spin_tb > s->max_spin_tb)
+			s->max_spin_tb = spin_tb;
+	}
+
+	return s;
+}
+
+void lock_stats_released(struct lock *l, uint64_t hold_tb)
+{
+	struct lock_stats *s = l->stats;
+
+	if (s && hold_tb > s->max_hold_tb)
+		s->max_hold_tb = hold_tb;
+}
+
+/* Order for the dump: most time spinning first, then most acquired */
+static bool lock_stats_worse(const struct lock_stats *a,
+			     const struct lock_stats *b)
+{
+	if (a->spin_tb != b->spin_tb)
+		return a->spin_tb > b->spin_tb;
+	return a->count > b->count;
+}
+
+/*
+ * Print the worst records, and optionally start counting afresh. Records
+ * stay claimed across a reset, as their lock holders may still be
+ * pointing at them.
+ */
+void lock_stats_dump(bool reset)
+{
+	struct lock_stats *top[LOCK_STATS_DUMP_MAX];
+	struct lock_stats *s;
+	unsigned int i, j, n = 0;
+
+	for (i = 0; i < LOCK_STATS_ENTRIES; i++) {
+		s = &lock_stats[i];
+		if (!s->count)
+			continue;
+
+		/* Insert into the sorted top list, dropping off the end */
+		for (j = n; j > 0 && lock_stats_worse(s, top[j - 1]); j--)
+			if (j < LOCK_STATS_DUMP_MAX)
+				top[j] = top[j - 1];
+		if (j < LOCK_STATS_DUMP_MAX)
+			top[j] = s;
+		if (n < LOCK_STATS_DUMP_MAX)
+			n++;
+	}
+
+	prlog(PR_NOTICE, "LOCK: Most contended locks (timebase ticks):\n");
+	prlog(PR_NOTICE, "LOCK: %16s %10s %10s %14s %12s %12s  %s\n", "lock",
+	      "count", "contended", "total spin", "max spin", "max hold",
+	      "caller");
+	for (i = 0; i < n; i++) {
+		s = top[i];
+		prlog(PR_NOTICE, "LOCK: %16p %10"PRIu64" %10"PRIu64" %14"PRIu64
+		      " %12"PRIu64" %12"PRIu64"  %s\n",
+		      s->lock, s->count, s->contended, s->spin_tb,
+		      s->max_spin_tb, s->max_hold_tb, s->caller);
+	}
+
+	if (lock_stats_dropped)
+		prlog(PR_NOTICE, "LOCK: %"PRIu64" acquisitions not recorded, table full\n",
+		      lock_stats_dropped);
+
+	if (!reset)
+		return;
+
+	for (i = 0; i < LOCK_STATS_ENTRIES; i++) {
+		s = &lock_stats[i];
+		s->count = s->contended = 0;
+		s->spin_tb = s->max_spin_tb = s->max_hold_tb = 0;
+	}
+	lock_stats_dropped = 0;
+}
+
+#endif /* LOCK_STATS */
@@ -199,6 +199,10 @@ bool try_lock_caller(struct lock *l, const char *owner)
 		cpu->con_suspend++;
 	if (__try_lock(cpu, l)) {
 		l->owner = owner;
+#ifdef LOCK_STATS
+		/* Only lock() is accounted, it fills these in */
+		l->stats = NULL;
+#endif
 
 #ifdef DEBUG_LOCKS_BACKTRACE
 		backtrace_create(l->bt_buf, LOCKS_BACKTRACE_MAX_ENTS,
@@ -213,18 +217,38 @@ bool try_lock_caller(struct lock *l, const char *owner)
 	return false;
 }
 
+#ifdef LOCK_STATS
+static void lock_account(struct lock *l, const char *owner,
+			 unsigned long spin_start)
+{
+	uint64_t now = mftb();
+
+	l->stats = lock_stats_acquired(l, owner, spin_start != 0,
+				       spin_start ? now - spin_start : 0);
+	l->acquired_tb = now;
+}
+#else
+static inline void lock_account(struct lock *l __unused,
+				const char *owner __unused,
+				unsigned long spin_start __unused) { }
+#endif
+
 void lock_caller(struct lock *l, const char *owner)
 {
 	bool timeout_warn = false;
 	unsigned long start = 0;
+	unsigned long spin_start;
 
 	if (bust_locks)
 		return;
 
 	lock_check(l);
 
-	if (try_lock_caller(l, owner))
+	if (try_lock_caller(l, owner)) {
+		lock_account(l, owner, 0);
 		return;
+	}
+	spin_start = mftb();
 	add_lock_request(l);
 
 #ifdef DEBUG_LOCKS
@@ -261,6 +285,7 @@ void lock_caller(struct lock *l, const char *owner)
 	}
 
 	remove_lock_request();
+	lock_account(l, owner, spin_start);
 }
 
 void unlock(struct lock *l)
@@ -272,6 +297,9 @@ void unlock(struct lock *l)
 
 	unlock_check(l);
 
+#ifdef LOCK_STATS
+	lock_stats_released(l, mftb() - l->acquired_tb);
+#endif
 	l->owner = NULL;
 	list_del(&l->list);
 	lwsync();
@@ -6,13 +6,112 @@
  * Copyright 2013-2015 IBM Corp.
  */
 
+#include <skiboot.h>
 #include <mem_region.h>
 #include <lock.h>
 #include <string.h>
+#include <cpu.h>
 #include <mem_region-malloc.h>
 
 #define DEFAULT_ALIGN __alignof__(long)
 
+/*
+ * Per-CPU malloc caches (see struct malloc_cache). Small allocations are
+ * served from this_cpu()'s cache, which is refilled from and drained to
+ * the heap MALLOC_CACHE_BATCH objects per heap lock acquisition.
+ *
+ * Objects sitting in a cache are still allocated as far as the heap is
+ * concerned: they show up in mem_dump_allocs() at malloc_cache_location,
+ * and get the caller's location back when they are handed out.
+ */
+static const char malloc_cache_location[] = "core/malloc.c:(per-cpu cache)";
+
+static const size_t malloc_cache_size[MALLOC_CACHE_CLASSES] = {
+	32, 64, 128, 256
+};
+
+/* Off until every cpu_thread has been initialised */
+static bool malloc_cache_enabled;
+
+void malloc_cache_enable(void)
+{
+	malloc_cache_enabled = true;
+}
+
+static int malloc_cache_class(size_t bytes)
+{
+	int i;
+
+	for (i = 0; i < MALLOC_CACHE_CLASSES; i++)
+		if (bytes <= malloc_cache_size[i])
+			return i;
+	return -1;
+}
+
+static void *malloc_cache_get(size_t bytes, const char *location)
+{
+	struct malloc_cache *mc = &this_cpu()->malloc_cache;
+	int c = malloc_cache_class(bytes);
+	void *p;
+
+	if (!mc->count[c]) {
+		lock(&skiboot_heap.free_list_lock);
+		while (mc->count[c] < MALLOC_CACHE_BATCH) {
+			p = mem_alloc(&skiboot_heap, malloc_cache_size[c],
+				      DEFAULT_ALIGN, location);
+			if (!p)
+				break;
+			mem_set_alloc_location(p, malloc_cache_location);
+			mc->objs[c][mc->count[c]++] = p;
+		}
+		unlock(&skiboot_heap.free_list_lock);
+		if (!mc->count[c])
+			return NULL;
+	}
+
+	p = mc->objs[c][--mc->count[c]];
+	mem_set_alloc_location(p, location);
+	return p;
+}
+
+static bool malloc_cache_put(void *p, const char *location)
+{
+	struct malloc_cache *mc = &this_cpu()->malloc_cache;
+	void *heap_start = (void *)skiboot_heap.start;
+	unsigned int i;
+	int c;
+
+	/*
+	 * Leave anything odd to mem_free() to complain about. The heap
+	 * header sits in the two longs in front of the object.
+	 */
+	if (p < heap_start + 2 * sizeof(long) ||
+	    p >= heap_start + skiboot_heap.len)
+		return false;
+
+	/* Only objects of exactly a class size can be handed out again */
+	c = malloc_cache_class(mem_allocated_size(p));
+	if (c < 0 || mem_allocated_size(p) != malloc_cache_size[c])
+		return false;
+
+	if (mem_alloc_location(p) == malloc_cache_location) {
+		prerror("%p re-freed into malloc cache at %s\n", p, location);
+		abort();
+	}
+
+	if (mc->count[c] == MALLOC_CACHE_DEPTH) {
+		lock(&skiboot_heap.free_list_lock);
+		for (i = 0; i < MALLOC_CACHE_BATCH; i++)
+			mem_free(&skiboot_heap, mc->objs[c][--mc->count[c]],
+				 location);
+		unlock(&skiboot_heap.free_list_lock);
+	}
+
+	mem_set_alloc_location(p, malloc_cache_location);
+	mc->objs[c][mc->count[c]++] = p;
+	return true;
+}
+
 void *__memalign(size_t blocksize, size_t bytes, const char *location)
 {
 	void *p;
@@ -26,11 +125,22 @@ void *__memalign(size_t blocksize, size_t bytes, const char *location)
 
 void *__malloc(size_t bytes, const char *location)
 {
+	if (malloc_cache_enabled &&
+	    bytes <= malloc_cache_size[MALLOC_CACHE_CLASSES - 1])
+		return malloc_cache_get(bytes, location);
+
 	return __memalign(DEFAULT_ALIGN, bytes, location);
 }
 
 void __free(void *p, const char *location)
 {
+	/* Freeing NULL is always a noop. */
+	if (!p)
+		return;
+
+	if (malloc_cache_enabled && malloc_cache_put(p, location))
+		return;
+
 	lock(&skiboot_heap.free_list_lock);
 	mem_free(&skiboot_heap, p, location);
 	unlock(&skiboot_heap.free_list_lock);
@@ -117,6 +117,12 @@ struct free_hdr {
 #define ALLOC_HDR_LONGS (sizeof(struct alloc_hdr) / sizeof(long))
 #define ALLOC_MIN_LONGS (sizeof(struct free_hdr) / sizeof(long) + 1)
 
+/*
+ * How many blocks of the requested size class we look at before moving
+ * on to the bigger classes, where the first block always fits.
+ */
+#define FREE_BIN_PROBES	8
+
 /* Avoid ugly casts. */
 static void *region_start(const struct mem_region *region)
 {
@@ -141,6 +147,50 @@ static struct alloc_hdr *next_hdr(const struct mem_region *region,
 	return next;
 }
 
+/*
+ * Free blocks are segregated by size: free_bins[n] holds the blocks of
+ * [1 << n, 1 << (n + 1)) longs and free_list everything bigger than that.
+ * Bit n of free_bins_map is set when free_bins[n] is non-empty.
+ */
+static unsigned int free_bin(unsigned long longs)
+{
+	return BITS_PER_LONG - 1 - __builtin_clzl(longs);
+}
+
+#define for_each_free_block(region, f, bin)				\
+	for (bin = 0; bin <= MEM_REGION_FREE_BINS; bin++)		\
+		list_for_each(bin < MEM_REGION_FREE_BINS ?		\
+			      &(region)->free_bins[bin] :		\
+			      &(region)->free_list, f, list)
+
+static void free_list_add(struct mem_region *region, struct free_hdr *f)
+{
+	unsigned int bin = free_bin(f->hdr.num_longs);
+
+	if (bin >= MEM_REGION_FREE_BINS) {
+		list_add(&region->free_list, &f->list);
+		return;
+	}
+
+	list_add(&region->free_bins[bin], &f->list);
+	region->free_bins_map |= 1UL << bin;
+}
+
+/* Must be called before f->hdr.num_longs is changed. */
+static void free_list_del(struct mem_region *region, struct free_hdr *f)
+{
+	unsigned int bin = free_bin(f->hdr.num_longs);
+
+	if (bin >= MEM_REGION_FREE_BINS) {
+		list_del_from(&region->free_list, &f->list);
+		return;
+	}
+
+	list_del_from(&region->free_bins[bin], &f->list);
+	if (list_empty(&region->free_bins[bin]))
+		region->free_bins_map &= ~(1UL << bin);
+}
+
 #if POISON_MEM_REGION == 1
 static void mem_poison(struct free_hdr *f)
 {
@@ -159,6 +209,8 @@ static void mem_poison(struct free_hdr *f)
 static void init_allocatable_region(struct mem_region *region)
 {
 	struct free_hdr *f = region_start(region);
+	unsigned int i;
+
 	assert(region->type == REGION_SKIBOOT_HEAP ||
 	       region->type == REGION_MEMORY);
 	f->hdr.num_longs = region->len / sizeof(long);
@@ -166,7 +218,10 @@ static void init_allocatable_region(struct mem_region *region)
 	f->hdr.prev_free = false;
 	*tailer(f) = f->hdr.num_longs;
 	list_head_init(&region->free_list);
-	list_add(&region->free_list, &f->list);
+	for (i = 0; i < MEM_REGION_FREE_BINS; i++)
+		list_head_init(&region->free_bins[i]);
+	region->free_bins_map = 0;
+	free_list_add(region, f);
 #if POISON_MEM_REGION == 1
 	mem_poison(f);
 #endif
@@ -194,12 +249,14 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 		assert(!prev->hdr.prev_free);
 
 		/* Expand to cover the one we just freed. */
+		free_list_del(region, prev);
 		prev->hdr.num_longs += f->hdr.num_longs;
+		free_list_add(region, prev);
 		f = prev;
 	} else {
 		f->hdr.free = true;
 		f->hdr.location = location;
-		list_add(&region->free_list, &f->list);
+		free_list_add(region, f);
 	}
 
 	/* Fix up tailer. */
@@ -211,7 +268,7 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 		next->prev_free = true;
 		if (next->free) {
 			struct free_hdr *next_free = (void *)next;
-			list_del_from(&region->free_list, &next_free->list);
+			free_list_del(region, next_free);
 			/* Maximum of one level of recursion */
 			make_free(region, next_free, location, true);
 		}
@@ -240,6 +297,57 @@ static bool fits(struct free_hdr *f, size_t longs, size_t align, size_t *offset)
 	return false;
 }
 
+/*
+ * Find a free block for this many longs. We try a few blocks of the
+ * requested size class, then the first block of each bigger class (which
+ * only fails to fit when alignment gets in the way), then the large
+ * blocks, and only then do we go back for the rest of our own class.
+ */
+static struct free_hdr *find_free(struct mem_region *region, size_t longs,
+				  size_t align, size_t *offset)
+{
+	unsigned int bin = free_bin(longs), probes = 0;
+	bool truncated = false;
+	struct free_hdr *f;
+	unsigned long map;
+
+	if (bin < MEM_REGION_FREE_BINS) {
+		list_for_each(&region->free_bins[bin], f, list) {
+			if (fits(f, longs, align, offset))
+				return f;
+			if (++probes == FREE_BIN_PROBES) {
+				truncated = true;
+				break;
+			}
+		}
+
+		map = region->free_bins_map & ~((2UL << bin) - 1);
+		while (map) {
+			unsigned int i = __builtin_ctzl(map);
+
+			list_for_each(&region->free_bins[i], f, list) {
+				if (fits(f, longs, align, offset))
+					return f;
+			}
+			map &= map - 1;
+		}
+	}
+
+	list_for_each(&region->free_list, f, list) {
+		if (fits(f, longs, align, offset))
+			return f;
+	}
+
+	if (truncated) {
+		list_for_each(&region->free_bins[bin], f, list) {
+			if (fits(f, longs, align, offset))
+				return f;
+		}
+	}
+
+	return NULL;
+}
+
 static void discard_excess(struct mem_region *region,
 			   struct alloc_hdr *hdr, size_t alloc_longs,
 			   const char *location, bool skip_poison)
@@ -423,21 +531,16 @@ static void *__mem_alloc(struct mem_region *region, size_t size, size_t align,
 	if (alloc_longs < ALLOC_MIN_LONGS)
 		alloc_longs = ALLOC_MIN_LONGS;
 
-	/* Walk free list. */
-	list_for_each(&region->free_list, f, list) {
-		/* We may have to skip some to meet alignment. */
-		if (fits(f, alloc_longs, align, &offset))
-			goto found;
-	}
-
-	return NULL;
+	/* We may have to skip some to meet alignment. */
+	f = find_free(region, alloc_longs, align, &offset);
+	if (!f)
+		return NULL;
 
-found:
 	assert(f->hdr.free);
 	assert(!f->hdr.prev_free);
 
 	/* This block is no longer free. */
-	list_del_from(&region->free_list, &f->list);
+	free_list_del(region, f);
 	f->hdr.free = false;
 	f->hdr.location = location;
 
@@ -531,6 +634,23 @@ size_t mem_allocated_size(const void *ptr)
 	return hdr->num_longs * sizeof(long) - sizeof(struct alloc_hdr);
 }
 
+const char *mem_alloc_location(const void *ptr)
+{
+	const struct alloc_hdr *hdr = ptr - sizeof(*hdr);
+	return hdr->location;
+}
+
+/* Used when an allocation changes hands, eg. out of a malloc cache. */
+void mem_set_alloc_location(void *ptr, const char *location)
+{
+	struct alloc_hdr *hdr = ptr - sizeof(*hdr);
+
+	/* This should be a constant. */
+	assert(is_rodata(location));
+
+	hdr->location = location;
+}
+
 bool mem_resize(struct mem_region *region, void *mem, size_t len,
 		const char *location)
 {
@@ -568,7 +688,7 @@ bool mem_resize(struct mem_region *region, void *mem, size_t len,
 
 	/* OK, it's free and big enough, absorb it. */
 	f = (struct free_hdr *)next;
-	list_del_from(&region->free_list, &f->list);
+	free_list_del(region, f);
 	hdr->num_longs += next->num_longs;
 	hdr->location = location;
 
@@ -592,6 +712,7 @@ bool mem_check(const struct mem_region *region)
 	size_t frees = 0;
 	struct alloc_hdr *hdr, *prev_free = NULL;
 	struct free_hdr *f;
+	unsigned int bin;
 
 	/* Check it's sanely aligned. */
 	if (region->start % sizeof(long)) {
@@ -653,9 +774,23 @@ bool mem_check(const struct mem_region *region)
 		}
 	}
 
-	/* Now walk free list. */
-	list_for_each(&region->free_list, f, list)
+	/* Now walk free lists, checking each block is in the right bin. */
+	for_each_free_block(region, f, bin) {
+		if (MIN(free_bin(f->hdr.num_longs),
+			MEM_REGION_FREE_BINS) != bin) {
+			prerror("Region '%s' free %p (%s) size %zu in bin %u\n",
+				region->name, f, hdr_location(&f->hdr),
+				f->hdr.num_longs * sizeof(long), bin);
+			return false;
+		}
+		if (bin < MEM_REGION_FREE_BINS &&
+		    !(region->free_bins_map & (1UL << bin))) {
+			prerror("Region '%s' bin %u not in map\n",
+				region->name, bin);
+			return false;
+		}
 		frees ^= (unsigned long)f - region->start;
+	}
 
 	if (frees) {
 		prerror("Region '%s' free list and walk do not match!\n",
@@ -1147,13 +1282,14 @@ void mem_region_init(void)
 static uint64_t allocated_length(const struct mem_region *r)
 {
 	struct free_hdr *f, *last = NULL;
+	unsigned int bin;
 
 	/* No allocations at all? */
 	if (r->free_list.n.next == NULL)
 		return 0;
 
 	/* Find last free block. */
-	list_for_each(&r->free_list, f, list)
+	for_each_free_block(r, f, bin)
 		if (f > last)
 			last = f;
 
@@ -1202,7 +1338,7 @@ void mem_region_release_unused(void)
 			struct free_hdr *last = region_start(r) + used_len;
 
 			/* Remove the final free block. */
-			list_del_from(&r->free_list, &last->list);
+			free_list_del(r, last);
 
 			for_linux = split_region(r, r->start + used_len,
 						 REGION_OS);
@@ -1217,6 +1353,33 @@ void mem_region_release_unused(void)
 	unlock(&mem_region_lock);
 }
 
+/* Cache line size of every CPU we run on */
+#define MEM_CLEAR_LINE_SIZE	128
+
+/*
+ * dcbz the cache line aligned body, so the lines are zeroed in the cache
+ * without first being read in from memory.
+ */
+static void mem_clear_lines(uint64_t s, uint64_t e)
+{
+	uint64_t body_s = ALIGN_UP(s, MEM_CLEAR_LINE_SIZE);
+	uint64_t body_e = ALIGN_DOWN(e, MEM_CLEAR_LINE_SIZE);
+
+	if (body_s >= body_e) {
+		memset((void *)s, 0, e - s);
+		return;
+	}
+
+	memset((void *)s, 0, body_s - s);
+#if defined(__powerpc64__)
+	for (; body_s < body_e; body_s += MEM_CLEAR_LINE_SIZE)
+		asm volatile("dcbz 0,%0" : : "r"(body_s) : "memory");
+#else
+	memset((void *)body_s, 0, body_e - body_s);
+#endif
+	memset((void *)body_e, 0, e - body_e);
+}
+
 static void mem_clear_range(uint64_t s, uint64_t e)
 {
 	uint64_t res_start, res_end;
@@ -1259,7 +1422,7 @@ static void mem_clear_range(uint64_t s, uint64_t e)
 
 	prlog(PR_DEBUG, "Clearing region %llx-%llx\n",
 	      (long long)s, (long long)e);
-	memset((void *)s, 0, e - s);
+	mem_clear_lines(s, e);
 }
 
 struct mem_region_clear_job_args {
@@ -1273,40 +1436,117 @@ static void mem_region_clear_job(void *data)
 	mem_clear_range(arg->s, arg->e);
 }
 
-#define MEM_REGION_CLEAR_JOB_SIZE (16ULL*(1<<30))
+/*
+ * Each region is split into a couple of jobs per core on its chip, so
+ * every core gets some and the stragglers can be stolen, within limits.
+ */
+#define MEM_REGION_CLEAR_JOB_SIZE	(16ULL*(1<<30))
+#define MEM_REGION_CLEAR_JOB_MIN	(256ULL*(1<<20))
+#define MEM_REGION_CLEAR_JOBS_PER_CORE	2
+
+/* Jobs are grouped by chip, so we can tell how fast each one went */
+struct mem_clear_chip {
+	uint32_t		chip_id;
+	uint64_t		bytes;
+	struct cpu_job_group	*grp;
+};
 
-static struct cpu_job **mem_clear_jobs;
 static struct mem_region_clear_job_args *mem_clear_job_args;
 static int mem_clear_njobs = 0;
+static struct mem_clear_chip *mem_clear_chips;
+static int mem_clear_nchips = 0;
+
+static uint32_t mem_clear_chip_id(struct mem_region *r)
+{
+	uint32_t chip_id = __dt_get_chip_id(r->node);
+
+	if (chip_id == -1)
+		chip_id = 0;
+	return chip_id;
+}
+
+static uint64_t mem_clear_job_size(struct mem_region *r)
+{
+	unsigned int cores;
+	uint64_t size;
+
+	cores = get_available_nr_cores_in_chip(mem_clear_chip_id(r));
+	if (!cores)
+		cores = 1;
+
+	size = r->len / (cores * MEM_REGION_CLEAR_JOBS_PER_CORE);
+	size = ALIGN_UP(size, MEM_REGION_CLEAR_JOB_MIN);
+	if (size < MEM_REGION_CLEAR_JOB_MIN)
+		size = MEM_REGION_CLEAR_JOB_MIN;
+	if (size > MEM_REGION_CLEAR_JOB_SIZE)
+		size = MEM_REGION_CLEAR_JOB_SIZE;
+	return size;
+}
+
+static struct mem_clear_chip *mem_clear_get_chip(uint32_t chip_id)
+{
+	struct mem_clear_chip *c;
+	int i;
+
+	for (i = 0; i < mem_clear_nchips; i++)
+		if (mem_clear_chips[i].chip_id == chip_id)
+			return &mem_clear_chips[i];
+
+	c = &mem_clear_chips[mem_clear_nchips++];
+	c->chip_id = chip_id;
+	c->bytes = 0;
+	c->grp = cpu_job_group_alloc();
+	assert(c->grp);
+	return c;
+}
+
+static void mem_clear_add_job(struct mem_region *r, int i)
+{
+	struct mem_region_clear_job_args *arg = &mem_clear_job_args[i];
+	uint32_t chip_id = mem_clear_chip_id(r);
+	struct mem_clear_chip *c = mem_clear_get_chip(chip_id);
+	bool added;
+	char *path;
+
+	arg->job_name = malloc(sizeof(char)*100);
+	path = dt_get_path(r->node);
+	snprintf(arg->job_name, 100,
+		 "clear %s, %s 0x%"PRIx64" len: 0x%"PRIx64" on %d",
+		 r->name, path, arg->s, (arg->e - arg->s), chip_id);
+	free(path);
+
+	/* Any chip will do if there's nobody on this one */
+	added = cpu_job_group_add(c->grp, chip_id, arg->job_name,
+				  mem_region_clear_job, arg);
+	assert(added);
+	c->bytes += arg->e - arg->s;
+}
 
 void start_mem_region_clear_unused(void)
 {
 	struct mem_region *r;
-	uint64_t s,l;
-	uint64_t total = 0;
-	uint32_t chip_id;
-	char *path;
-	int i;
-	struct cpu_job **jobs;
+	uint64_t s, e, size;
+	int i, nregions = 0;
 	struct mem_region_clear_job_args *job_args;
 
 	lock(&mem_region_lock);
 	assert(mem_regions_finalised);
 
 	mem_clear_njobs = 0;
+	mem_clear_nchips = 0;
 
 	list_for_each(&regions, r, list) {
 		if (!(r->type == REGION_OS))
 			continue;
-		mem_clear_njobs++;
-		/* One job per 16GB */
-		mem_clear_njobs += r->len / MEM_REGION_CLEAR_JOB_SIZE;
+		nregions++;
+		size = mem_clear_job_size(r);
+		mem_clear_njobs += (r->len + size - 1) / size;
 	}
 
-	jobs = malloc(mem_clear_njobs * sizeof(struct cpu_job*));
 	job_args = malloc(mem_clear_njobs * sizeof(struct mem_region_clear_job_args));
-	mem_clear_jobs = jobs;
 	mem_clear_job_args = job_args;
+	mem_clear_chips = malloc(nregions * sizeof(struct mem_clear_chip));
+	assert(job_args && (mem_clear_chips || !nregions));
 
 	prlog(PR_NOTICE, "Clearing unused memory:\n");
 	i = 0;
@@ -1317,82 +1557,49 @@ void start_mem_region_clear_unused(void)
 
 		assert(r != &skiboot_heap);
 
-		s = r->start;
-		l = r->len;
-		while(l > MEM_REGION_CLEAR_JOB_SIZE) {
-			job_args[i].s = s+l - MEM_REGION_CLEAR_JOB_SIZE;
-			job_args[i].e = s+l;
-			l-=MEM_REGION_CLEAR_JOB_SIZE;
-			job_args[i].job_name = malloc(sizeof(char)*100);
-			total+=MEM_REGION_CLEAR_JOB_SIZE;
-			chip_id = __dt_get_chip_id(r->node);
-			if (chip_id == -1)
-				chip_id = 0;
-			path = dt_get_path(r->node);
-			snprintf(job_args[i].job_name, 100,
-				 "clear %s, %s 0x%"PRIx64" len: %"PRIx64" on %d",
-				 r->name, path,
-				 job_args[i].s,
-				 (job_args[i].e - job_args[i].s),
-				 chip_id);
-			free(path);
-			jobs[i] = cpu_queue_job_on_node(chip_id,
-							job_args[i].job_name,
-							mem_region_clear_job,
-							&job_args[i]);
-			if (!jobs[i])
-				jobs[i] = cpu_queue_job(NULL,
-							job_args[i].job_name,
-							mem_region_clear_job,
-							&job_args[i]);
-			assert(jobs[i]);
+		size = mem_clear_job_size(r);
+		for (s = r->start; s < r->start + r->len; s = e) {
+			e = s + size;
+			if (e > r->start + r->len)
+				e = r->start + r->len;
+			job_args[i].s = s;
+			job_args[i].e = e;
+			mem_clear_add_job(r, i);
 			i++;
 		}
-		job_args[i].s = s;
-		job_args[i].e = s+l;
-		job_args[i].job_name = malloc(sizeof(char)*100);
-		total+=l;
-		chip_id = __dt_get_chip_id(r->node);
-		if (chip_id == -1)
-			chip_id = 0;
-		path = dt_get_path(r->node);
-		snprintf(job_args[i].job_name,100,
-			 "clear %s, %s 0x%"PRIx64" len: 0x%"PRIx64" on %d",
-			 r->name, path,
-			 job_args[i].s,
-			 (job_args[i].e - job_args[i].s),
-			 chip_id);
-		free(path);
-		jobs[i] = cpu_queue_job_on_node(chip_id,
-						job_args[i].job_name,
-					mem_region_clear_job,
-					&job_args[i]);
-		i++;
 	}
 	unlock(&mem_region_lock);
-	cpu_process_local_jobs();
+
+	/* If no secondary CPUs, this does everything sync */
+	for (i = 0; i < mem_clear_nchips; i++)
+		cpu_job_group_submit(mem_clear_chips[i].grp);
 }
 
 void wait_mem_region_clear_unused(void)
 {
-	uint64_t l;
+	struct mem_clear_chip *c;
 	uint64_t total = 0;
+	unsigned long us;
 	int i;
 
-	for(i=0; i < mem_clear_njobs; i++) {
-		total += (mem_clear_job_args[i].e - mem_clear_job_args[i].s);
+	for (i = 0; i < mem_clear_nchips; i++) {
+		c = &mem_clear_chips[i];
+		us = cpu_job_group_wait(c->grp);
+		total += c->bytes;
+
+		/* bytes per us is MB/s */
+		if (us)
+			prlog(PR_NOTICE, "Clearing memory... chip %d: %"PRIu64
+			      "GB in %lums, %"PRIu64".%"PRIu64"GB/s\n",
+			      c->chip_id, c->bytes >> 30, us / 1000,
+			      c->bytes / us / 1000, c->bytes / us / 100 % 10);
 	}
+	printf("Clearing memory... %"PRIu64"GB done\n", total>>30);
 
-	l = 0;
-	for(i=0; i < mem_clear_njobs; i++) {
-		cpu_wait_job(mem_clear_jobs[i], true);
-		l += (mem_clear_job_args[i].e - mem_clear_job_args[i].s);
-		printf("Clearing memory... %"PRIu64"/%"PRIu64"GB done\n",
-		       l>>30, total>>30);
+	for(i=0; i < mem_clear_njobs; i++)
 		free(mem_clear_job_args[i].job_name);
-	}
-	free(mem_clear_jobs);
 	free(mem_clear_job_args);
+	free(mem_clear_chips);
 }
 
 static void mem_region_add_dt_reserved_node(struct dt_node *parent,
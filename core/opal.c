@@ -23,6 +23,7 @@
 #include <elf-abi.h>
 #include <errorlog.h>
 #include <occ.h>
+#include <nvram.h>
 
 /* Pending events to signal via opal_poll_events */
 uint64_t opal_pending_events;
@@ -158,6 +159,45 @@ int64_t opal_entry_check(struct stack_frame *eframe)
 	return OPAL_SUCCESS;
 }
 
+/*
+ * OPAL call latency histograms, see struct opal_call_latency. Only kept
+ * if the "opal-call-latency" NVRAM option is "true", as they take over
+ * 20KB per thread.
+ */
+#define OPAL_CALL_LATENCY_TOKENS	(OPAL_LAST + 1)
+#define OPAL_CALL_LATENCY_BUCKETS	32
+#define OPAL_CALL_LATENCY_CPU_SIZE					\
+	(sizeof(struct opal_call_latency_cpu) +				\
+	 OPAL_CALL_LATENCY_TOKENS * OPAL_CALL_LATENCY_BUCKETS * sizeof(__be32))
+
+static struct opal_call_latency *opal_latency;
+
+static inline unsigned int opal_latency_bucket(uint64_t ticks)
+{
+	unsigned int b;
+
+	if (!ticks)
+		return 0;
+	b = ilog2(ticks);
+	return b < OPAL_CALL_LATENCY_BUCKETS ? b :
+		OPAL_CALL_LATENCY_BUCKETS - 1;
+}
+
+/* Only ever updated by the owning CPU, so no locking needed */
+static void opal_latency_record(struct cpu_thread *cpu, uint64_t token,
+				uint64_t ticks)
+{
+	struct opal_call_latency_cpu *lat = cpu->opal_latency;
+	__be32 *count;
+
+	if (!lat || token > OPAL_LAST)
+		return;
+
+	count = &lat->hist[token * OPAL_CALL_LATENCY_BUCKETS +
+			  opal_latency_bucket(ticks)];
+	*count = cpu_to_be32(be32_to_cpu(*count) + 1);
+}
+
 int64_t opal_exit_check(int64_t retval, struct stack_frame *eframe);
 
 int64_t opal_exit_check(int64_t retval, struct stack_frame *eframe)
@@ -184,6 +224,9 @@ int64_t opal_exit_check(int64_t retval, struct stack_frame *eframe)
 		}
 	}
 
+	if (token != OPAL_RESYNC_TIMEBASE)
+		opal_latency_record(cpu, token, now - cpu->entered_opal_call_at);
+
 	if (call_time > 100 && token != OPAL_RESYNC_TIMEBASE) {
 		prlog((call_time < 1000) ? PR_DEBUG : PR_WARNING,
 		      "Spent %llu msecs in OPAL call %llu!\n",
@@ -317,6 +360,78 @@ int64_t opal_quiesce(uint32_t quiesce_type, int32_t cpu_target)
 }
 opal_call(OPAL_QUIESCE, opal_quiesce, 2);
 
+/*
+ * Calls in flight on other CPUs while we clear can still land in the old
+ * counts, which is fine for statistics.
+ */
+static int64_t opal_call_latency_reset(void)
+{
+	struct cpu_thread *cpu;
+
+	if (!opal_latency)
+		return OPAL_UNSUPPORTED;
+
+	for_each_cpu(cpu) {
+		if (cpu->opal_latency)
+			memset(cpu->opal_latency->hist, 0,
+			       OPAL_CALL_LATENCY_CPU_SIZE -
+			       sizeof(*cpu->opal_latency));
+	}
+	lwsync();
+	opal_latency->reset_tb = cpu_to_be64(mftb());
+
+	return OPAL_SUCCESS;
+}
+opal_call(OPAL_CALL_LATENCY_RESET, opal_call_latency_reset, 0);
+
+/*
+ * Allocate the latency histograms and export them, if asked to. Needs
+ * add_opal_node() and NVRAM.
+ */
+void opal_latency_init(void)
+{
+	struct dt_node *exports;
+	struct cpu_thread *cpu;
+	unsigned int nr_cpus = 0;
+	void *rec;
+	size_t size;
+
+	if (!nvram_query_eq_safe("opal-call-latency", "true"))
+		return;
+
+	for_each_cpu(cpu)
+		nr_cpus++;
+
+	size = sizeof(*opal_latency) + nr_cpus * OPAL_CALL_LATENCY_CPU_SIZE;
+	opal_latency = local_alloc(this_cpu()->chip_id, size, 0x10000);
+	if (!opal_latency) {
+		prerror("OPAL: Failed to allocate call latency histograms\n");
+		return;
+	}
+	memset(opal_latency, 0, size);
+
+	opal_latency->magic = cpu_to_be32(OPAL_CALL_LATENCY_MAGIC);
+	opal_latency->nr_tokens = cpu_to_be16(OPAL_CALL_LATENCY_TOKENS);
+	opal_latency->nr_buckets = cpu_to_be16(OPAL_CALL_LATENCY_BUCKETS);
+	opal_latency->nr_cpus = cpu_to_be32(nr_cpus);
+	opal_latency->tb_hz = cpu_to_be64(tb_hz);
+	opal_latency->reset_tb = cpu_to_be64(mftb());
+
+	rec = opal_latency + 1;
+	for_each_cpu(cpu) {
+		cpu->opal_latency = rec;
+		cpu->opal_latency->pir = cpu_to_be32(cpu->pir);
+		rec += OPAL_CALL_LATENCY_CPU_SIZE;
+	}
+
+	prlog(PR_INFO, "OPAL: Keeping call latency histograms\n");
+
+	exports = dt_find_by_path(opal_node, "firmware/exports");
+	if (exports)
+		dt_add_property_u64s(exports, "opal_call_latency",
+				     (uint64_t)opal_latency, size);
+}
+
 void __opal_register(uint64_t token, void *func, unsigned int nargs)
 {
 	assert(token <= OPAL_LAST);
@@ -65,6 +65,77 @@ opal_call(OPAL_PCI_CONFIG_WRITE_BYTE, opal_pci_config_write_byte, 4);
 opal_call(OPAL_PCI_CONFIG_WRITE_HALF_WORD, opal_pci_config_write_half_word, 4);
 opal_call(OPAL_PCI_CONFIG_WRITE_WORD, opal_pci_config_write_word, 4);
 
+static int64_t pci_cfg_op(struct phb *phb, struct opal_pci_cfg_op *op)
+{
+	uint16_t bdfn = be16_to_cpu(op->bdfn);
+	uint16_t offset = be16_to_cpu(op->offset);
+	uint32_t data = be32_to_cpu(op->data);
+	uint16_t data16;
+	uint8_t data8;
+	int64_t rc;
+
+	if (op->flags & ~OPAL_PCI_CFG_OP_WRITE)
+		return OPAL_PARAMETER;
+
+	if (op->flags & OPAL_PCI_CFG_OP_WRITE) {
+		switch (op->size) {
+		case 1:
+			return phb->ops->cfg_write8(phb, bdfn, offset, data);
+		case 2:
+			return phb->ops->cfg_write16(phb, bdfn, offset, data);
+		case 4:
+			return phb->ops->cfg_write32(phb, bdfn, offset, data);
+		}
+		return OPAL_PARAMETER;
+	}
+
+	switch (op->size) {
+	case 1:
+		rc = phb->ops->cfg_read8(phb, bdfn, offset, &data8);
+		data = data8;
+		break;
+	case 2:
+		rc = phb->ops->cfg_read16(phb, bdfn, offset, &data16);
+		data = data16;
+		break;
+	case 4:
+		rc = phb->ops->cfg_read32(phb, bdfn, offset, &data);
+		break;
+	default:
+		return OPAL_PARAMETER;
+	}
+	op->data = cpu_to_be32(data);
+
+	return rc;
+}
+
+/*
+ * Run a list of config accesses through the same PHB ops, and so the same
+ * filters, as the single ones above, but for one OPAL call and one go at
+ * the PHB lock. Each access gets its own return code, one failing doesn't
+ * stop the rest.
+ */
+static int64_t opal_pci_config_batch(uint64_t phb_id,
+				     struct opal_pci_cfg_op *ops,
+				     uint64_t count)
+{
+	struct phb *phb = pci_get_phb(phb_id);
+	uint64_t i;
+
+	if (!phb || !count || count > OPAL_PCI_CFG_BATCH_MAX)
+		return OPAL_PARAMETER;
+	if (!opal_addr_valid(ops) || !opal_addr_valid(&ops[count - 1]))
+		return OPAL_PARAMETER;
+
+	phb_lock(phb);
+	for (i = 0; i < count; i++)
+		ops[i].rc = cpu_to_be32(pci_cfg_op(phb, &ops[i]));
+	phb_unlock(phb);
+
+	return OPAL_SUCCESS;
+}
+opal_call(OPAL_PCI_CONFIG_BATCH, opal_pci_config_batch, 3);
+
 static struct lock opal_eeh_evt_lock = LOCK_UNLOCKED;
 static uint64_t opal_eeh_evt = 0;
 
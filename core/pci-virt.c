@@ -102,6 +102,10 @@ struct pci_virt_device *pci_virt_find_device(struct phb *phb,
 {
 	struct pci_virt_device *pvd;
 
+	if (!phb->virt_map.incomplete)
+		return bdfn > 0xffff ? NULL :
+			pci_bdfn_map_get(&phb->virt_map, bdfn);
+
 	list_for_each(&phb->virt_devices, pvd, node) {
 		if (pvd->bdfn == bdfn)
 			return pvd;
@@ -251,6 +255,7 @@ struct pci_virt_device *pci_virt_add_device(struct phb *phb, uint32_t bdfn,
 	pvd->data     = data;
 	list_head_init(&pvd->pcrf);
 	list_add_tail(&phb->virt_devices, &pvd->node);
+	pci_bdfn_map_set(&phb->virt_map, bdfn, pvd);
 
 	return pvd;
 }
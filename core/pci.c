@@ -54,29 +54,172 @@ static int64_t __pci_find_cap(struct phb *phb, uint16_t bdfn,
 	return OPAL_UNSUPPORTED;
 }
 
-/* pci_find_cap - Find a PCI capability in a device config space
- *
- * This will return a config space offset (positive) or a negative
- * error (OPAL error codes).
- *
- * OPAL_UNSUPPORTED is returned if the capability doesn't exist
+/*
+ * Every capability in a device's standard and extended lists, read once
+ * so pci_find_cap() and pci_find_ecap() don't walk config space on each
+ * call. Entries are in list order so a duplicate resolves the way walking
+ * would. Extended ones are only read for PCIe devices, for anything else
+ * pci_find_ecap() still walks.
  */
-int64_t pci_find_cap(struct phb *phb, uint16_t bdfn, uint8_t want)
+#define PCI_CAP_CACHE_MAX	64
+
+struct pci_cap_cache_ent {
+	uint16_t	id;
+	uint16_t	pos;
+	uint8_t		version;	/* Extended ones only */
+	bool		ext;
+};
+
+struct pci_cap_cache {
+	bool			has_ecaps;
+	uint32_t		count;
+	struct pci_cap_cache_ent ent[];
+};
+
+static int64_t pci_cap_cache_read(struct phb *phb, uint16_t bdfn,
+				  struct pci_cap_cache_ent *ent,
+				  uint32_t *count, bool *has_ecaps)
 {
-	return __pci_find_cap(phb, bdfn, want, true);
+	bool pcie = false;
+	uint16_t vendor, stat, cap, off, prev = 0;
+	uint8_t pos, next;
+	uint32_t ecap;
+	int64_t rc;
+
+	/*
+	 * A device that's being reset, is frozen or has gone reads back
+	 * all-ones. Don't cache that, it'd stick until the next invalidation.
+	 */
+	rc = pci_cfg_read16(phb, bdfn, PCI_CFG_VENDOR_ID, &vendor);
+	if (rc)
+		return rc;
+	rc = pci_cfg_read16(phb, bdfn, PCI_CFG_STAT, &stat);
+	if (rc)
+		return rc;
+	if (vendor == 0xffff || stat == 0xffff)
+		return OPAL_HARDWARE;
+	pos = 0;
+	if (stat & PCI_CFG_STAT_CAP) {
+		rc = pci_cfg_read8(phb, bdfn, PCI_CFG_CAP, &pos);
+		if (rc)
+			return rc;
+		pos &= 0xfc;
+	}
+	while (pos) {
+		rc = pci_cfg_read16(phb, bdfn, pos, &cap);
+		if (rc)
+			return rc;
+		if (cap == 0xffff)
+			return OPAL_HARDWARE;
+		if (*count == PCI_CAP_CACHE_MAX)
+			return OPAL_RESOURCE;
+		ent[*count].id = cap & 0xff;
+		ent[*count].pos = pos;
+		ent[*count].ext = false;
+		(*count)++;
+		if ((cap & 0xff) == PCI_CFG_CAP_ID_EXP)
+			pcie = true;
+		next = (cap >> 8) & 0xfc;
+		if (next == pos)
+			break;
+		pos = next;
+	}
+
+	*has_ecaps = pcie;
+	if (!pcie)
+		return OPAL_SUCCESS;
+
+	for (off = 0x100; off && off < 0x1000; off = (ecap >> 20) & 0xffc) {
+		if (off == prev)
+			break;
+		prev = off;
+		rc = pci_cfg_read32(phb, bdfn, off, &ecap);
+		if (rc)
+			return rc;
+		if (ecap == 0xffffffff)
+			return OPAL_HARDWARE;
+		if (ecap == 0 || (ecap & 0xffff) == 0xffff)
+			break;
+		if (*count == PCI_CAP_CACHE_MAX)
+			return OPAL_RESOURCE;
+		ent[*count].id = ecap & 0xffff;
+		ent[*count].pos = off;
+		ent[*count].version = (ecap >> 16) & 0xf;
+		ent[*count].ext = true;
+		(*count)++;
+	}
+
+	return OPAL_SUCCESS;
 }
 
-/* pci_find_ecap - Find a PCIe extended capability in a device
- *                 config space
- *
- * This will return a config space offset (positive) or a negative
- * error (OPAL error code). Additionally, if the "version" argument
- * is non-NULL, the capability version will be returned there.
- *
- * OPAL_UNSUPPORTED is returned if the capability doesn't exist
- */
-int64_t pci_find_ecap(struct phb *phb, uint16_t bdfn, uint16_t want,
-		      uint8_t *version)
+static void pci_cap_cache_init(struct phb *phb, struct pci_device *pd)
+{
+	struct pci_cap_cache_ent ent[PCI_CAP_CACHE_MAX];
+	struct pci_cap_cache *cc;
+	uint32_t count = 0;
+	bool has_ecaps;
+
+	/* If anything goes wrong, lookups walk config space like before */
+	if (pci_cap_cache_read(phb, pd->bdfn, ent, &count, &has_ecaps))
+		return;
+
+	cc = malloc(sizeof(*cc) + count * sizeof(ent[0]));
+	if (!cc)
+		return;
+	cc->has_ecaps = has_ecaps;
+	cc->count = count;
+	memcpy(cc->ent, ent, count * sizeof(ent[0]));
+	pd->cap_cache = cc;
+}
+
+/* After a reset or before the device goes away */
+static void pci_cap_cache_invalidate(struct pci_device *pd)
+{
+	free(pd->cap_cache);
+	pd->cap_cache = NULL;
+}
+
+/* Returns false if pci_find_(e)cap() has to walk config space instead */
+static bool pci_cap_cache_find(struct phb *phb, struct pci_device *pd,
+			       uint16_t want, bool ext, uint8_t *version,
+			       int64_t *pos)
+{
+	struct pci_cap_cache *cc;
+	uint32_t i;
+
+	if (!pd)
+		return false;
+	if (!pd->cap_cache)
+		pci_cap_cache_init(phb, pd);
+	cc = pd->cap_cache;
+	if (!cc || (ext && !cc->has_ecaps))
+		return false;
+
+	for (i = 0; i < cc->count; i++) {
+		if (cc->ent[i].ext != ext || cc->ent[i].id != want)
+			continue;
+		if (version)
+			*version = cc->ent[i].version;
+		*pos = cc->ent[i].pos;
+		return true;
+	}
+	*pos = OPAL_UNSUPPORTED;
+	return true;
+}
+
+static int64_t pci_dev_find_cap(struct phb *phb, struct pci_device *pd,
+				uint8_t want)
+{
+	int64_t pos;
+
+	if (pci_cap_cache_find(phb, pd, want, false, NULL, &pos))
+		return pos;
+
+	return __pci_find_cap(phb, pd->bdfn, want, true);
+}
+
+static int64_t __pci_find_ecap(struct phb *phb, uint16_t bdfn, uint16_t want,
+			       uint8_t *version)
 {
 	int64_t rc;
 	uint32_t cap;
@@ -105,6 +248,56 @@ int64_t pci_find_ecap(struct phb *phb, uint16_t bdfn, uint16_t want,
 	return OPAL_UNSUPPORTED;
 }
 
+static int64_t pci_dev_find_ecap(struct phb *phb, struct pci_device *pd,
+				 uint16_t want, uint8_t *version)
+{
+	int64_t pos;
+
+	if (pci_cap_cache_find(phb, pd, want, true, version, &pos))
+		return pos;
+
+	return __pci_find_ecap(phb, pd->bdfn, want, version);
+}
+
+/* pci_find_cap - Find a PCI capability in a device config space
+ *
+ * This will return a config space offset (positive) or a negative
+ * error (OPAL error codes).
+ *
+ * OPAL_UNSUPPORTED is returned if the capability doesn't exist
+ */
+int64_t pci_find_cap(struct phb *phb, uint16_t bdfn, uint8_t want)
+{
+	struct pci_device *pd = pci_find_dev(phb, bdfn);
+	int64_t pos;
+
+	if (pci_cap_cache_find(phb, pd, want, false, NULL, &pos))
+		return pos;
+
+	return __pci_find_cap(phb, bdfn, want, true);
+}
+
+/* pci_find_ecap - Find a PCIe extended capability in a device
+ *                 config space
+ *
+ * This will return a config space offset (positive) or a negative
+ * error (OPAL error code). Additionally, if the "version" argument
+ * is non-NULL, the capability version will be returned there.
+ *
+ * OPAL_UNSUPPORTED is returned if the capability doesn't exist
+ */
+int64_t pci_find_ecap(struct phb *phb, uint16_t bdfn, uint16_t want,
+		      uint8_t *version)
+{
+	struct pci_device *pd = pci_find_dev(phb, bdfn);
+	int64_t pos;
+
+	if (pci_cap_cache_find(phb, pd, want, true, version, &pos))
+		return pos;
+
+	return __pci_find_ecap(phb, bdfn, want, version);
+}
+
 static void pci_init_pcie_cap(struct phb *phb, struct pci_device *pd)
 {
 	int64_t ecap = 0;
@@ -125,9 +318,9 @@ static void pci_init_pcie_cap(struct phb *phb, struct pci_device *pd)
 			ecap = __pci_find_cap(phb, pd->bdfn,
 					      PCI_CFG_CAP_ID_EXP, false);
 		else
-			ecap = pci_find_cap(phb, pd->bdfn, PCI_CFG_CAP_ID_EXP);
+			ecap = pci_dev_find_cap(phb, pd, PCI_CFG_CAP_ID_EXP);
 	} else {
-		ecap = pci_find_cap(phb, pd->bdfn, PCI_CFG_CAP_ID_EXP);
+		ecap = pci_dev_find_cap(phb, pd, PCI_CFG_CAP_ID_EXP);
 	}
 
 	if (ecap <= 0) {
@@ -169,7 +362,7 @@ static void pci_init_aer_cap(struct phb *phb, struct pci_device *pd)
 	if (!pci_has_cap(pd, PCI_CFG_CAP_ID_EXP, false))
 		return;
 
-	pos = pci_find_ecap(phb, pd->bdfn, PCIECAP_ID_AER, NULL);
+	pos = pci_dev_find_ecap(phb, pd, PCIECAP_ID_AER, NULL);
 	if (pos > 0)
 		pci_set_cap(pd, PCIECAP_ID_AER, pos, NULL, NULL, true);
 }
@@ -178,7 +371,7 @@ static void pci_init_pm_cap(struct phb *phb, struct pci_device *pd)
 {
 	int64_t pos;
 
-	pos = pci_find_cap(phb, pd->bdfn, PCI_CFG_CAP_ID_PM);
+	pos = pci_dev_find_cap(phb, pd, PCI_CFG_CAP_ID_PM);
 	if (pos > 0)
 		pci_set_cap(pd, PCI_CFG_CAP_ID_PM, pos, NULL, NULL, false);
 }
@@ -293,6 +486,7 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 		list_add_tail(&phb->devices, &pd->link);
 	else
 		list_add_tail(&parent->children, &pd->link);
+	pci_bdfn_map_set(&phb->dev_map, bdfn, pd);
 
 	/*
 	 * Call PHB hook
@@ -688,6 +882,9 @@ void pci_remove_bus(struct phb *phb, struct list_head *list)
 
 		/* Remove from parent list and release itself */
 		list_del(&pd->link);
+		if (pci_bdfn_map_get(&phb->dev_map, pd->bdfn) == pd)
+			pci_bdfn_map_set(&phb->dev_map, pd->bdfn, NULL);
+		pci_cap_cache_invalidate(pd);
 		free(pd);
 	}
 }
@@ -1673,34 +1870,27 @@ void __noinline pci_add_device_nodes(struct phb *phb,
 
 static void pci_do_jobs(void (*fn)(void *))
 {
-	struct cpu_job **jobs;
+	struct cpu_job_group *grp;
+	bool added;
 	int i;
 
-	jobs = zalloc(sizeof(struct cpu_job *) * ARRAY_SIZE(phbs));
-	assert(jobs);
+	grp = cpu_job_group_alloc();
+	assert(grp);
 	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
-		if (!phbs[i]) {
-			jobs[i] = NULL;
+		if (!phbs[i])
 			continue;
-		}
-
-		jobs[i] = __cpu_queue_job(NULL, phbs[i]->dt_node->name,
-					  fn, phbs[i], false);
-		assert(jobs[i]);
 
+		added = cpu_job_group_add(grp,
+					  __dt_get_chip_id(phbs[i]->dt_node),
+					  phbs[i]->dt_node->name, fn, phbs[i]);
+		assert(added);
 	}
 
-	/* If no secondary CPUs, do everything sync */
-	cpu_process_local_jobs();
+	/* If no secondary CPUs, this does everything sync */
+	cpu_job_group_submit(grp);
 
 	/* Wait until all tasks are done */
-	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
-		if (!jobs[i])
-			continue;
-
-		cpu_wait_job(jobs[i], true);
-	}
-	free(jobs);
+	cpu_job_group_wait(grp);
 }
 
 static void __pci_init_slots(void)
@@ -1748,14 +1938,16 @@ static void __pci_init_slots(void)
 	}
 }
 
-static void __pci_reset(struct list_head *list)
+static void __pci_reset(struct phb *phb, struct list_head *list)
 {
 	struct pci_device *pd;
 	struct pci_cfg_reg_filter *pcrf;
 	int i;
 
 	while ((pd = list_pop(list, struct pci_device, link)) != NULL) {
-		__pci_reset(&pd->children);
+		__pci_reset(phb, &pd->children);
+		if (pci_bdfn_map_get(&phb->dev_map, pd->bdfn) == pd)
+			pci_bdfn_map_set(&phb->dev_map, pd->bdfn, NULL);
 		dt_free(pd->dn);
 		free(pd->slot);
 		while((pcrf = list_pop(&pd->pcrf, struct pci_cfg_reg_filter, link)) != NULL) {
@@ -1764,6 +1956,7 @@ static void __pci_reset(struct list_head *list)
 		for(i=0; i < 64; i++)
 			if (pd->cap[i].free_func)
 				pd->cap[i].free_func(pd->cap[i].data);
+		pci_cap_cache_invalidate(pd);
 		free(pd);
 	}
 }
@@ -1778,7 +1971,7 @@ int64_t pci_reset(void)
 		struct phb *phb = phbs[i];
 		if (!phb)
 			continue;
-		__pci_reset(&phb->devices);
+		__pci_reset(phb, &phb->devices);
 
 		pci_slot_set_state(phb->slot, PCI_SLOT_STATE_CRESET_START);
 	}
@@ -1862,15 +2055,39 @@ static int __pci_find_dev(struct phb *phb,
 
 struct pci_device *pci_find_dev(struct phb *phb, uint16_t bdfn)
 {
+	if (!phb->dev_map.incomplete)
+		return pci_bdfn_map_get(&phb->dev_map, bdfn);
+
 	return pci_walk_dev(phb, NULL, __pci_find_dev, &bdfn);
 }
 
+void pci_bdfn_map_set(struct pci_bdfn_map *map, uint16_t bdfn, void *dev)
+{
+	void **devfns = map->bus[PCI_BUS_NUM(bdfn)];
+
+	if (!devfns) {
+		if (!dev)
+			return;
+		devfns = zalloc(256 * sizeof(*devfns));
+		if (!devfns) {
+			prerror("PCI: No memory for bdfn map, will walk\n");
+			map->incomplete = true;
+			return;
+		}
+		map->bus[PCI_BUS_NUM(bdfn)] = devfns;
+	}
+	devfns[bdfn & 0xff] = dev;
+}
+
 static int __pci_restore_bridge_buses(struct phb *phb,
 				      struct pci_device *pd,
 				      void *data __unused)
 {
 	uint32_t vdid;
 
+	/* The reset may have changed it, read it again when it's wanted */
+	pci_cap_cache_invalidate(pd);
+
 	/* If the device is behind a switch, wait for the switch */
 	if (!pd->is_vf && !(pd->bdfn & 7) && pd->parent != NULL &&
 	    pd->parent->dev_type == PCIE_TYPE_SWITCH_DNPORT) {
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Submit cpu_job_groups to a handful of pretend CPUs, run their queues
+ * and steal from them by hand, and check every job runs exactly once,
+ * where it should, before cpu_job_group_wait() returns.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#define zalloc(size) calloc((size), 1)
+
+/* The CPUs live here rather than at their fixed address */
+#define NR_CPUS		4
+static char test_stacks[NR_CPUS][STACK_SIZE] __align(STACK_SIZE);
+#undef CPU_STACKS_BASE
+#define CPU_STACKS_BASE	((unsigned long)test_stacks)
+
+static unsigned long fake_tb;
+
+static inline unsigned long mftb(void)
+{
+	return fake_tb;
+}
+
+static inline void sync(void)
+{
+	__sync_synchronize();
+}
+#define lwsync sync
+#define isync sync
+
+static inline uint32_t __cmpxchg32(uint32_t *mem, uint32_t old, uint32_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
+static inline uint64_t __cmpxchg64(uint64_t *mem, uint64_t old, uint64_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
+static inline void smt_lowest(void) { }
+static inline void smt_medium(void) { }
+static inline uint64_t mfspr(unsigned int spr __unused) { return 0; }
+static inline void mtspr(unsigned int spr __unused, uint64_t val __unused) { }
+static inline void mtmsrd(uint64_t val __unused, int l __unused) { }
+static inline void set_hid0(uint64_t hid0 __unused) { }
+void trigger_attn(void);
+
+/* From skiboot's own string.h */
+void memcpy_enable_vsx(void);
+
+/* Doorbells just get counted */
+static unsigned int test_dbells[NR_CPUS];
+
+static inline void p9_dbell_send(uint32_t pir)
+{
+	test_dbells[pir]++;
+}
+
+static inline void p9_dbell_receive(void) { }
+
+/* cpu.c prints 64-bit values as %llx, which only suits skiboot's libc */
+#undef prlog
+#define prlog(l, f, ...) test_prlog(l, f, ##__VA_ARGS__)
+
+static inline void test_prlog(int l __unused, const char *fmt __unused, ...)
+{
+}
+
+#include "../cpu.c"
+
+/* Only job groups are tested, the rest just has to link */
+enum proc_gen proc_gen = proc_gen_p9;
+unsigned long tb_hz = 512000000;
+unsigned long top_of_ram;
+struct dt_node *dt_root;
+enum proc_chip_quirks proc_chip_quirks;
+struct debug_descriptor debug_descriptor;
+
+static struct cpu_thread *cpu(unsigned int pir)
+{
+	return &cpu_stacks[pir].cpu;
+}
+
+/* Run a CPU's queue as that CPU */
+static void run_cpu(struct cpu_thread *t)
+{
+	struct cpu_thread *me = this_cpu();
+
+	__this_cpu = t;
+	cpu_process_jobs();
+	__this_cpu = me;
+}
+
+/* The other CPUs get on with their jobs while the boot CPU waits */
+void time_wait_us_nopoll(unsigned long us)
+{
+	unsigned int pir;
+
+	fake_tb += usecs_to_tb(us);
+	for (pir = 1; pir < NR_CPUS; pir++)
+		run_cpu(cpu(pir));
+}
+
+void opal_run_pollers(void)
+{
+}
+
+#define NR_JOBS		6
+
+static unsigned int runs[NR_JOBS];
+static struct cpu_thread *ran_on[NR_JOBS];
+
+static void test_job(void *data)
+{
+	unsigned long i = (unsigned long)data;
+
+	runs[i]++;
+	ran_on[i] = this_cpu();
+}
+
+static struct cpu_job_group *submit(unsigned int nr, int32_t chip_id)
+{
+	struct cpu_job_group *grp = cpu_job_group_alloc();
+	unsigned long i;
+
+	memset(runs, 0, sizeof(runs));
+	memset(ran_on, 0, sizeof(ran_on));
+	assert(grp);
+	for (i = 0; i < nr; i++)
+		assert(cpu_job_group_add(grp, chip_id, "test", test_job,
+					 (void *)i));
+	cpu_job_group_submit(grp);
+
+	return grp;
+}
+
+static void check_ran(unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		assert(runs[i] == 1);
+	assert(cpu_jobs_stealable == 0);
+}
+
+int main(void)
+{
+	struct cpu_job_group *grp;
+	unsigned int pir;
+
+	/* Two chips of two single thread cores, the boot CPU is 0 */
+	for (pir = 0; pir < NR_CPUS; pir++) {
+		struct cpu_thread *t = cpu(pir);
+
+		t->pir = pir;
+		t->chip_id = pir / 2;
+		t->state = cpu_state_active;
+		t->primary = t;
+		list_head_init(&t->job_queue);
+		list_head_init(&t->locks_held);
+		init_lock(&t->job_lock);
+	}
+	cpu_max_pir = NR_CPUS - 1;
+	__this_cpu = boot_cpu = cpu(0);
+
+	/* Spread over everyone else, and waited for as they complete */
+	grp = submit(NR_JOBS, -1);
+	for (pir = 1; pir < NR_CPUS; pir++)
+		assert(cpu(pir)->job_count == NR_JOBS / (NR_CPUS - 1));
+	assert(cpu(0)->job_count == 0);
+	assert(cpu_jobs_stealable == NR_JOBS);
+	assert(!cpu_job_group_done(grp));
+	assert(cpu_job_group_wait(grp) == CPU_JOB_GROUP_WAIT_US);
+	check_ran(NR_JOBS);
+
+	/* The time taken is to the latest completion, not the last one */
+	fake_tb = 0;
+	grp = submit(NR_JOBS, -1);
+	fake_tb = usecs_to_tb(100);
+	run_cpu(cpu(2));
+	fake_tb = usecs_to_tb(60);
+	run_cpu(cpu(1));
+	run_cpu(cpu(3));
+	assert(cpu_job_group_done(grp));
+	assert(cpu_job_group_wait(grp) == 100);
+	check_ran(NR_JOBS);
+
+	/*
+	 * Jobs went round-robin to 1, 2, 3. Once 3 is done with its own it
+	 * takes from the tail of its chip first, then from the other chip.
+	 */
+	grp = submit(NR_JOBS, -1);
+	run_cpu(cpu(3));
+	assert(runs[2] == 1 && runs[5] == 1);
+	assert(cpu_steal_job(cpu(3)));
+	assert(cpu(2)->job_count == 1 && cpu(3)->job_count == 1);
+	run_cpu(cpu(3));
+	assert(ran_on[4] == cpu(3));
+	assert(cpu_steal_job(cpu(3)));
+	assert(cpu_steal_job(cpu(3)));
+	assert(cpu_steal_job(cpu(3)));
+	assert(!cpu_steal_job(cpu(3)));
+	assert(cpu(3)->job_count == 3);
+	run_cpu(cpu(3));
+	for (pir = 0; pir < NR_JOBS; pir++)
+		assert(ran_on[pir] == cpu(3));
+	assert(cpu_job_group_done(grp));
+	cpu_job_group_wait(grp);
+	check_ran(NR_JOBS);
+
+	/* Jobs for chip 0 only go to, and are only stolen by, chip 0 */
+	grp = submit(3, 0);
+	assert(cpu(1)->job_count == 3);
+	assert(!cpu_steal_job(cpu(2)) && !cpu_steal_job(cpu(3)));
+	cpu_job_group_wait(grp);
+	for (pir = 0; pir < 3; pir++)
+		assert(ran_on[pir] == cpu(1));
+	check_ran(3);
+
+	/* Nobody to give them to, so they're run by the submitter */
+	for (pir = 1; pir < NR_CPUS; pir++)
+		cpu(pir)->job_has_no_return = true;
+	grp = submit(3, -1);
+	assert(cpu_job_group_done(grp));
+	for (pir = 0; pir < 3; pir++)
+		assert(ran_on[pir] == cpu(0));
+	cpu_job_group_wait(grp);
+	check_ran(3);
+	for (pir = 1; pir < NR_CPUS; pir++)
+		cpu(pir)->job_has_no_return = false;
+
+	/* Idle targets are woken, busy ones will find them anyway */
+	pm_enabled = true;
+	cpu(1)->in_idle = true;
+	grp = submit(2, 0);
+	assert(test_dbells[1] == 1);
+	assert(test_dbells[0] == 0 && test_dbells[2] == 0 &&
+	       test_dbells[3] == 0);
+	pm_enabled = false;
+	cpu(1)->in_idle = false;
+	cpu_job_group_wait(grp);
+	check_ran(2);
+
+	return 0;
+}
@@ -3,6 +3,7 @@
  * Copyright 2019 IBM Corp.
  */
 
+#define __TEST__
 #include <skiboot.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,8 +26,6 @@ static inline bool fake_is_rodata(const void *p)
 #include <assert.h>
 #include "../../test/dt_common.c"
 
-#define __TEST__
-
 static inline unsigned long mfspr(unsigned int spr);
 
 #include <ccan/str/str.c>
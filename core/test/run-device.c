@@ -5,6 +5,7 @@
 
 #include <skiboot.h>
 #include <stdlib.h>
+#include <time.h>
 
 /* Override this for testing. */
 #define is_rodata(p) fake_is_rodata(p)
@@ -90,6 +91,181 @@ const char **props_to_fix(struct dt_node *node)
 	return NULL;
 }
 
+/* What the lookups did before there was any indexing */
+static const struct dt_property *slow_find_property(const struct dt_node *node,
+						    const char *name)
+{
+	const struct dt_property *i;
+
+	list_for_each(&node->properties, i, list)
+		if (strcmp(i->name, name) == 0)
+			return i;
+	return NULL;
+}
+
+static struct dt_node *slow_find_by_phandle(struct dt_node *root, u32 phandle)
+{
+	struct dt_node *node;
+
+	dt_for_each_node(root, node)
+		if (node->phandle == phandle)
+			return node;
+	return NULL;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define BENCH_CHIPS	32
+#define BENCH_NODES	64	/* per chip */
+#define BENCH_PROPS	24	/* per node */
+#define BENCH_PHANDLES	2000
+
+/*
+ * A tree shaped like a big system's: lots of chips, each with lots of
+ * nodes that have lots of properties. Check the indexed lookups find the
+ * same things as walking the lists and the tree does, then time both.
+ */
+static void test_lookup_bench(void)
+{
+	struct dt_node *root, *chip, *node, **nodes;
+	const struct dt_property *p;
+	struct dt_property *rp;
+	char name[32], names[BENCH_PROPS][32];
+	unsigned int c, n, i, nr = 0;
+	uint64_t start, fast, slow;
+	u32 ph, phandle;
+
+	nodes = malloc(BENCH_CHIPS * BENCH_NODES * sizeof(*nodes));
+	assert(nodes);
+
+	root = dt_new_root("");
+	for (c = 0; c < BENCH_CHIPS; c++) {
+		chip = dt_new_addr(root, "chip", c);
+		for (n = 0; n < BENCH_NODES; n++) {
+			node = dt_new_addr(chip, "unit", n);
+			for (i = 0; i < BENCH_PROPS; i++) {
+				snprintf(name, sizeof(name), "ibm,prop-%u", i);
+				dt_add_property_cells(node, name, i);
+			}
+			nodes[nr++] = node;
+		}
+	}
+
+	for (i = 0; i < nr; i++) {
+		node = nodes[i];
+		assert(node->prop_hash);
+		assert(dt_find_by_phandle(root, node->phandle) == node);
+		list_for_each(&node->properties, p, list)
+			assert(dt_find_property(node, p->name) == p);
+		assert(!dt_find_property(node, "ibm,prop-none"));
+	}
+	assert(!dt_find_by_phandle(root, root->phandle));
+	assert(!dt_find_by_phandle(root, last_phandle + 1));
+
+	/* Moved, deleted and renumbered things are still found properly */
+	node = nodes[7];
+	rp = __dt_find_property(node, "ibm,prop-3");
+	dt_resize_property(&rp, 4096);
+	assert(dt_find_property(node, "ibm,prop-3") == rp);
+	dt_del_property(node, rp);
+	assert(!dt_find_property(node, "ibm,prop-3"));
+	assert(dt_find_property(node, "ibm,prop-4"));
+
+	ph = node->phandle;
+	phandle = last_phandle + 100;
+	dt_add_property(node, "phandle", &phandle, sizeof(phandle));
+	assert(!dt_find_by_phandle(root, ph));
+	assert(dt_find_by_phandle(root, node->phandle) == node);
+
+	/* Not in this tree */
+	chip = dt_new_root("elsewhere");
+	assert(!dt_find_by_phandle(root, chip->phandle));
+	assert(dt_find_by_phandle(chip, chip->phandle) == NULL);
+	dt_free(chip);
+
+	for (i = 0; i < BENCH_PROPS; i++)
+		snprintf(names[i], sizeof(names[i]), "ibm,prop-%u", i);
+
+	start = now_ns();
+	for (i = 0; i < nr; i++)
+		assert(slow_find_property(nodes[i], names[i % BENCH_PROPS]) ||
+		       i % BENCH_PROPS == 3);
+	slow = now_ns() - start;
+	start = now_ns();
+	for (i = 0; i < nr; i++)
+		assert(dt_find_property(nodes[i], names[i % BENCH_PROPS]) ||
+		       i % BENCH_PROPS == 3);
+	fast = now_ns() - start;
+	printf("dt_find_property: %u lookups, %lluus walking, %lluus hashed\n",
+	       nr, (unsigned long long)slow / 1000,
+	       (unsigned long long)fast / 1000);
+
+	start = now_ns();
+	for (i = 0; i < BENCH_PHANDLES; i++) {
+		node = nodes[(i * 7919) % nr];
+		assert(slow_find_by_phandle(root, node->phandle) == node);
+	}
+	slow = now_ns() - start;
+	start = now_ns();
+	for (i = 0; i < BENCH_PHANDLES; i++) {
+		node = nodes[(i * 7919) % nr];
+		assert(dt_find_by_phandle(root, node->phandle) == node);
+	}
+	fast = now_ns() - start;
+	printf("dt_find_by_phandle: %u lookups, %lluus walking, %lluus indexed\n",
+	       BENCH_PHANDLES, (unsigned long long)slow / 1000,
+	       (unsigned long long)fast / 1000);
+
+	dt_free(root);
+	free(nodes);
+}
+
+/* Names are shared, arena properties can still be deleted and resized */
+static void test_name_and_prop_arenas(void)
+{
+	struct dt_node *root, *a, *b;
+	struct dt_property *p, *q;
+	char name[16];
+	int i;
+
+	root = dt_new_root("arenas");
+	strcpy(name, "node@1");
+	a = dt_new(root, name);
+	strcpy(name, "node@2");
+	b = dt_new(root, name);
+	assert(a->name != b->name && streq(a->name, "node@1"));
+
+	dt_prop_arena_begin();
+	for (i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "prop%d", i);
+		p = dt_add_property_cells(a, name, i);
+		q = dt_add_property_cells(b, name, i + 1);
+		assert(p->name == q->name);
+		assert(((unsigned long)p & 7) == 0);
+	}
+	dt_prop_arena_end();
+
+	p = __dt_find_property(a, "prop7");
+	dt_resize_property(&p, 4096);
+	p->len = 4096;
+	assert(dt_property_get_cell(p, 0) == 7);
+	memset(p->prop, 0x5a, 4096);
+	assert(dt_prop_get_u32(a, "prop8") == 8);
+	assert(dt_prop_get_u32(a, "prop6") == 6);
+
+	dt_del_property(b, __dt_find_property(b, "prop500"));
+	assert(!dt_find_property(b, "prop500"));
+	assert(dt_prop_get_u32(b, "prop501") == 502);
+
+	dt_free(root);
+}
+
 int main(void)
 {
 	struct dt_node *root, *other_root, *c1, *c2, *c2_c, *gc1, *gc2, *gc3, *ggc1, *ggc2;
@@ -466,6 +642,11 @@ int main(void)
 	new_prop_ph = dt_prop_get_u32(ut2, "something");
 	assert(!(new_prop_ph == ev1_ph));
 	dt_free(subtree);
+
+	test_name_and_prop_arenas();
+
+	test_lookup_bench();
+
 	return 0;
 }
 
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Check create_dtb() sizes the FDT right first time, and that the sizes
+ * cached in the nodes follow changes to the tree.
+ */
+
+#include <skiboot.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/* Override this for testing. */
+#define is_rodata(p) fake_is_rodata(p)
+
+char __rodata_start[16];
+#define __rodata_end (__rodata_start + sizeof(__rodata_start))
+
+static inline bool fake_is_rodata(const void *p)
+{
+	return ((char *)p >= __rodata_start && (char *)p < __rodata_end);
+}
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+#include "../../libfdt/fdt.c"
+#include "../../libfdt/fdt_ro.c"
+#include "../../libfdt/fdt_sw.c"
+#include "../../libfdt/fdt_strerror.c"
+
+#include "../device.c"
+#include "../../test/dt_common.c"
+
+unsigned long top_of_ram = ~0UL;
+enum proc_chip_quirks proc_chip_quirks;
+
+#include "../fdt.c"
+
+static int count_nodes(const void *fdt)
+{
+	int off = 0, next, n = 0;
+	uint32_t tag;
+
+	while ((tag = fdt_next_tag(fdt, off, &next)) != FDT_END) {
+		if (tag == FDT_BEGIN_NODE)
+			n++;
+		off = next;
+	}
+
+	return n;
+}
+
+/* The size without name dedup is exact, with it we only use less */
+static void *check_dtb(const struct dt_node *root, bool exclusive,
+		       int nodes)
+{
+	size_t size;
+	void *fdt;
+
+	proc_chip_quirks = QUIRK_SLOW_SIM;
+	size = dtb_size(root, exclusive);
+	fdt = create_dtb(root, exclusive);
+	assert(fdt);
+	assert(fdt_check_header(fdt) == 0);
+	assert(fdt_totalsize(fdt) == size);
+	free(fdt);
+
+	proc_chip_quirks = 0;
+	fdt = create_dtb(root, exclusive);
+	assert(fdt);
+	assert(fdt_check_header(fdt) == 0);
+	assert(fdt_totalsize(fdt) <= size);
+	assert(count_nodes(fdt) == nodes);
+
+	return fdt;
+}
+
+int main(void)
+{
+	static const u64 ranges[] = { 0x1000, 0x1000, 0x30000000, 0x100000 };
+	struct dt_node *a, *b, *c, *n;
+	struct dt_property *p;
+	const void *fdt_prop;
+	char name[32];
+	void *fdt;
+	u64 size;
+	int i, len;
+
+	dt_root = dt_new_root("");
+	dt_add_property_cells(dt_root, "#address-cells", 2);
+	dt_add_property(dt_root, "reserved-ranges", ranges, sizeof(ranges));
+	dt_add_property_string(dt_root, DT_PRIVATE "hidden", "not flattened");
+
+	a = dt_new(dt_root, "a");
+	b = dt_new_addr(dt_root, "bus", 0x1234);
+	c = dt_new(b, "odd-length-name");
+	dt_add_property_string(a, "compatible", "ibm,test");
+	dt_add_property_cells(b, "reg", 0, 0x1234, 0, 0x10);
+	dt_add_property(c, "empty", NULL, 0);
+	dt_add_property(c, "three", "abc", 3);
+	for (i = 0; i < 20; i++) {
+		snprintf(name, sizeof(name), "child@%x", i);
+		n = dt_new(a, name);
+		dt_add_property_cells(n, "reg", i);
+		dt_add_property_string(n, "status", "okay");
+	}
+
+	fdt = check_dtb(dt_root, false, 24);
+	assert(fdt_num_mem_rsv(fdt) == 2);
+	i = fdt_path_offset(fdt, "/bus@1234/odd-length-name");
+	fdt_prop = fdt_getprop(fdt, i, "three", &len);
+	assert(fdt_prop && len == 3 && memcmp(fdt_prop, "abc", 3) == 0);
+	assert(!fdt_getprop(fdt, 0, DT_PRIVATE "hidden", &len));
+	free(fdt);
+
+	/* Everything's cached now, a change only dirties the way up */
+	dt_for_each_node(dt_root, n)
+		assert(n->flat_gen == dt_flat_gen);
+	dt_add_property_cells(c, "new", 1, 2, 3);
+	assert(!c->flat_gen && !b->flat_gen && !dt_root->flat_gen);
+	assert(a->flat_gen == dt_flat_gen);
+	free(check_dtb(dt_root, false, 24));
+
+	/* Deleting, adding and removing nodes */
+	p = __dt_find_property(c, "three");
+	dt_del_property(c, p);
+	dt_new(c, "grandchild");
+	dt_free(dt_find_by_name(a, "child@3"));
+	assert(a->flat_gen != dt_flat_gen);
+	free(check_dtb(dt_root, false, 24));
+
+	/* We can't tell whose property got resized, so that drops the lot */
+	p = __dt_find_property(b, "reg");
+	dt_resize_property(&p, 4096);
+	p->len = 4096;
+	assert(b->flat_gen != dt_flat_gen && a->flat_gen != dt_flat_gen);
+	free(check_dtb(dt_root, false, 24));
+
+	/* A subtree, as OPAL_GET_DEVICE_TREE hands them out */
+	free(check_dtb(a, true, 19));
+	size = opal_get_device_tree(a->phandle, 0, 0);
+	assert(size == dtb_size(a, true));
+	fdt = malloc(size);
+	assert(opal_get_device_tree(a->phandle, (u64)fdt, size / 2) ==
+	       OPAL_NO_MEM);
+	assert(opal_get_device_tree(a->phandle, (u64)fdt, size) ==
+	       OPAL_SUCCESS);
+	assert(count_nodes(fdt) == 19);
+	free(fdt);
+
+	dt_free(dt_root);
+	return 0;
+}
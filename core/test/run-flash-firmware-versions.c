@@ -3,6 +3,8 @@
  * Copyright 2018-2019 IBM Corp.
  */
 
+#define __TEST__
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Check the cached partition table is kept across flash writes that miss
+ * it, and dropped and re-read after ones that hit it.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#define zalloc(size) calloc((size), 1)
+
+/* flash.c prints u64s as %llx, which only suits skiboot's own libc */
+#undef pr_fmt
+#undef prlog
+#define prlog(l, f, ...) test_prlog(l, f, ##__VA_ARGS__)
+
+static inline void test_prlog(int l __unused, const char *fmt __unused, ...)
+{
+}
+
+#include "../flash.c"
+#include "../flash-subpartition.c"
+/* Build libffs the way skiboot does */
+#define __SKIBOOT__
+#include "../../libflash/libffs.c"
+#include "../../libflash/blocklevel.c"
+#include "../../libflash/ecc.c"
+
+unsigned long top_of_ram;
+struct dt_node *opal_node;
+struct dt_node *dt_chosen;
+struct platform platform;
+bool libflash_debug;
+
+#define TEST_GRANULE	0x1000
+#define TEST_SIZE	(16 * TEST_GRANULE)
+
+static char test_flash[TEST_SIZE];
+static uint64_t test_read_bytes;
+
+static int test_read(struct blocklevel_device *bl __unused, uint64_t pos,
+		     void *buf, uint64_t len)
+{
+	assert(pos + len <= TEST_SIZE);
+	memcpy(buf, test_flash + pos, len);
+	test_read_bytes += len;
+	return 0;
+}
+
+static int test_write(struct blocklevel_device *bl __unused, uint64_t pos,
+		      const void *buf, uint64_t len)
+{
+	assert(pos + len <= TEST_SIZE);
+	memcpy(test_flash + pos, buf, len);
+	return 0;
+}
+
+static int test_erase(struct blocklevel_device *bl __unused, uint64_t pos,
+		      uint64_t len)
+{
+	assert(pos + len <= TEST_SIZE);
+	memset(test_flash + pos, 0xff, len);
+	return 0;
+}
+
+static int test_get_info(struct blocklevel_device *bl __unused,
+			 const char **name, uint64_t *total_size,
+			 uint32_t *erase_granule)
+{
+	if (name)
+		*name = "test";
+	if (total_size)
+		*total_size = TEST_SIZE;
+	if (erase_granule)
+		*erase_granule = TEST_GRANULE;
+	return 0;
+}
+
+static struct blocklevel_device test_bl = {
+	.read		= test_read,
+	.write		= test_write,
+	.erase		= test_erase,
+	.get_info	= test_get_info,
+	.erase_mask	= TEST_GRANULE - 1,
+	.flags		= WRITE_NEED_ERASE,
+};
+
+/* A TOC with just BOOTKERNEL in it, @block erase blocks in */
+static void write_toc(uint32_t block)
+{
+	struct ffs_entry *ent;
+	struct ffs_hdr *hdr;
+
+	assert(!ffs_hdr_new(TEST_GRANULE, TEST_SIZE / TEST_GRANULE, NULL,
+			    &hdr));
+	assert(!ffs_entry_new("BOOTKERNEL", block * TEST_GRANULE,
+			      TEST_GRANULE, &ent));
+	assert(!ffs_entry_add(hdr, ent));
+	ffs_entry_put(ent);
+	assert(!ffs_hdr_finalise(&test_bl, hdr));
+	ffs_hdr_free(hdr);
+}
+
+/* Where the (maybe cached) TOC says BOOTKERNEL is */
+static uint32_t kernel_start(struct flash *flash)
+{
+	struct ffs_handle *ffs = flash_get_ffs(flash);
+	uint32_t part, start;
+
+	assert(ffs);
+	assert(!ffs_lookup_part(ffs, "BOOTKERNEL", &part));
+	assert(!ffs_part_info(ffs, part, NULL, &start, NULL, NULL, NULL));
+	return start;
+}
+
+int main(void)
+{
+	struct flash flash = { .bl = &test_bl, .size = TEST_SIZE };
+	struct ffs_handle *ffs;
+	uint32_t toc_end;
+	uint64_t before;
+
+	memset(test_flash, 0xff, sizeof(test_flash));
+	write_toc(1);
+
+	/* Read once, then answered from the cache */
+	assert(kernel_start(&flash) == TEST_GRANULE);
+	ffs = flash.ffs;
+	assert(ffs && flash.toc_offset == 0);
+	assert(flash.toc_size > 0 && flash.toc_size < TEST_SIZE);
+	toc_end = flash.toc_offset + flash.toc_size;
+	before = test_read_bytes;
+	assert(kernel_start(&flash) == TEST_GRANULE);
+	assert(test_read_bytes == before);
+
+	/* Writes that miss the TOC, right up to its end, keep it */
+	flash_invalidate_ffs(&flash, toc_end, TEST_GRANULE);
+	assert(flash.ffs == ffs);
+	flash_invalidate_ffs(&flash, TEST_SIZE - TEST_GRANULE, TEST_GRANULE);
+	assert(flash.ffs == ffs);
+	flash_invalidate_ffs(&flash, 0, 0);
+	assert(flash.ffs == ffs);
+
+	/* Which is wrong once the TOC itself has been rewritten... */
+	write_toc(2);
+	assert(kernel_start(&flash) == TEST_GRANULE);
+
+	/* ...so a write overlapping its last byte drops it */
+	flash_invalidate_ffs(&flash, toc_end - 1, TEST_GRANULE);
+	assert(!flash.ffs);
+	flash_invalidate_ffs(&flash, 0, TEST_SIZE);
+	assert(!flash.ffs);
+	before = test_read_bytes;
+	assert(kernel_start(&flash) == 2 * TEST_GRANULE);
+	assert(test_read_bytes > before);
+
+	/* As does one overlapping its first, or all of it */
+	write_toc(3);
+	flash_invalidate_ffs(&flash, 0, 1);
+	assert(!flash.ffs);
+	assert(kernel_start(&flash) == 3 * TEST_GRANULE);
+	flash_invalidate_ffs(&flash, 0, TEST_SIZE);
+	assert(!flash.ffs);
+
+	return 0;
+}
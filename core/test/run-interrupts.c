@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Check irq_find_source() finds the same source through its index as
+ * walking the lists does, as sources come and go.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+#include <processor.h>
+
+static inline void sync(void)
+{
+	__sync_synchronize();
+}
+#define lwsync sync
+
+#define zalloc(size) calloc((size), 1)
+
+/* Override this for testing. */
+#define is_rodata(p) fake_is_rodata(p)
+
+char __rodata_start[16];
+#define __rodata_end (__rodata_start + sizeof(__rodata_start))
+
+static inline bool fake_is_rodata(const void *p)
+{
+	return ((char *)p >= __rodata_start && (char *)p < __rodata_end);
+}
+
+/* Don't include this, it's PPC-specific, and the ICP isn't tested */
+#define __IO_H
+static inline uint32_t in_be32(volatile uint32_t *addr __unused)
+{
+	return 0;
+}
+
+static inline void out_8(volatile uint8_t *addr __unused, uint8_t val __unused)
+{
+}
+
+static inline void out_be32(volatile uint32_t *addr __unused,
+			    uint32_t val __unused)
+{
+}
+
+#include "../interrupts.c"
+#include "../device.c"
+
+/* Only irq sources are tested, the rest just has to link */
+enum proc_gen proc_gen;
+unsigned long top_of_ram;
+struct dt_node *opal_node;
+uint64_t opal_pending_events;
+
+void lock_caller(struct lock *l, const char *caller __unused)
+{
+	assert(!l->lock_val);
+	l->lock_val++;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val--;
+}
+
+struct proc_chip *get_chip(uint32_t chip_id __unused)
+{
+	return NULL;
+}
+
+struct cpu_thread *find_cpu_by_server(u32 server_no __unused)
+{
+	return NULL;
+}
+
+bool p8_sbe_timer_ok(void)
+{
+	return true;
+}
+
+bool p9_sbe_timer_ok(void)
+{
+	return true;
+}
+
+void check_timers(bool from_interrupt __unused)
+{
+}
+
+#include <time.h>
+#include <inttypes.h>
+
+static const struct irq_source_ops test_ops;
+
+#define MAX_ISN		0x4000
+
+static void check_all(void)
+{
+	uint32_t isn;
+
+	for (isn = 0; isn < MAX_ISN; isn++)
+		assert(irq_find_source(isn) == irq_find_source_locked(isn));
+}
+
+static struct irq_source *secondary(uint32_t start, uint32_t end)
+{
+	struct irq_source *is = calloc(1, sizeof(*is));
+
+	assert(is);
+	is->start = start;
+	is->end = end;
+	is->ops = &test_ops;
+	__register_irq_source(is, true);
+
+	return is;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(void)
+{
+	uint64_t start, indexed, walked;
+	uint32_t i, isn;
+
+	/* Nothing registered */
+	assert(!irq_find_source(0x10));
+
+	/* Secondaries covering two chips, primaries scattered over them */
+	secondary(0x0000, 0x1000);
+	secondary(0x1000, 0x2000);
+	for (i = 0; i < 64; i++)
+		register_irq_source(&test_ops, NULL, (i * 0x97) % 0x3f00 + 8,
+				    i % 7 + 1);
+
+	/* Nothing's built until the first lookup after the last of them */
+	assert(!irq_index && irq_index_stale);
+	assert(irq_find_source(0x0004));
+	assert(irq_index && !irq_index_stale);
+	check_all();
+
+	/* Ranges right at the edges of a secondary */
+	register_irq_source(&test_ops, NULL, 0x0000, 4);
+	register_irq_source(&test_ops, NULL, 0x1ffe, 2);
+	assert(irq_find_source(0x0003)->start == 0x0000);
+	assert(irq_find_source(0x0004) == irq_find_source(0x0ffc));
+	assert(irq_find_source(0x1fff)->start == 0x1ffe);
+	check_all();
+
+	/* Take some away again, the secondary shows through */
+	unregister_irq_source(0x0000, 4);
+	assert(irq_find_source(0x0003)->start == 0x0000 &&
+	       irq_find_source(0x0003)->end == 0x1000);
+	for (i = 0; i < 64; i += 3)
+		unregister_irq_source((i * 0x97) % 0x3f00 + 8, i % 7 + 1);
+	check_all();
+
+	start = now_ns();
+	for (i = 0; i < 1000000; i++) {
+		isn = (i * 2654435761u) % MAX_ISN;
+		assert(irq_find_source(isn) || isn >= 0x2000);
+	}
+	indexed = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < 1000000; i++) {
+		isn = (i * 2654435761u) % MAX_ISN;
+		assert(irq_find_source_locked(isn) || isn >= 0x2000);
+	}
+	walked = now_ns() - start;
+
+	printf("irq_find_source: %"PRIu64"ns indexed, %"PRIu64"ns walking\n",
+	       indexed / 1000000, walked / 1000000);
+
+	return 0;
+}
@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#define __TEST__
+#define LOCK_STATS
+
+static inline uint64_t __cmpxchg64(uint64_t *mem, uint64_t old, uint64_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
+#include "../lock-stats.c"
+
+/* Just enough of a cpu_thread for lock.c, one per test thread */
+#define __CPU_H
+enum cpu_thread_state {
+	cpu_state_no_cpu	= 0,
+	cpu_state_active,
+	cpu_state_os,
+};
+
+struct cpu_thread {
+	uint32_t			pir;
+	enum cpu_thread_state		state;
+	uint32_t			con_suspend;
+	struct list_head		locks_held;
+	bool				con_need_flush;
+	struct lock			*requested_lock;
+};
+
+static struct cpu_thread test_cpus[2];
+static __thread struct cpu_thread *test_cpu;
+static unsigned int cpu_max_pir = 1;
+
+static inline struct cpu_thread *this_cpu(void)
+{
+	return test_cpu;
+}
+
+static struct cpu_thread *find_cpu_by_pir_nomcount(uint32_t pir)
+{
+	return pir <= cpu_max_pir ? &test_cpus[pir] : NULL;
+}
+
+/* Time only moves when the test says so */
+static uint64_t fake_tb;
+unsigned long tb_hz = 512000000;
+
+static inline unsigned long mftb(void)
+{
+	return __atomic_load_n(&fake_tb, __ATOMIC_SEQ_CST);
+}
+
+#define mfspr(spr) SPR_TFMR_TB_VALID
+#define sync() __sync_synchronize()
+#define lwsync() __sync_synchronize()
+
+static inline void smt_lowest(void) { }
+static inline void smt_medium(void) { }
+
+/* lock_error() prints a u64 as %llx, which only suits skiboot's own libc */
+static void lock_error_print(const char *reason, struct lock *l, uint64_t val)
+{
+	fprintf(stderr, "LOCK ERROR: %s @%p (state: 0x%016"PRIx64")\n",
+		reason, l, val);
+}
+#define fprintf(f, fmt, ...) lock_error_print(__VA_ARGS__)
+
+#include "../lock.c"
+
+#undef fprintf
+
+bool flush_console(void)
+{
+	return true;
+}
+
+void disable_fast_reboot(const char *reason __unused)
+{
+}
+
+void op_display(enum op_severity s __unused, enum op_module m __unused,
+		uint16_t code __unused)
+{
+}
+
+void backtrace(void)
+{
+}
+
+void backtrace_create(struct bt_entry *entries __unused,
+		      unsigned int max_ents __unused,
+		      struct bt_metadata *metadata __unused)
+{
+}
+
+void backtrace_print(struct bt_entry *entries __unused,
+		     struct bt_metadata *metadata __unused,
+		     char *out_buf __unused, unsigned int *len __unused,
+		     bool symbols __unused)
+{
+}
+
+static const char site_a[] = "a.c:1", site_b[] = "b.c:2";
+
+/* What lock() and unlock() do with LOCK_STATS */
+static void fake_lock(struct lock *l, const char *caller, uint64_t spin,
+		      uint64_t hold)
+{
+	l->stats = lock_stats_acquired(l, caller, spin != 0, spin);
+	lock_stats_released(l, hold);
+}
+
+/* Run a dump with stdout captured, so we can look at what it said */
+static char *dump(bool reset)
+{
+	static char buf[8192];
+	FILE *f = tmpfile();
+	int saved;
+	size_t n;
+
+	assert(f);
+	fflush(stdout);
+	saved = dup(1);
+	dup2(fileno(f), 1);
+	lock_stats_dump(reset);
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+
+	rewind(f);
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+	return buf;
+}
+
+/* Find the dump line for a lock and call site, and what it counted */
+static void dump_line(const char *out, struct lock *l, const char *caller,
+		      uint64_t counts[5])
+{
+	char name[64];
+	const char *line;
+	void *p;
+
+	for (line = out; line; line = strchr(line, '\n')) {
+		line += *line == '\n';
+		if (sscanf(line, "LOCK: %p %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64
+			   " %"PRIu64" %63s", &p, &counts[0], &counts[1],
+			   &counts[2], &counts[3], &counts[4], name) == 7 &&
+		    p == l && !strcmp(name, caller))
+			return;
+	}
+	assert(!"no dump line for lock");
+}
+
+static struct lock contended = LOCK_UNLOCKED;
+static bool holder_locked;
+
+static void *holder(void *arg __unused)
+{
+	test_cpu = &test_cpus[1];
+
+	lock(&contended);
+	__atomic_store_n(&holder_locked, true, __ATOMIC_SEQ_CST);
+
+	/* The deadlock checker shows when main starts spinning, make it 1000 */
+	while (!__atomic_load_n(&test_cpus[0].requested_lock, __ATOMIC_SEQ_CST))
+		;
+	__atomic_add_fetch(&fake_tb, 1000, __ATOMIC_SEQ_CST);
+	unlock(&contended);
+
+	return NULL;
+}
+
+/* The same again through lock() and unlock(), as the rest of skiboot does */
+static void test_lock_path(void)
+{
+	struct lock l = LOCK_UNLOCKED;
+	struct lock_stats *s = NULL, *cs;
+	uint64_t counts[5];
+	pthread_t thread;
+	unsigned int i;
+	char *out;
+
+	for (i = 0; i <= cpu_max_pir; i++) {
+		test_cpus[i].pir = i;
+		test_cpus[i].state = cpu_state_active;
+		list_head_init(&test_cpus[i].locks_held);
+	}
+	test_cpu = &test_cpus[0];
+	init_locks();
+
+	/* The record is per call site, so the same one each time round */
+	for (i = 0; i < 2; i++) {
+		lock(&l);
+		assert(l.stats && (i == 0 || l.stats == s));
+		s = l.stats;
+		fake_tb += 500 * (i + 1);
+		unlock(&l);
+	}
+	assert(s->lock == &l && s->count == 2 && s->contended == 0);
+	assert(s->max_hold_tb == 1000);
+
+	lock(&l);
+	assert(l.stats != s && l.stats->count == 1);
+	unlock(&l);
+
+	/* try_lock() isn't accounted */
+	assert(try_lock(&l));
+	assert(!l.stats);
+	unlock(&l);
+
+	assert(pthread_create(&thread, NULL, holder, NULL) == 0);
+	while (!__atomic_load_n(&holder_locked, __ATOMIC_SEQ_CST))
+		;
+	lock(&contended);
+	cs = contended.stats;
+	unlock(&contended);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(cs->count == 1 && cs->contended == 1);
+	assert(cs->spin_tb == 1000 && cs->max_spin_tb == 1000);
+
+	out = dump(true);
+	dump_line(out, &l, s->caller, counts);
+	assert(counts[0] == 2 && counts[1] == 0 && counts[4] == 1000);
+	dump_line(out, &contended, cs->caller, counts);
+	assert(counts[0] == 1 && counts[1] == 1 && counts[2] == 1000);
+}
+
+int main(void)
+{
+	struct lock a = LOCK_UNLOCKED, b = LOCK_UNLOCKED;
+	static struct lock many[LOCK_STATS_ENTRIES + 10];
+	struct lock_stats *s;
+	uint64_t counts[5];
+	char *out;
+	int i;
+
+	/* Uncontended, then contended acquisitions */
+	fake_lock(&a, site_a, 0, 10);
+	fake_lock(&a, site_a, 100, 5);
+	fake_lock(&a, site_a, 50, 30);
+	s = lock_stats_find(&a, site_a);
+	assert(s->count == 3);
+	assert(s->contended == 2);
+	assert(s->spin_tb == 150);
+	assert(s->max_spin_tb == 100);
+	assert(s->max_hold_tb == 30);
+
+	/* Same lock from another call site gets its own record */
+	fake_lock(&a, site_b, 1000, 1);
+	assert(lock_stats_find(&a, site_b) != s);
+	assert(lock_stats_find(&a, site_b)->spin_tb == 1000);
+	assert(s->count == 3);
+
+	/* A try_lock() leaves no record to update on release */
+	a.stats = NULL;
+	lock_stats_released(&a, 1000000);
+	assert(s->max_hold_tb == 30);
+
+	/* Most spinning goes first */
+	fake_lock(&b, site_a, 0, 0);
+	out = dump(false);
+	assert(strstr(out, site_b) < strstr(out, site_a));
+	dump_line(out, &a, site_a, counts);
+	assert(counts[0] == 3 && counts[1] == 2 && counts[2] == 150);
+	assert(counts[3] == 100 && counts[4] == 30);
+	dump_line(out, &a, site_b, counts);
+	assert(counts[0] == 1 && counts[1] == 1 && counts[2] == 1000);
+	dump_line(out, &b, site_a, counts);
+	assert(counts[0] == 1 && counts[1] == 0);
+
+	/* Reset clears the counts but not the records */
+	dump(true);
+	assert(lock_stats_find(&a, site_a) == s);
+	assert(s->count == 0 && s->spin_tb == 0 && s->max_hold_tb == 0);
+	out = dump(false);
+	assert(!strstr(out, site_a) && !strstr(out, site_b));
+
+	/* Running out of records only loses the overflow, three are in use */
+	for (i = 0; i < LOCK_STATS_ENTRIES + 10; i++)
+		fake_lock(&many[i], site_a, 1, 1);
+	assert(lock_stats_dropped == 10 + 3);
+	out = dump(true);
+	assert(strstr(out, "13 acquisitions not recorded"));
+	assert(lock_stats_dropped == 0);
+
+	/* Start again from an empty table */
+	memset(lock_stats, 0, sizeof(lock_stats));
+	test_lock_path();
+
+	return 0;
+}
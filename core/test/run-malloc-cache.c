@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ */
+
+#include <config.h>
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#include "dummy-cpu.h"
+
+#include <stdlib.h>
+
+/* Use these before we undefine them below. */
+static inline void *real_malloc(size_t size)
+{
+	return malloc(size);
+}
+
+static inline void real_free(void *p)
+{
+	return free(p);
+}
+
+#include <skiboot.h>
+
+/* We need mem_region to accept __location__ */
+#define is_rodata(p) true
+#include "../malloc.c"
+#include "../mem_region.c"
+#include "../device.c"
+
+#undef malloc
+#undef free
+#undef realloc
+
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <skiboot-valgrind.h>
+
+char __rodata_start[1], __rodata_end[1];
+struct dt_node *dt_root;
+enum proc_chip_quirks proc_chip_quirks;
+
+/*
+ * Real spinlocks this time, counting how often the heap lock is taken
+ * and how often somebody had to spin for it.
+ */
+static unsigned long heap_lock_taken, heap_lock_contended;
+
+void lock_caller(struct lock *l, const char *caller)
+{
+	bool contended = false;
+
+	(void)caller;
+	while (__atomic_exchange_n(&l->lock_val, 1, __ATOMIC_ACQUIRE)) {
+		contended = true;
+		while (__atomic_load_n(&l->lock_val, __ATOMIC_RELAXED))
+			;
+	}
+	if (l == &skiboot_heap.free_list_lock) {
+		heap_lock_taken++;
+		heap_lock_contended += contended;
+	}
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	__atomic_store_n(&l->lock_val, 0, __ATOMIC_RELEASE);
+}
+
+bool lock_held_by_me(struct lock *l)
+{
+	return l->lock_val;
+}
+
+#define THREADS		4
+#define ITERATIONS	((RUNNING_ON_VALGRIND) ? 5000 : 100000)
+#define LIVE_OBJS	16
+
+static struct cpu_thread fake_cpus[THREADS];
+static __thread struct cpu_thread *my_fake_cpu;
+
+struct cpu_thread *this_cpu(void)
+{
+	return my_fake_cpu;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Keep a handful of small objects live, replacing one each iteration */
+static void *worker(void *arg)
+{
+	static const size_t sizes[] = { 16, 24, 48, 64, 100, 128, 200, 256 };
+	void *live[LIVE_OBJS] = { NULL };
+	unsigned int seed = (unsigned long)arg;
+	unsigned int i, slot;
+
+	my_fake_cpu = &fake_cpus[(unsigned long)arg];
+
+	for (i = 0; i < ITERATIONS; i++) {
+		seed = seed * 1103515245 + 12345;
+		slot = (seed >> 16) % LIVE_OBJS;
+
+		__free(live[slot], __location__);
+		live[slot] = __zalloc(sizes[(seed >> 20) % ARRAY_SIZE(sizes)],
+				      __location__);
+		assert(live[slot]);
+	}
+
+	for (i = 0; i < LIVE_OBJS; i++)
+		__free(live[i], __location__);
+
+	return NULL;
+}
+
+static void run(const char *what)
+{
+	pthread_t threads[THREADS];
+	unsigned long i;
+	uint64_t start;
+
+	heap_lock_taken = heap_lock_contended = 0;
+
+	start = now_ns();
+	for (i = 0; i < THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, worker, (void *)i));
+	for (i = 0; i < THREADS; i++)
+		assert(!pthread_join(threads[i], NULL));
+
+	printf("%s: %u threads, %lu heap locks, %lu contended, %llu ms\n",
+	       what, THREADS, heap_lock_taken, heap_lock_contended,
+	       (unsigned long long)(now_ns() - start) / 1000000);
+}
+
+static void drain_caches(void)
+{
+	unsigned int i, c;
+
+	lock(&skiboot_heap.free_list_lock);
+	for (i = 0; i < THREADS; i++) {
+		struct malloc_cache *mc = &fake_cpus[i].malloc_cache;
+
+		for (c = 0; c < MALLOC_CACHE_CLASSES; c++)
+			while (mc->count[c])
+				mem_free(&skiboot_heap,
+					 mc->objs[c][--mc->count[c]],
+					 __location__);
+	}
+}
+
+int main(void)
+{
+	unsigned long uncached_locks;
+	struct alloc_hdr *hdr;
+
+	/* Use malloc for the heap, so valgrind can find issues. */
+	skiboot_heap.start = (unsigned long)real_malloc(skiboot_heap.len);
+
+	run("heap lock only");
+	uncached_locks = heap_lock_taken;
+	assert(uncached_locks == 2 * THREADS * ITERATIONS);
+	assert(mem_check(&skiboot_heap));
+
+	malloc_cache_enable();
+	run("per-cpu caches");
+	assert(mem_check(&skiboot_heap));
+
+	/* Refills and drains are batched, so the lock gets much quieter */
+	assert(heap_lock_taken * MALLOC_CACHE_BATCH / 2 < uncached_locks);
+
+	/* Everything still allocated is sitting in a cache, and says so */
+	for (hdr = region_start(&skiboot_heap); hdr;
+	     hdr = next_hdr(&skiboot_heap, hdr))
+		assert(hdr->free || hdr->location == malloc_cache_location);
+
+	/* Draining the caches gives the heap back in one piece */
+	drain_caches();
+	assert(mem_check(&skiboot_heap));
+	hdr = region_start(&skiboot_heap);
+	assert(hdr->free && hdr->num_longs == skiboot_heap.len / sizeof(long));
+
+	real_free(region_start(&skiboot_heap));
+	return 0;
+}
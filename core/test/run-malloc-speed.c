@@ -63,6 +63,69 @@ bool lock_held_by_me(struct lock *l)
 
 #define NUM_ALLOCS 4096
 
+/* Mixed size phase: how many allocations */
+#define NUM_MIXED	16384
+
+/* Free blocks in the size classes below the one for this many bytes */
+static unsigned int free_blocks_below(size_t bytes)
+{
+	unsigned int bin, n = 0;
+	struct free_hdr *f;
+
+	for (bin = 0; bin < free_bin(bytes / sizeof(long) + ALLOC_HDR_LONGS);
+	     bin++)
+		list_for_each(&skiboot_heap.free_bins[bin], f, list)
+			n++;
+	return n;
+}
+
+/*
+ * Fill the first half of the run with alternating small and larger
+ * allocations, then free the small ones: that leaves thousands of small
+ * free fragments pinned between the larger blocks. They must all sit in
+ * the small size classes, where the larger allocations that follow never
+ * look, so those don't slow down with the number of fragments and don't
+ * split or use any of them.
+ */
+static void test_mixed_sizes(void)
+{
+	static const size_t small[] = { 16, 24 };
+	static const size_t large[] = { 64, 128, 200, 256, 512, 1000 };
+	void **p = real_malloc(sizeof(void *) * NUM_MIXED);
+	unsigned int seed = 1;
+	size_t i, j, size;
+
+	assert(p);
+	assert(free_blocks_below(large[0]) == 0);
+
+	for (i = 0; i < NUM_MIXED; i++) {
+		seed = seed * 1103515245 + 12345;
+		if (i < NUM_MIXED / 2 && !(i & 1))
+			size = small[(seed >> 16) % ARRAY_SIZE(small)];
+		else
+			size = large[(seed >> 16) % ARRAY_SIZE(large)];
+
+		p[i] = __malloc(size, __location__);
+		assert(p[i]);
+
+		if (i == NUM_MIXED / 2) {
+			for (j = 0; j < i; j += 2) {
+				__free(p[j], __location__);
+				p[j] = NULL;
+			}
+			assert(free_blocks_below(large[0]) == NUM_MIXED / 4);
+		}
+	}
+	assert(mem_check(&skiboot_heap));
+	assert(free_blocks_below(large[0]) == NUM_MIXED / 4);
+
+	for (i = 0; i < NUM_MIXED; i++)
+		__free(p[i], __location__);
+	assert(mem_check(&skiboot_heap));
+	assert(free_blocks_below(large[0]) == 0);
+	real_free(p);
+}
+
 int main(void)
 {
 	uint64_t i, len;
@@ -82,6 +145,13 @@ int main(void)
 	}
 	assert(mem_check(&skiboot_heap));
 	assert(skiboot_heap.free_list_lock.lock_val == 0);
+
+	for (i = 0; i < NUM_ALLOCS; i++)
+		__free(p[i], __location__);
+	assert(mem_check(&skiboot_heap));
+
+	test_mixed_sizes();
+	assert(skiboot_heap.free_list_lock.lock_val == 0);
 	free(region_start(&skiboot_heap));
 	real_free(p);
 	return 0;
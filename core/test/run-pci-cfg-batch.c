@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Run OPAL_PCI_CONFIG_BATCH against a PHB of pci-virt devices, and check
+ * it gives the same results, filters included, as single accesses do.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#define zalloc(size) calloc((size), 1)
+
+static inline unsigned long mftb(void)
+{
+	return 0;
+}
+
+/* pci-opal.c prints u64s as %llx, which only suits skiboot's own libc */
+#undef prlog
+#define prlog(l, f, ...) do { (void)(l); } while (0)
+
+#include "../pci-virt.c"
+#include "../pci-opal.c"
+
+unsigned long top_of_ram = ~0UL;
+unsigned long tb_hz = 512000000;
+
+static struct phb test_phb;
+
+struct phb *pci_get_phb(uint64_t phb_id)
+{
+	return phb_id == 0 ? &test_phb : NULL;
+}
+
+/* pci.c isn't linked, so virtual devices are found by walking */
+void pci_bdfn_map_set(struct pci_bdfn_map *map, uint16_t bdfn __unused,
+		      void *dev __unused)
+{
+	map->incomplete = true;
+}
+
+void lock_caller(struct lock *l, const char *caller __unused)
+{
+	assert(!l->lock_val);
+	l->lock_val++;
+}
+
+bool try_lock_caller(struct lock *l, const char *caller __unused)
+{
+	if (l->lock_val)
+		return false;
+	l->lock_val++;
+	return true;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val--;
+}
+
+/* Only the config calls are tested, the rest just has to link */
+int _opal_queue_msg(enum opal_msg_type msg_type __unused,
+		    void *data __unused,
+		    void (*consumed)(void *data, int status) __unused,
+		    size_t params_size __unused, const void *params __unused)
+{
+	return OPAL_SUCCESS;
+}
+
+void opal_update_pending_evt(uint64_t evt_mask __unused,
+			     uint64_t evt_values __unused)
+{
+}
+
+void init_timer(struct timer *t __unused, timer_func_t expiry __unused,
+		void *data __unused)
+{
+}
+
+uint64_t schedule_timer(struct timer *t __unused, uint64_t how_long __unused)
+{
+	return 0;
+}
+
+struct pci_slot *pci_slot_find(uint64_t id __unused)
+{
+	return NULL;
+}
+
+void pci_remove_bus(struct phb *phb __unused, struct list_head *list __unused)
+{
+}
+
+uint8_t pci_scan_bus(struct phb *phb __unused, uint8_t bus __unused,
+		     uint8_t max_bus __unused, struct list_head *list __unused,
+		     struct pci_device *parent __unused,
+		     bool scan_downstream __unused)
+{
+	return 0;
+}
+
+void pci_add_device_nodes(struct phb *phb __unused,
+			  struct list_head *list __unused,
+			  struct dt_node *parent_node __unused,
+			  struct pci_lsi_state *lstate __unused,
+			  uint8_t swizzle __unused)
+{
+}
+
+#define TEST_CFG_READ(size, type)					\
+static int64_t test_cfg_read##size(struct phb *phb, uint32_t bdfn,	\
+				   uint32_t offset, type *data)		\
+{									\
+	uint32_t val;							\
+	int64_t rc;							\
+									\
+	assert(phb->lock.lock_val);					\
+	rc = pci_virt_cfg_read(phb, bdfn, offset, sizeof(*data), &val);\
+	*data = val;							\
+	return rc;							\
+}
+
+#define TEST_CFG_WRITE(size, type)					\
+static int64_t test_cfg_write##size(struct phb *phb, uint32_t bdfn,	\
+				    uint32_t offset, type data)		\
+{									\
+	assert(phb->lock.lock_val);					\
+	return pci_virt_cfg_write(phb, bdfn, offset, sizeof(data), data);\
+}
+
+TEST_CFG_READ(8, uint8_t)
+TEST_CFG_READ(16, uint16_t)
+TEST_CFG_READ(32, uint32_t)
+TEST_CFG_WRITE(8, uint8_t)
+TEST_CFG_WRITE(16, uint16_t)
+TEST_CFG_WRITE(32, uint32_t)
+
+static const struct phb_ops test_phb_ops = {
+	.cfg_read8	= test_cfg_read8,
+	.cfg_read16	= test_cfg_read16,
+	.cfg_read32	= test_cfg_read32,
+	.cfg_write8	= test_cfg_write8,
+	.cfg_write16	= test_cfg_write16,
+	.cfg_write32	= test_cfg_write32,
+};
+
+/* Reads of 0x40 come back doubled, writes to 0x44 are dropped */
+static int64_t test_filter(void *dev __unused,
+			   struct pci_cfg_reg_filter *pcrf __unused,
+			   uint32_t offset, uint32_t len __unused,
+			   uint32_t *data, bool write)
+{
+	if (write)
+		return offset == 0x44 ? OPAL_SUCCESS : OPAL_PARTIAL;
+	if (offset != 0x40)
+		return OPAL_PARTIAL;
+
+	*data = 0x1234 * 2;
+	return OPAL_SUCCESS;
+}
+
+static void set_op(struct opal_pci_cfg_op *op, uint16_t bdfn, uint16_t offset,
+		   uint8_t size, uint8_t flags, uint32_t data)
+{
+	op->bdfn = cpu_to_be16(bdfn);
+	op->offset = cpu_to_be16(offset);
+	op->size = size;
+	op->flags = flags;
+	op->reserved = 0;
+	op->data = cpu_to_be32(data);
+	op->rc = cpu_to_be32(0x5a5a5a5a);
+}
+
+static int64_t op_rc(struct opal_pci_cfg_op *op)
+{
+	return (int32_t)be32_to_cpu(op->rc);
+}
+
+int main(void)
+{
+	static struct opal_pci_cfg_op ops[OPAL_PCI_CFG_BATCH_MAX + 1];
+	struct pci_virt_device *pvd;
+	uint32_t val, i;
+
+	test_phb.ops = &test_phb_ops;
+	list_head_init(&test_phb.virt_devices);
+
+	pvd = pci_virt_add_device(&test_phb, 0x0100, 4096, NULL);
+	assert(pvd);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_VENDOR_ID, 4, 0x04ea1014);
+	PCI_VIRT_CFG_INIT(pvd, 0x40, 4, 0x1234, 0xffffffff, 0);
+	PCI_VIRT_CFG_INIT(pvd, 0x44, 4, 0x5678, 0, 0);
+	for (i = 0x100; i < 0x1000; i += 4)
+		PCI_VIRT_CFG_INIT(pvd, i, 4, i * 3, 0, 0);
+	pci_virt_add_filter(pvd, 0x40, 8, PCI_REG_FLAG_READ |
+			    PCI_REG_FLAG_WRITE, test_filter, NULL);
+
+	/* A mix of sizes, a write, filtered accesses and bad ones */
+	set_op(&ops[0], 0x0100, PCI_CFG_VENDOR_ID, 2, 0, 0);
+	set_op(&ops[1], 0x0100, PCI_CFG_DEVICE_ID, 2, 0, 0);
+	set_op(&ops[2], 0x0100, 0x40, 4, 0, 0);
+	set_op(&ops[3], 0x0100, 0x44, 4, OPAL_PCI_CFG_OP_WRITE, 0xdead);
+	set_op(&ops[4], 0x0100, 0x104, 1, OPAL_PCI_CFG_OP_WRITE, 0xab);
+	set_op(&ops[5], 0x0100, 0x104, 4, 0, 0);
+	set_op(&ops[6], 0x0200, 0x0, 4, 0, 0);
+	set_op(&ops[7], 0x0100, 0x0, 3, 0, 0);
+	set_op(&ops[8], 0x0100, 0x0, 4, 0x80, 0);
+	set_op(&ops[9], 0x0100, 0x44, 4, 0, 0);
+	assert(opal_pci_config_batch(0, ops, 10) == OPAL_SUCCESS);
+	assert(test_phb.lock.lock_val == 0);
+
+	assert(op_rc(&ops[0]) == OPAL_SUCCESS);
+	assert(be32_to_cpu(ops[0].data) == 0x1014);
+	assert(op_rc(&ops[1]) == OPAL_SUCCESS);
+	assert(be32_to_cpu(ops[1].data) == 0x04ea);
+	assert(op_rc(&ops[2]) == OPAL_SUCCESS);
+	assert(be32_to_cpu(ops[2].data) == 0x1234 * 2);
+	assert(op_rc(&ops[3]) == OPAL_SUCCESS);
+	assert(op_rc(&ops[4]) == OPAL_SUCCESS);
+	assert(op_rc(&ops[5]) == OPAL_SUCCESS);
+	assert(be32_to_cpu(ops[5].data) == (((0x104 * 3) & ~0xff) | 0xab));
+	assert(op_rc(&ops[6]) == OPAL_PARAMETER);
+	assert(op_rc(&ops[7]) == OPAL_PARAMETER);
+	assert(op_rc(&ops[8]) == OPAL_PARAMETER);
+	assert(op_rc(&ops[9]) == OPAL_SUCCESS);
+	assert(be32_to_cpu(ops[9].data) == 0x5678);
+
+	/* Same again one at a time */
+	assert(opal_pci_config_read_word(0, 0x0100, 0x40, &val) ==
+	       OPAL_SUCCESS);
+	assert(val == 0x1234 * 2);
+	assert(opal_pci_config_read_word(0, 0x0100, 0x104, &val) ==
+	       OPAL_SUCCESS);
+	assert(val == be32_to_cpu(ops[5].data));
+
+	/* The whole extended config space in one call */
+	for (i = 0; i < 1024; i++)
+		set_op(&ops[i], 0x0100, i * 4, 4, 0, 0);
+	assert(opal_pci_config_batch(0, ops, 1024) == OPAL_SUCCESS);
+	for (i = 0x100 / 4; i < 1024; i++) {
+		assert(op_rc(&ops[i]) == OPAL_SUCCESS);
+		if (i != 0x104 / 4)
+			assert(be32_to_cpu(ops[i].data) == i * 4 * 3);
+	}
+
+	/* Bad calls don't touch anything */
+	ops[0].rc = cpu_to_be32(0x5a5a5a5a);
+	assert(opal_pci_config_batch(1, ops, 1) == OPAL_PARAMETER);
+	assert(opal_pci_config_batch(0, ops, 0) == OPAL_PARAMETER);
+	assert(opal_pci_config_batch(0, ops, OPAL_PCI_CFG_BATCH_MAX + 1) ==
+	       OPAL_PARAMETER);
+	assert(opal_pci_config_batch(0, (void *)0x8000000000000000ul, 1) ==
+	       OPAL_PARAMETER);
+	assert(be32_to_cpu(ops[0].rc) == 0x5a5a5a5a);
+
+	return 0;
+}
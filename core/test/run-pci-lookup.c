@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Scan a PHB of pci-virt devices and check pci_find_dev() stops finding
+ * them once pci_remove_bus() or pci_reset() has freed them, and that the
+ * capability cache answers lookups without config reads until it's
+ * invalidated, and isn't built from all-ones.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define __TEST__
+#include <skiboot.h>
+
+#define zalloc(size) calloc((size), 1)
+
+/* Override this for testing. */
+#define is_rodata(p) fake_is_rodata(p)
+
+char __rodata_start[16];
+#define __rodata_end (__rodata_start + sizeof(__rodata_start))
+
+static inline bool fake_is_rodata(const void *p)
+{
+	return ((char *)p >= __rodata_start && (char *)p < __rodata_end);
+}
+
+static inline unsigned long mftb(void)
+{
+	return 0;
+}
+
+static inline int ilog2(unsigned long val)
+{
+	return 63 - __builtin_clzl(val);
+}
+
+/* pci.c prints 64-bit values as %llx, which only suits skiboot's libc */
+#undef prlog
+#define prlog(l, f, ...) test_prlog(l, f, ##__VA_ARGS__)
+
+static inline void test_prlog(int l __unused, const char *fmt __unused, ...)
+{
+}
+
+#include "../pci-virt.c"
+#include "../pci.c"
+#include "../device.c"
+
+/* Only the device lookups are tested, the rest just has to link */
+struct platform platform;
+unsigned long tb_hz = 512000000;
+
+void time_wait(unsigned long duration __unused)
+{
+}
+
+void time_wait_ms(unsigned long ms __unused)
+{
+}
+
+void check_timers(bool from_interrupt __unused)
+{
+}
+
+void pci_handle_quirk(struct phb *phb __unused, struct pci_device *pd __unused)
+{
+}
+
+void pci_slot_add_dt_properties(struct pci_slot *slot __unused,
+				struct dt_node *np __unused)
+{
+}
+
+/* Set when the devices have gone away, reads then come back all-ones */
+static bool test_gone;
+static unsigned long test_reads;
+
+#define TEST_CFG_READ(size, type)					\
+static int64_t test_cfg_read##size(struct phb *phb, uint32_t bdfn,	\
+				   uint32_t offset, type *data)		\
+{									\
+	uint32_t val;							\
+	int64_t rc;							\
+									\
+	test_reads++;							\
+	if (test_gone) {						\
+		*data = (type)~0u;					\
+		return OPAL_SUCCESS;					\
+	}								\
+	rc = pci_virt_cfg_read(phb, bdfn, offset, sizeof(*data), &val);	\
+	*data = val;							\
+	return rc;							\
+}
+
+#define TEST_CFG_WRITE(size, type)					\
+static int64_t test_cfg_write##size(struct phb *phb, uint32_t bdfn,	\
+				    uint32_t offset, type data)		\
+{									\
+	return pci_virt_cfg_write(phb, bdfn, offset, sizeof(data), data);\
+}
+
+TEST_CFG_READ(8, uint8_t)
+TEST_CFG_READ(16, uint16_t)
+TEST_CFG_READ(32, uint32_t)
+TEST_CFG_WRITE(8, uint8_t)
+TEST_CFG_WRITE(16, uint16_t)
+TEST_CFG_WRITE(32, uint32_t)
+
+static int64_t test_freeze_status(struct phb *phb __unused,
+				  uint64_t pe_number __unused,
+				  uint8_t *freeze_state,
+				  uint16_t *pci_error_type __unused,
+				  uint16_t *severity __unused)
+{
+	*freeze_state = OPAL_EEH_STOPPED_NOT_FROZEN;
+	return OPAL_SUCCESS;
+}
+
+static int64_t test_reserved_pe(struct phb *phb __unused)
+{
+	return 0;
+}
+
+static const struct phb_ops test_phb_ops = {
+	.cfg_read8		= test_cfg_read8,
+	.cfg_read16		= test_cfg_read16,
+	.cfg_read32		= test_cfg_read32,
+	.cfg_write8		= test_cfg_write8,
+	.cfg_write16		= test_cfg_write16,
+	.cfg_write32		= test_cfg_write32,
+	.eeh_freeze_status	= test_freeze_status,
+	.get_reserved_pe_number	= test_reserved_pe,
+};
+
+static struct phb test_phb;
+
+#define NR_DEVS	4
+
+static void add_devices(void)
+{
+	struct pci_virt_device *pvd;
+	int i;
+
+	for (i = 0; i < NR_DEVS; i++) {
+		pvd = pci_virt_add_device(&test_phb, i << 3, 4096, NULL);
+		assert(pvd);
+		PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_VENDOR_ID, 4,
+				     0x04ea1014 + i);
+		PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_REV_ID, 4, 0x02000000);
+	}
+
+	/* The first one is PCIe: PM then EXP, and AER then vendor (0xb) */
+	pvd = pci_virt_find_device(&test_phb, 0);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_CMD, 4, PCI_CFG_STAT_CAP << 16);
+	PCI_VIRT_CFG_INIT_RO(pvd, PCI_CFG_CAP, 1, 0x40);
+	PCI_VIRT_CFG_INIT_RO(pvd, 0x40, 2, 0x5000 | PCI_CFG_CAP_ID_PM);
+	PCI_VIRT_CFG_INIT_RO(pvd, 0x50, 2, PCI_CFG_CAP_ID_EXP);
+	PCI_VIRT_CFG_INIT_RO(pvd, 0x100, 4, 0x14010000 | PCIECAP_ID_AER);
+	PCI_VIRT_CFG_INIT_RO(pvd, 0x140, 4, 0x0001000b);
+}
+
+static void scan(void)
+{
+	pci_scan_bus(&test_phb, 0, 0, &test_phb.devices, NULL, false);
+	pci_add_device_nodes(&test_phb, &test_phb.devices, test_phb.dt_node,
+			     &test_phb.lstate, 0);
+}
+
+static void check_found(void)
+{
+	struct pci_device *pd;
+	int i;
+
+	for (i = 0; i < NR_DEVS; i++) {
+		pd = pci_find_dev(&test_phb, i << 3);
+		assert(pd && pd->bdfn == i << 3);
+		assert(pd->vdid == 0x04ea1014u + i);
+	}
+	assert(!pci_find_dev(&test_phb, NR_DEVS << 3));
+}
+
+static void check_gone(void)
+{
+	int i;
+
+	for (i = 0; i <= NR_DEVS; i++)
+		assert(!pci_find_dev(&test_phb, i << 3));
+}
+
+static void check_cap_cache(void)
+{
+	struct pci_virt_device *pvd = pci_virt_find_device(&test_phb, 0);
+	struct pci_device *pd = pci_find_dev(&test_phb, 0);
+	unsigned long reads;
+	uint8_t version = 0;
+
+	/* Built by the scan, lookups don't touch config space */
+	assert(pd->cap_cache);
+	reads = test_reads;
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_PM) == 0x40);
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_EXP) == 0x50);
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_VENDOR) ==
+	       OPAL_UNSUPPORTED);
+	assert(pci_find_ecap(&test_phb, 0, PCIECAP_ID_AER, NULL) == 0x100);
+	assert(pci_find_ecap(&test_phb, 0, 0x000b, &version) == 0x140);
+	assert(version == 1);
+	assert(pci_find_ecap(&test_phb, 0, 0x0002, NULL) == OPAL_UNSUPPORTED);
+	assert(test_reads == reads);
+
+	/* Not PCIe: standard ones are cached, extended ones still walk */
+	assert(pci_find_cap(&test_phb, 1 << 3, PCI_CFG_CAP_ID_EXP) ==
+	       OPAL_UNSUPPORTED);
+	assert(test_reads == reads);
+	assert(pci_find_ecap(&test_phb, 1 << 3, PCIECAP_ID_AER, NULL) ==
+	       OPAL_UNSUPPORTED);
+	assert(test_reads > reads);
+
+	/* Stale until invalidated, then read again */
+	PCI_VIRT_CFG_INIT_RO(pvd, 0x40, 2, PCI_CFG_CAP_ID_PM);
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_EXP) == 0x50);
+	pci_cap_cache_invalidate(pd);
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_EXP) ==
+	       OPAL_UNSUPPORTED);
+	assert(pd->cap_cache);
+	PCI_VIRT_CFG_INIT_RO(pvd, 0x40, 2, 0x5000 | PCI_CFG_CAP_ID_PM);
+	pci_cap_cache_invalidate(pd);
+
+	/* All-ones isn't cached, lookups walk until the device is back */
+	test_gone = true;
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_EXP) ==
+	       OPAL_UNSUPPORTED);
+	assert(pci_find_ecap(&test_phb, 0, PCIECAP_ID_AER, NULL) ==
+	       OPAL_UNSUPPORTED);
+	assert(!pd->cap_cache);
+	test_gone = false;
+	assert(pci_find_cap(&test_phb, 0, PCI_CFG_CAP_ID_EXP) == 0x50);
+	assert(pci_find_ecap(&test_phb, 0, 0x000b, NULL) == 0x140);
+	assert(pd->cap_cache);
+}
+
+int main(void)
+{
+	dt_root = dt_new_root("");
+
+	test_phb.ops = &test_phb_ops;
+	test_phb.dt_node = dt_new(dt_root, "pciex@0");
+	test_phb.scan_map = 0xffffffff;
+	list_head_init(&test_phb.devices);
+	list_head_init(&test_phb.virt_devices);
+	init_lock(&test_phb.lock);
+	phbs[0] = &test_phb;
+
+	add_devices();
+	scan();
+	check_found();
+	assert(!test_phb.dev_map.incomplete);
+	check_cap_cache();
+
+	pci_remove_bus(&test_phb, &test_phb.devices);
+	assert(list_empty(&test_phb.devices));
+	check_gone();
+
+	/* Found again by a rescan, then lost when a reset finds nothing */
+	scan();
+	check_found();
+	test_gone = true;
+	assert(pci_reset() == 0);
+	assert(list_empty(&test_phb.devices));
+	check_gone();
+
+	/* A reset that finds them again makes them visible again */
+	test_gone = false;
+	assert(pci_reset() == 0);
+	check_found();
+
+	dt_free(dt_root);
+	return 0;
+}
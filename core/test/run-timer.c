@@ -6,6 +6,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+
+#include <skiboot-valgrind.h>
 
 #define __TEST__
 #include <timer.h>
@@ -66,6 +69,84 @@ void p9_sbe_update_timer_expiry(uint64_t new_target)
 	(void)new_target;
 }
 
+/*
+ * Lots of timers, to check the ordering holds up with cancels and
+ * reschedules in the mix, and to see what schedule/cancel cost.
+ */
+#define NUM_BENCH_TIMERS	((RUNNING_ON_VALGRIND) ? 2000 : 50000)
+
+static struct timer *bench_timers;
+static uint64_t bench_last;
+static unsigned int bench_fired;
+
+static void bench_expiry(struct timer *t, void *data, uint64_t now)
+{
+	(void)now;
+	assert(!data);		/* Cancelled ones are marked */
+	assert(t->target >= bench_last);
+	bench_last = t->target;
+	bench_fired++;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_report(const char *what, unsigned int n, uint64_t start)
+{
+	printf("%-12s %6u timers, %6llu ns/timer\n", what, n,
+	       (unsigned long long)(now_ns() - start) / n);
+}
+
+static void test_many_timers(void)
+{
+	unsigned int i, n = NUM_BENCH_TIMERS;
+	uint64_t start;
+
+	bench_timers = calloc(n, sizeof(*bench_timers));
+	assert(bench_timers);
+	stamp = 0;
+
+	start = now_ns();
+	for (i = 0; i < n; i++) {
+		init_timer(&bench_timers[i], bench_expiry, NULL);
+		schedule_timer(&bench_timers[i], random() % (n * 16));
+	}
+	bench_report("schedule", n, start);
+
+	/* Cancel every other one */
+	start = now_ns();
+	for (i = 0; i < n; i += 2) {
+		cancel_timer(&bench_timers[i]);
+		bench_timers[i].user_data = (void *)1;
+	}
+	bench_report("cancel", n / 2, start);
+
+	/* Move the rest about */
+	start = now_ns();
+	for (i = 1; i < n; i += 2)
+		schedule_timer(&bench_timers[i], random() % (n * 16));
+	bench_report("reschedule", n / 2, start);
+
+	/* Cancelling twice, or something not scheduled, is harmless */
+	cancel_timer(&bench_timers[0]);
+	cancel_timer_async(&bench_timers[2]);
+
+	/* Run them all, in order */
+	start = now_ns();
+	stamp = n * 16;
+	check_timers(false);
+	bench_report("expire", n / 2, start);
+	assert(bench_fired == n / 2);
+	assert(!timer_heap);
+
+	free(bench_timers);
+}
+
 int main(void)
 {
 	unsigned int i;
@@ -80,5 +161,7 @@ int main(void)
 		check_timers(false);
 		stamp++;
 	}
+
+	test_many_timers();
 	return 0;
 }
@@ -14,6 +14,8 @@
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <signal.h>
 
 #include <skiboot-valgrind.h>
 
@@ -38,6 +40,17 @@ static inline void lwsync(void)
 #error "Define lwsync for this arch"
 #endif
 
+#define __TEST__
+static inline uint32_t __cmpxchg32(uint32_t *mem, uint32_t old, uint32_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
+static inline uint64_t __cmpxchg64(uint64_t *mem, uint64_t old, uint64_t new)
+{
+	return __sync_val_compare_and_swap(mem, old, new);
+}
+
 #define zalloc(size) calloc((size), 1)
 
 struct cpu_thread {
@@ -102,19 +115,6 @@ struct debug_descriptor debug_descriptor = {
 	.trace_mask = -1
 };
 
-void lock_caller(struct lock *l, const char *caller)
-{
-	(void)caller;
-	assert(!l->lock_val);
-	l->lock_val = 1;
-}
-
-void unlock(struct lock *l)
-{
-	assert(l->lock_val);
-	l->lock_val = 0;
-}
-
 struct cpu_thread *my_fake_cpu;
 static struct cpu_thread *this_cpu(void)
 {
@@ -252,6 +252,168 @@ static void test_parallel(void)
 	 */
 }
 
+/*
+ * Now all the writers share a single, small buffer, as the threads of a
+ * core do, and a timer signal stands in for an HMI re-entering
+ * trace_add() half way through. Each record carries a payload derived
+ * from its sequence number, so the reader can tell a torn one.
+ */
+#define SHARED_TRACES ((RUNNING_ON_VALGRIND) ? (1024*16) : (1024*256))
+#define SHARED_BUF_SZ 262144
+#define TYPE_NESTED 0x60
+#define TYPE_DONE 0x70
+
+static void fill_payload(union trace *t, u64 seq, u64 cpu)
+{
+	unsigned int i;
+
+	t->opal.token = cpu_to_be64(seq);
+	t->opal.lr = cpu_to_be64(cpu);
+	for (i = 0; i < 9; i++)
+		t->opal.r3_to_11[i] = cpu_to_be64(seq * 31 + cpu * 7 + i);
+}
+
+static u64 check_payload(const union trace *t)
+{
+	u64 seq = be64_to_cpu(t->opal.token);
+	u64 cpu = be64_to_cpu(t->opal.lr);
+	unsigned int i;
+
+	assert(t->hdr.len_div_8 * 8 == sizeof(t->opal));
+	assert(cpu == be16_to_cpu(t->hdr.cpu));
+	for (i = 0; i < 9; i++)
+		assert(be64_to_cpu(t->opal.r3_to_11[i]) == seq * 31 + cpu * 7 + i);
+	return seq;
+}
+
+static u64 nested_seq, *nested_written;
+
+static void nested_writer(int sig)
+{
+	union trace t;
+
+	(void)sig;
+	fill_payload(&t, nested_seq++, my_fake_cpu->server_no);
+	trace_add(&t, TYPE_NESTED, sizeof(t.opal));
+}
+
+static void write_shared_entries(int id)
+{
+	struct itimerval it = { { 0, 50 }, { 0, 50 } };
+	union trace trace;
+	unsigned int i;
+
+	signal(SIGPROF, nested_writer);
+	setitimer(ITIMER_PROF, &it, NULL);
+
+	for (i = 0; i < SHARED_TRACES; i++) {
+		fill_payload(&trace, i, id);
+		trace_add(&trace, 3 + (i % 0x40), sizeof(trace.opal));
+	}
+
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_PROF, &it, NULL);
+	nested_written[id] = nested_seq;
+
+	/* Final entry has special type, so parent knows it's over. */
+	fill_payload(&trace, i, id);
+	trace_add(&trace, TYPE_DONE, sizeof(trace.opal));
+	exit(0);
+}
+
+static void test_shared(void)
+{
+	size_t len = sizeof(struct trace_info) + TBUF_SZ + sizeof(union trace);
+	u64 next_seq[CPUS] = { 0 }, next_nested[CPUS] = { 0 };
+	unsigned int i, cpu, nested = 0, missed = 0, alive = CPUS;
+	u64 read_bytes = 0, missed_bytes = 0, total_nested = 0;
+	struct trace_reader tr;
+	bool done[CPUS] = { false };
+	struct trace_info *ti;
+	union trace t;
+	int status;
+	u64 seq;
+
+	ti = mmap(NULL, len + CPUS * sizeof(u64), PROT_READ|PROT_WRITE,
+		  MAP_ANONYMOUS|MAP_SHARED, -1, 0);
+	assert(ti != MAP_FAILED);
+	nested_written = (void *)ti + len;
+	ti->tb.buf_size = cpu_to_be64(SHARED_BUF_SZ);
+	ti->tb.max_size = cpu_to_be32(sizeof(union trace));
+	memset(&tr, 0, sizeof(tr));
+	tr.tb = &ti->tb;
+
+	fflush(stdout);
+	for (i = 0; i < CPUS; i++) {
+		fake_cpus[i].trace = ti;
+		if (!fork()) {
+			my_fake_cpu = &fake_cpus[i];
+			write_shared_entries(i);
+		}
+	}
+
+	/* The last few records may be overwritten, so wait for the writers */
+	for (;;) {
+		if (!trace_get(&t, &tr)) {
+			if (!alive)
+				break;
+			if (waitpid(-1, &status, WNOHANG) > 0) {
+				assert(WIFEXITED(status) && !WEXITSTATUS(status));
+				alive--;
+			} else
+				sched_yield();
+			continue;
+		}
+
+		if (t.hdr.type == TRACE_OVERFLOW) {
+			missed_bytes += be64_to_cpu(t.overflow.bytes_missed);
+			missed++;
+			continue;
+		}
+		read_bytes += t.hdr.len_div_8 * 8;
+
+		/* Every record is unique, so never a repeat */
+		assert(t.hdr.type != TRACE_REPEAT);
+		cpu = be16_to_cpu(t.hdr.cpu);
+		assert(cpu < CPUS);
+		assert(!done[cpu]);
+		seq = check_payload(&t);
+
+		/* Each writer's records come out in the order it wrote them */
+		if (t.hdr.type == TYPE_NESTED) {
+			assert(seq >= next_nested[cpu]);
+			next_nested[cpu] = seq + 1;
+			nested++;
+		} else {
+			assert(seq >= next_seq[cpu]);
+			next_seq[cpu] = seq + 1;
+			if (t.hdr.type == TYPE_DONE) {
+				assert(seq == SHARED_TRACES);
+				done[cpu] = true;
+			} else
+				assert(t.hdr.type == 3 + (seq % 0x40));
+		}
+	}
+
+	for (i = 0; i < CPUS; i++) {
+		assert(done[i] || missed);
+		total_nested += nested_written[i];
+	}
+
+	printf("Shared: %llu bytes read, %llu missed in %u overflows, "
+	       "%u of %llu nested\n", (long long)read_bytes,
+	       (long long)missed_bytes, missed, nested,
+	       (long long)total_nested);
+
+	/* Everyone's finished, and all of it was either read or overwritten */
+	assert(reserve_pos(ti->reserve) == be64_to_cpu(ti->tb.end));
+	assert(!(ti->reserve & TRACE_WRITERS_MASK));
+	assert(read_bytes + missed_bytes == be64_to_cpu(ti->tb.end));
+	assert(trace_empty(&tr));
+
+	munmap(ti, len + CPUS * sizeof(u64));
+}
+
 int main(void)
 {
 	union trace minimal;
@@ -387,6 +549,7 @@ int main(void)
 			free(fake_cpus[i].trace);
 
 	test_parallel();
+	test_shared();
 
 	return 0;
 }
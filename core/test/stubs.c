@@ -8,8 +8,11 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
 
 #include <compiler.h>
+#include <lock.h>
 #include "../../ccan/list/list.c"
 
 void _prlog(int log_level __attribute__((unused)), const char* fmt, ...) __attribute__((format (printf, 2, 3)));
@@ -28,6 +31,37 @@ void _prlog(int log_level __attribute__((unused)), const char* fmt, ...)
         va_end(ap);
 }
 
+/*
+ * Tests are single threaded, so locks only need to be taken and dropped
+ * in pairs. Tests with their own locking override these.
+ */
+void __attribute__((weak)) lock_caller(struct lock *l, const char *caller)
+{
+	(void)caller;
+	assert(!l->lock_val);
+	l->lock_val++;
+}
+
+bool __attribute__((weak)) try_lock_caller(struct lock *l, const char *caller)
+{
+	(void)caller;
+	if (l->lock_val)
+		return false;
+	l->lock_val++;
+	return true;
+}
+
+void __attribute__((weak)) unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val--;
+}
+
+void __attribute__((weak)) drop_my_locks(bool warn)
+{
+	(void)warn;
+}
+
 /* Add any stub functions required for linking here. */
 static void stub_function(void)
 {
@@ -46,36 +80,100 @@ void cpu_process_local_jobs(void);
 struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 				       const char *name,
 				       void (*func)(void *data), void *data);
+uint8_t get_available_nr_cores_in_chip(uint32_t chip_id);
+struct cpu_job_group *cpu_job_group_alloc(void);
+bool cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id,
+		       const char *name,
+		       void (*func)(void *data), void *data);
+void cpu_job_group_submit(struct cpu_job_group *grp);
+unsigned long cpu_job_group_wait(struct cpu_job_group *grp);
 
-struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
-				       const char *name,
-				       void (*func)(void *data), void *data)
+struct cpu_job * __attribute__((weak))
+cpu_queue_job_on_node(uint32_t chip_id, const char *name,
+		      void (*func)(void *data), void *data)
 {
 	(void)chip_id;
 	return __cpu_queue_job(NULL, name, func, data, false);
 }
 
-struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
-				const char *name,
-				void (*func)(void *data), void *data,
-				bool no_return)
+/*
+ * Jobs can't be scheduled anywhere, so like cpu.c they're run right away.
+ * Tests of cpu.c itself override these.
+ */
+struct cpu_job {
+	bool complete;
+};
+
+struct cpu_job * __attribute__((weak))
+__cpu_queue_job(struct cpu_thread *cpu, const char *name,
+		void (*func)(void *data), void *data, bool no_return)
 {
+	struct cpu_job *job;
+
 	(void)cpu;
 	(void)name;
-	(func)(data);
 	(void)no_return;
-	return NULL;
+
+	job = calloc(1, sizeof(struct cpu_job));
+	if (!job)
+		return NULL;
+	(func)(data);
+	job->complete = true;
+
+	return job;
+}
+
+void __attribute__((weak)) cpu_wait_job(struct cpu_job *job, bool free_it)
+{
+	if (!job)
+		return;
+	assert(job->complete);
+	if (free_it)
+		free(job);
+}
+
+void __attribute__((weak)) cpu_process_local_jobs(void)
+{
+}
+
+uint8_t __attrconst __attribute__((weak))
+get_available_nr_cores_in_chip(uint32_t chip_id)
+{
+	(void)chip_id;
+	return 1;
+}
+
+/* Jobs run as they're added, so there's never anything to wait for */
+struct cpu_job_group {
+	int unused;
+};
+
+struct cpu_job_group * __attribute__((weak)) cpu_job_group_alloc(void)
+{
+	return calloc(1, sizeof(struct cpu_job_group));
+}
+
+bool __attribute__((weak))
+cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id, const char *name,
+		  void (*func)(void *data), void *data)
+{
+	(void)grp;
+	(void)chip_id;
+	(void)name;
+	(func)(data);
+	return true;
 }
 
-void cpu_wait_job(struct cpu_job *job, bool free_it)
+void __attribute__((weak)) cpu_job_group_submit(struct cpu_job_group *grp)
 {
-	(void)job;
-	(void)free_it;
-	return;
+	(void)grp;
 }
 
-void cpu_process_local_jobs(void)
+unsigned long __attribute__((weak))
+cpu_job_group_wait(struct cpu_job_group *grp)
 {
+	free(grp);
+	return 0;
 }
 
 #define STUB(fnname) \
@@ -99,3 +197,62 @@ STUB(dt_has_node_property);
 STUB(dt_get_address);
 STUB(add_chip_dev_associativity);
 STUB(pci_check_clear_freeze);
+STUB(this_cpu);
+STUB(dt_new);
+STUB(dt_new_addr);
+STUB(dt_add_property);
+STUB(dt_add_property_string);
+STUB(__dt_add_property_cells);
+STUB(__dt_add_property_strings);
+STUB(dt_get_path);
+STUB(_opal_queue_msg);
+STUB(nvram_read_complete);
+STUB(time_wait_ms);
+STUB(secureboot_verify);
+STUB(stb_is_container);
+STUB(stb_sw_payload_size);
+STUB(trustedboot_measure);
+STUB(trustedboot_measure_digest);
+STUB(trustedboot_measuring);
+STUB(hashed_read_init);
+STUB(hashed_read);
+STUB(hashed_read_finish);
+STUB(xz_crc32_init);
+STUB(xz_dec_init);
+STUB(xz_dec_run);
+STUB(xz_dec_end);
+STUB(xz_dec_block);
+STUB(xz_dec_index);
+STUB(__dt_find_property);
+STUB(__secondary_cpu_entry);
+STUB(__trigger_attn);
+STUB(_xscom_write);
+STUB(add_core_associativity);
+STUB(cleanup_global_tlb);
+STUB(dt_del_property);
+STUB(dt_find_by_path);
+STUB(dt_find_compatible_node);
+STUB(dt_find_compatible_node_on_chip);
+STUB(dt_find_property);
+STUB(dt_free);
+STUB(dt_get_chip_id);
+STUB(dt_prop_get);
+STUB(dt_prop_get_u32);
+STUB(dt_prop_get_u32_def);
+STUB(dt_property_get_cell);
+STUB(enable_machine_check);
+STUB(enter_p8_pm_state);
+STUB(enter_p9_pm_lite_state);
+STUB(enter_p9_pm_state);
+STUB(exception_entry_pm_mce);
+STUB(exception_entry_pm_sreset);
+STUB(icp_kick_cpu);
+STUB(icp_prep_for_pm);
+STUB(init_boot_tracebuf);
+STUB(malloc_cache_enable);
+STUB(memcpy_enable_vsx);
+STUB(op_display);
+STUB(pir_to_core_id);
+STUB(reset_cpu_icp);
+STUB(slw_reinit);
+STUB(start_kernel_secondary);
@@ -29,7 +29,7 @@
 #define HEARTBEAT_DEFAULT_MS	200
 
 static struct lock timer_lock = LOCK_UNLOCKED;
-static LIST_HEAD(timer_list);
+static struct timer *timer_heap;
 static LIST_HEAD(timer_poll_list);
 static bool timer_in_poll;
 static uint64_t timer_poll_gen;
@@ -45,16 +45,120 @@ static inline void update_timer_expiry(uint64_t target)
 void init_timer(struct timer *t, timer_func_t expiry, void *data)
 {
 	t->link.next = t->link.prev = NULL;
+	t->child = t->next = t->prev = NULL;
 	t->target = 0;
 	t->expiry = expiry;
 	t->user_data = data;
 	t->running = NULL;
 }
 
+/*
+ * Real timers are kept in a pairing heap ordered by target, so the next
+ * one to expire is always at the top, inserting is O(1) and removing
+ * is O(log n) amortised. Each node points to its first child, the next
+ * sibling, and either its previous sibling or, for a first child, its
+ * parent. The top has no prev, which is how we tell it's queued.
+ */
+static struct timer *heap_meld(struct timer *a, struct timer *b)
+{
+	struct timer *tmp;
+
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	if (b->target < a->target) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	/* b becomes the first child of a */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+
+	return a;
+}
+
+/* Meld a list of siblings into one heap, the usual two-pass way */
+static struct timer *heap_merge_pairs(struct timer *first)
+{
+	struct timer *a, *b, *next, *pairs = NULL, *heap = NULL;
+
+	/* Meld them in pairs left to right, stacking the results */
+	while (first) {
+		a = first;
+		b = a->next;
+		next = b ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b) {
+			b->next = b->prev = NULL;
+			a = heap_meld(a, b);
+		}
+		a->next = pairs;
+		pairs = a;
+		first = next;
+	}
+
+	/* Then meld the stack of pairs right to left */
+	while (pairs) {
+		next = pairs->next;
+		pairs->next = NULL;
+		heap = heap_meld(heap, pairs);
+		pairs = next;
+	}
+
+	return heap;
+}
+
+static void heap_insert(struct timer *t)
+{
+	t->child = t->next = t->prev = NULL;
+	timer_heap = heap_meld(timer_heap, t);
+}
+
+static void heap_remove(struct timer *t)
+{
+	struct timer *sub;
+
+	if (t != timer_heap) {
+		/* Unlink from our parent or previous sibling */
+		if (t->prev->child == t)
+			t->prev->child = t->next;
+		else
+			t->prev->next = t->next;
+		if (t->next)
+			t->next->prev = t->prev;
+	}
+
+	sub = heap_merge_pairs(t->child);
+	if (t == timer_heap)
+		timer_heap = sub;
+	else
+		timer_heap = heap_meld(timer_heap, sub);
+	if (timer_heap)
+		timer_heap->prev = NULL;
+
+	t->child = t->next = t->prev = NULL;
+}
+
+static bool timer_queued(struct timer *t)
+{
+	if (t->target == TIMER_POLL)
+		return t->link.next != NULL;
+	return t == timer_heap || t->prev;
+}
+
 static void __remove_timer(struct timer *t)
 {
-	list_del(&t->link);
-	t->link.next = t->link.prev = NULL;
+	if (t->target == TIMER_POLL) {
+		list_del(&t->link);
+		t->link.next = t->link.prev = NULL;
+	} else
+		heap_remove(t);
 }
 
 static void __sync_timer(struct timer *t)
@@ -86,7 +190,7 @@ void cancel_timer(struct timer *t)
 {
 	lock(&timer_lock);
 	__sync_timer(t);
-	if (t->link.next)
+	if (timer_queued(t))
 		__remove_timer(t);
 	unlock(&timer_lock);
 }
@@ -94,17 +198,15 @@ void cancel_timer(struct timer *t)
 void cancel_timer_async(struct timer *t)
 {
 	lock(&timer_lock);
-	if (t->link.next)
+	if (timer_queued(t))
 		__remove_timer(t);
 	unlock(&timer_lock);
 }
 
 static void __schedule_timer_at(struct timer *t, uint64_t when)
 {
-	struct timer *lt;
-
 	/* If the timer is already scheduled, take it out */
-	if (t->link.next)
+	if (timer_queued(t))
 		__remove_timer(t);
 
 	/* Update target */
@@ -115,23 +217,13 @@ static void __schedule_timer_at(struct timer *t, uint64_t when)
 		t->gen = timer_poll_gen;
 		list_add_tail(&timer_poll_list, &t->link);
 	} else {
-		/* It's a real timer, add it in the right spot in the
-		 * ordered timer list
-		 */
-		list_for_each(&timer_list, lt, link) {
-			if (when >= lt->target)
-				continue;
-			list_add_before(&timer_list, &t->link, &lt->link);
-			goto bail;
-		}
-		list_add_tail(&timer_list, &t->link);
+		/* It's a real timer, add it to the heap */
+		heap_insert(t);
 	}
- bail:
+
 	/* Pick up the next timer and upddate the SBE HW timer */
-	lt = list_top(&timer_list, struct timer, link);
-	if (lt) {
-		update_timer_expiry(lt->target);
-	}
+	if (timer_heap)
+		update_timer_expiry(timer_heap->target);
 }
 
 void schedule_timer_at(struct timer *t, uint64_t when)
@@ -212,7 +304,7 @@ static void __check_timers(uint64_t now)
 	struct timer *t;
 
 	for (;;) {
-		t = list_top(&timer_list, struct timer, link);
+		t = timer_heap;
 
 		/* Top of list not expired ? that's it ... */
 		if (!t || t->target > now)
@@ -255,8 +347,7 @@ void check_timers(bool from_interrupt)
 	/* Lockless "peek", a bit racy but shouldn't be a problem as
 	 * we are only looking at whether the list is empty
 	 */
-	if (list_empty_nocheck(&timer_poll_list) &&
-	    list_empty_nocheck(&timer_list))
+	if (list_empty_nocheck(&timer_poll_list) && !timer_heap)
 		return;
 
 	/* Take lock and try again */
@@ -7,7 +7,6 @@
 
 #include <trace.h>
 #include <timebase.h>
-#include <lock.h>
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
@@ -15,6 +14,7 @@
 #include <device.h>
 #include <libfdt.h>
 #include <processor.h>
+#include <cmpxchg.h>
 #include <skiboot.h>
 #include <opal-api.h>
 #include <debug_descriptor.h>
@@ -32,7 +32,9 @@ static struct {
 
 void init_boot_tracebuf(struct cpu_thread *boot_cpu)
 {
-	init_lock(&boot_tracebuf.trace_info.lock);
+	BUILD_ASSERT(offsetof(struct trace_info, tb) == TRACE_INFO_TB_OFFSET);
+
+	boot_tracebuf.trace_info.reserve = 0;
 	boot_tracebuf.trace_info.tb.buf_size = cpu_to_be64(BOOT_TBUF_SZ);
 	boot_tracebuf.trace_info.tb.max_size = cpu_to_be32(MAX_SIZE);
 
@@ -45,15 +47,156 @@ static size_t tracebuf_extra(void)
 	return TBUF_SZ + MAX_SIZE;
 }
 
+/*
+ * Writers don't take a lock, a trace buffer is shared by all threads of
+ * a core and trace_add() can be re-entered from HMI or sreset context.
+ * Instead ti->reserve holds the next free position and, in the bottom
+ * bits, how many writers are still filling in the space they reserved.
+ * A writer reserves with cmpxchg, throws away old entries, fills in its
+ * record, then drops the writer count. Whoever drops it to zero knows
+ * everything up to the reserved position is written and moves tb->end
+ * there, which is all the reader ever trusts.
+ */
+#define TRACE_WRITERS_BITS	8
+#define TRACE_WRITERS_MASK	((1ull << TRACE_WRITERS_BITS) - 1)
+#define TRACE_ANY_POS		(~0ull)
+
+static inline u64 reserve_pos(u64 reserve)
+{
+	return reserve >> TRACE_WRITERS_BITS;
+}
+
+/* Throw away old entries until we can write up to new_end */
+static void trace_reclaim(struct tracebuf *tb, u64 new_end)
+{
+	u64 bs = be64_to_cpu(tb->buf_size);
+	u64 start, len;
+	struct trace_hdr *hdr;
+
+	for (;;) {
+		barrier();
+		start = be64_to_cpu(tb->start);
+		if (start + bs >= new_end)
+			return;
+
+		hdr = (void *)tb->buf + start % bs;
+		len = hdr->len_div_8 << 3;
+#ifdef DEBUG_TRACES
+		assert(len);
+#endif
+		/* If someone else moved it on, go around and look again */
+		__cmpxchg64((u64 *)&tb->start, cpu_to_be64(start),
+			    cpu_to_be64(start + len));
+	}
+}
+
+/*
+ * Reserve size bytes, at exactly position expect unless that's
+ * TRACE_ANY_POS. We drop the trace rather than overwrite data which
+ * isn't visible to the reader yet, which can only happen if writers
+ * never all get out of the way for a whole buffer's worth of traces.
+ */
+static bool trace_reserve(struct trace_info *ti, u32 size, u64 expect,
+			  u64 *pos)
+{
+	u64 bs = be64_to_cpu(ti->tb.buf_size);
+	u64 old, new;
+
+	do {
+		barrier();
+		old = ti->reserve;
+		*pos = reserve_pos(old);
+		if (expect != TRACE_ANY_POS && *pos != expect)
+			return false;
+		if (*pos + size > be64_to_cpu(ti->tb.end) + bs)
+			return false;
+#ifdef DEBUG_TRACES
+		assert((old & TRACE_WRITERS_MASK) != TRACE_WRITERS_MASK);
+#endif
+		new = ((*pos + size) << TRACE_WRITERS_BITS) +
+			(old & TRACE_WRITERS_MASK) + 1;
+	} while (__cmpxchg64(&ti->reserve, old, new) != old);
+
+	trace_reclaim(&ti->tb, *pos + size);
+
+	/* Must update ->start before we rewrite new entries. */
+	lwsync(); /* write barrier */
+
+	return true;
+}
+
+static void trace_commit(struct trace_info *ti)
+{
+	u64 old, new, end;
+
+	lwsync(); /* write barrier: complete our entry before exposing */
+
+	do {
+		barrier();
+		old = ti->reserve;
+		new = old - 1;
+	} while (__cmpxchg64(&ti->reserve, old, new) != old);
+
+	if (new & TRACE_WRITERS_MASK)
+		return;
+
+	/* Nobody is half way through, so it's all there up to here */
+	lwsync();
+	do {
+		barrier();
+		end = be64_to_cpu(ti->tb.end);
+		if (end >= reserve_pos(new))
+			return;
+	} while (__cmpxchg64((u64 *)&ti->tb.end, cpu_to_be64(end),
+			     cpu_to_be64(reserve_pos(new))) != cpu_to_be64(end));
+}
+
+/* The count shares an aligned word with prev_len, so bump it atomically */
+static bool repeat_inc(struct trace_repeat *rpt, __be64 timestamp)
+{
+	union {
+		u32 word;
+		struct {
+			__be16 prev_len;
+			__be16 num;
+		};
+	} old, new;
+	u32 *p = (u32 *)&rpt->prev_len;
+
+	do {
+		barrier();
+		old.word = *p;
+		/* If this repeat entry is full, don't repeat. */
+		if (be16_to_cpu(old.num) == 0xFFFF)
+			return false;
+		new = old;
+		new.num = cpu_to_be16(be16_to_cpu(old.num) + 1);
+	} while (__cmpxchg32(p, old.word, new.word) != old.word);
+
+	rpt->timestamp = timestamp;
+	return true;
+}
+
 /* To avoid bloating each entry, repeats are actually specific entries.
  * tb->last points to the last (non-repeat) entry. */
-static bool handle_repeat(struct tracebuf *tb, const union trace *trace)
+static bool handle_repeat(struct trace_info *ti, const union trace *trace)
 {
+	struct tracebuf *tb = &ti->tb;
+	u64 bs = be64_to_cpu(tb->buf_size);
 	struct trace_hdr *prev;
 	struct trace_repeat *rpt;
+	u64 last, reserve, pos;
 	u32 len;
 
-	prev = (void *)tb->buf + be64_to_cpu(tb->last) % be64_to_cpu(tb->buf_size);
+	barrier();
+	reserve = ti->reserve;
+	last = be64_to_cpu(tb->last);
+
+	/* If they've consumed prev entry, don't repeat. */
+	if (last < be64_to_cpu(tb->start))
+		return false;
+
+	prev = (void *)tb->buf + last % bs;
 
 	if (prev->type != trace->hdr.type
 	    || prev->len_div_8 != trace->hdr.len_div_8
@@ -64,42 +207,40 @@ static bool handle_repeat(struct tracebuf *tb, const union trace *trace)
 	if (memcmp(prev + 1, &trace->hdr + 1, len - sizeof(*prev)) != 0)
 		return false;
 
-	/* If they've consumed prev entry, don't repeat. */
-	if (be64_to_cpu(tb->last) < be64_to_cpu(tb->start))
-		return false;
-
-	/* OK, it's a duplicate.  Do we already have repeat? */
-	if (be64_to_cpu(tb->last) + len != be64_to_cpu(tb->end)) {
-		u64 pos = be64_to_cpu(tb->last) + len;
-		/* FIXME: Reader is not protected from seeing this! */
-		rpt = (void *)tb->buf + pos % be64_to_cpu(tb->buf_size);
-		assert(pos + rpt->len_div_8*8 == be64_to_cpu(tb->end));
-		assert(rpt->type == TRACE_REPEAT);
-
-		/* If this repeat entry is full, don't repeat. */
-		if (be16_to_cpu(rpt->num) == 0xFFFF)
+	/*
+	 * OK, it's a duplicate.  Do we already have repeat? Only bump it if
+	 * it's complete and nothing has been added after it since.
+	 */
+	pos = last + len;
+	if (reserve_pos(reserve) != pos) {
+		rpt = (void *)tb->buf + pos % bs;
+		if (reserve_pos(reserve) != pos + sizeof(*rpt)
+		    || (reserve & TRACE_WRITERS_MASK)
+		    || be64_to_cpu(tb->end) != pos + sizeof(*rpt)
+		    || rpt->type != TRACE_REPEAT)
 			return false;
 
-		rpt->num = cpu_to_be16(be16_to_cpu(rpt->num) + 1);
-		rpt->timestamp = trace->hdr.timestamp;
-		return true;
+		return repeat_inc(rpt, trace->hdr.timestamp);
 	}
 
 	/*
 	 * Generate repeat entry: it's the smallest possible entry, so we
-	 * must have eliminated old entries.
+	 * must have eliminated old entries. It has to go right after prev,
+	 * so give up if anyone else got in first.
 	 */
 	assert(trace->hdr.len_div_8 * 8 >= sizeof(*rpt));
 
-	rpt = (void *)tb->buf + be64_to_cpu(tb->end) % be64_to_cpu(tb->buf_size);
+	if (!trace_reserve(ti, sizeof(*rpt), pos, &pos))
+		return false;
+
+	rpt = (void *)tb->buf + pos % bs;
 	rpt->timestamp = trace->hdr.timestamp;
 	rpt->type = TRACE_REPEAT;
 	rpt->len_div_8 = sizeof(*rpt) >> 3;
 	rpt->cpu = trace->hdr.cpu;
 	rpt->prev_len = cpu_to_be16(trace->hdr.len_div_8 << 3);
 	rpt->num = cpu_to_be16(1);
-	lwsync(); /* write barrier: complete repeat record before exposing */
-	tb->end = cpu_to_be64(be64_to_cpu(tb->end) + sizeof(*rpt));
+	trace_commit(ti);
 	return true;
 }
 
@@ -107,6 +248,7 @@ void trace_add(union trace *trace, u8 type, u16 len)
 {
 	struct trace_info *ti = this_cpu()->trace;
 	unsigned int tsz;
+	u64 pos;
 
 	trace->hdr.type = type;
 	trace->hdr.len_div_8 = (len + 7) >> 3;
@@ -127,32 +269,17 @@ void trace_add(union trace *trace, u8 type, u16 len)
 	trace->hdr.timestamp = cpu_to_be64(mftb());
 	trace->hdr.cpu = cpu_to_be16(this_cpu()->server_no);
 
-	lock(&ti->lock);
-
-	/* Throw away old entries before we overwrite them. */
-	while ((be64_to_cpu(ti->tb.start) + be64_to_cpu(ti->tb.buf_size))
-	       < (be64_to_cpu(ti->tb.end) + tsz)) {
-		struct trace_hdr *hdr;
-
-		hdr = (void *)ti->tb.buf +
-			be64_to_cpu(ti->tb.start) % be64_to_cpu(ti->tb.buf_size);
-		ti->tb.start = cpu_to_be64(be64_to_cpu(ti->tb.start) +
-					   (hdr->len_div_8 << 3));
-	}
+	/* Check for duplicates... */
+	if (handle_repeat(ti, trace))
+		return;
 
-	/* Must update ->start before we rewrite new entries. */
-	lwsync(); /* write barrier */
+	if (!trace_reserve(ti, tsz, TRACE_ANY_POS, &pos))
+		return;
 
-	/* Check for duplicates... */
-	if (!handle_repeat(&ti->tb, trace)) {
-		/* This may go off end, and that's why ti->tb.buf is oversize */
-		memcpy(ti->tb.buf + be64_to_cpu(ti->tb.end) % be64_to_cpu(ti->tb.buf_size),
-		       trace, tsz);
-		ti->tb.last = ti->tb.end;
-		lwsync(); /* write barrier: write entry before exposing */
-		ti->tb.end = cpu_to_be64(be64_to_cpu(ti->tb.end) + tsz);
-	}
-	unlock(&ti->lock);
+	/* This may go off end, and that's why ti->tb.buf is oversize */
+	memcpy(ti->tb.buf + pos % be64_to_cpu(ti->tb.buf_size), trace, tsz);
+	ti->tb.last = cpu_to_be64(pos);
+	trace_commit(ti);
 }
 
 static void trace_add_dt_props(void)
@@ -234,7 +361,6 @@ void init_trace_buffers(void)
 		if (t->trace) {
 			any = t->trace;
 			memset(t->trace, 0, size);
-			init_lock(&t->trace->lock);
 			t->trace->tb.max_size = cpu_to_be32(MAX_SIZE);
 			t->trace->tb.buf_size = cpu_to_be64(TBUF_SZ);
 			trace_add_desc(any, sizeof(t->trace->tb) +
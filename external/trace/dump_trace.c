@@ -26,14 +26,28 @@
 #include "trace.h"
 
 
+/*
+ * The next record from each buffer. Only these are ever in the heap, so
+ * merging needs no allocation and the heap lasts across polls.
+ */
 struct trace_entry {
 	int index;
+	bool queued;
 	union trace t;
-	struct list_node link;
+};
+
+enum output_format {
+	OUTPUT_TEXT,
+	OUTPUT_BINARY,
+	OUTPUT_JSON,
 };
 
 static int follow;
 static long poll_msecs;
+static enum output_format output;
+static double tb_mhz = 512;
+static u64 json_events;
+static double json_last_ts;
 
 static void *ezalloc(size_t size)
 {
@@ -144,22 +158,6 @@ static void dump_uart(struct trace_uart *t)
 	}
 }
 
-static void load_traces(struct trace_reader *trs, int count)
-{
-	struct trace_entry *te;
-	union trace t;
-	int i;
-
-	for (i = 0; i < count; i++) {
-		while (trace_get(&t, &trs[i])) {
-			te = ezalloc(sizeof(struct trace_entry));
-			memcpy(&te->t, &t, sizeof(union trace));
-			te->index = i;
-			list_add_tail(&trs[i].traces, &te->link);
-		}
-	}
-}
-
 static void print_trace(union trace *t)
 {
 	display_header(&t->hdr);
@@ -206,39 +204,138 @@ bool earlier_entry(const void *va, const void *vb)
 	return be64_to_cpu(a->t.hdr.timestamp) < be64_to_cpu(b->t.hdr.timestamp);
 }
 
-static void display_traces(struct trace_reader *trs, int count)
+/*
+ * The binary export is a magic string and then the records themselves,
+ * as they are in the buffers but merged into timestamp order. Repeat and
+ * overflow records are kept so gaps and bursts show up.
+ */
+#define TRACE_EXPORT_MAGIC	"OPALTRC1"
+
+static void export_binary(const union trace *t)
 {
-	struct trace_entry *current, *next;
-	struct heap *h;
-	int i;
+	if (fwrite(t, t->hdr.len_div_8 * 8, 1, stdout) != 1)
+		err(1, "Writing trace");
+}
 
-	h = heap_init(earlier_entry);
-	if (!h)
-		err(1, "Allocating memory");
+/* Timestamps are in timebase ticks, the JSON wants microseconds */
+static void json_begin(const char *name, const char *cat, const union trace *t)
+{
+	json_last_ts = be64_to_cpu(t->hdr.timestamp) / tb_mhz;
+	printf("%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+	       "\"ts\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{",
+	       json_events++ ? ",\n" : "", name, cat, json_last_ts,
+	       be16_to_cpu(t->hdr.cpu));
+}
+
+/*
+ * Chrome's trace event format, which Perfetto reads too: one instant
+ * event per record on the CPU's track. It's the array form, which is
+ * allowed to be left unterminated when we're killed in follow mode.
+ */
+static void export_json(const union trace *t)
+{
+	switch (t->hdr.type) {
+	case TRACE_REPEAT:
+		json_begin("REPEAT", "trace", t);
+		printf("\"num\":%u", be16_to_cpu(t->repeat.num));
+		break;
+	case TRACE_OVERFLOW:
+		/* No timestamp or CPU, so put it by the last event */
+		printf("%s{\"name\":\"OVERFLOW\",\"cat\":\"trace\",\"ph\":\"i\","
+		       "\"s\":\"g\",\"ts\":%.3f,\"pid\":0,\"tid\":0,\"args\":{"
+		       "\"bytes_missed\":%"PRIu64,
+		       json_events++ ? ",\n" : "", json_last_ts,
+		       be64_to_cpu(t->overflow.bytes_missed));
+		break;
+	case TRACE_OPAL:
+		json_begin("OPAL_CALL", "opal", t);
+		printf("\"token\":%"PRIu64",\"lr\":\"0x%"PRIx64"\"",
+		       be64_to_cpu(t->opal.token), be64_to_cpu(t->opal.lr));
+		break;
+	case TRACE_FSP_MSG:
+		json_begin("FSP_MSG", "fsp", t);
+		printf("\"cmd\":%u,\"seq\":%u,\"mod\":%u,\"sub\":%u,"
+		       "\"dlen\":%u,\"dir\":\"%s\"",
+		       be32_to_cpu(t->fsp_msg.word0) & 0xFFFF,
+		       be32_to_cpu(t->fsp_msg.word0) >> 16,
+		       be32_to_cpu(t->fsp_msg.word1) >> 8,
+		       be32_to_cpu(t->fsp_msg.word1) & 0xFF,
+		       t->fsp_msg.dlen,
+		       t->fsp_msg.dir == TRACE_FSP_MSG_IN ? "IN" : "OUT");
+		break;
+	case TRACE_FSP_EVENT:
+		json_begin("FSP_EVT", "fsp", t);
+		printf("\"event\":%u,\"state\":%u,\"data0\":%u",
+		       be16_to_cpu(t->fsp_evt.event),
+		       be16_to_cpu(t->fsp_evt.fsp_state),
+		       be32_to_cpu(t->fsp_evt.data[0]));
+		break;
+	case TRACE_UART:
+		json_begin("UART", "uart", t);
+		printf("\"ctx\":%u,\"irq_en\":%u,\"in_count\":%u,\"cnt\":%u",
+		       t->uart.ctx, !t->uart.irq_state,
+		       be16_to_cpu(t->uart.in_count), t->uart.cnt);
+		break;
+	default:
+		return;
+	}
+	printf("}}");
+}
+
+static void output_trace(const union trace *t)
+{
+	switch (output) {
+	case OUTPUT_TEXT:
+		print_trace((union trace *)t);
+		break;
+	case OUTPUT_BINARY:
+		export_binary(t);
+		break;
+	case OUTPUT_JSON:
+		export_json(t);
+		break;
+	}
+}
+
+/* Queue up the next record of any buffer we don't have one from */
+static void load_traces(struct heap *h, struct trace_entry *tes,
+			struct trace_reader *trs, int count)
+{
+	int i;
 
 	for (i = 0; i < count; i++) {
-		current = list_pop(&trs[i].traces, struct trace_entry, link);
-		/* no need to add empty ones */
-		if (current)
-			heap_push(h, current);
+		if (tes[i].queued || !trace_get(&tes[i].t, &trs[i]))
+			continue;
+		tes[i].queued = true;
+		if (heap_push(h, &tes[i]))
+			err(1, "Allocating memory");
 	}
+}
+
+/*
+ * Output everything in timestamp order, refilling from whichever buffer
+ * the last record came from. The readers keep their place, so the next
+ * poll carries on from here.
+ */
+static void display_traces(struct heap *h, struct trace_reader *trs)
+{
+	struct trace_entry *current;
 
 	while (h->len) {
 		current = heap_pop(h);
 		if (!current)
 			break;
 
-		print_trace(&current->t);
+		output_trace(&current->t);
 
-		next = list_pop(&trs[current->index].traces, struct trace_entry,
-				link);
-		heap_push(h, next);
-		free(current);
+		if (!trace_get(&current->t, &trs[current->index]))
+			current->queued = false;
+		else if (heap_push(h, current))
+			err(1, "Allocating memory");
 	}
-	heap_free(h);
+	fflush(stdout);
 }
 
-
 /* Can't poll for 0 msec, so use 0 to signify failure */
 static long get_mseconds(char *s)
 {
@@ -254,22 +351,38 @@ static long get_mseconds(char *s)
 
 static void usage(void)
 {
-	errx(1, "Usage: dump_trace [-f [-s msecs]] file...");
+	errx(1, "Usage: dump_trace [-f [-s msecs]] [-b | -j [-t tb_mhz]] file...\n"
+	     "  -b  binary export: \"" TRACE_EXPORT_MAGIC "\" then raw records\n"
+	     "  -j  Chrome/Perfetto JSON trace events\n"
+	     "  -t  timebase frequency in MHz for -j (default 512)");
 }
 
 int main(int argc, char *argv[])
 {
 	struct trace_reader *trs;
+	struct trace_entry *tes;
 	struct trace_info *ti;
+	struct heap *h;
 	struct stat sb;
 	int fd, opt, i;
 
 	poll_msecs = 1000;
-	while ((opt = getopt(argc, argv, "fs:")) != -1) {
+	while ((opt = getopt(argc, argv, "fs:bjt:")) != -1) {
 		switch (opt) {
 		case 'f':
 			follow++;
 			break;
+		case 'b':
+			output = OUTPUT_BINARY;
+			break;
+		case 'j':
+			output = OUTPUT_JSON;
+			break;
+		case 't':
+			tb_mhz = strtod(optarg, NULL);
+			if (tb_mhz > 0)
+				break;
+			usage();
 		case 's':
 			poll_msecs = get_mseconds(optarg);
 			if (follow && poll_msecs)
@@ -286,6 +399,7 @@ int main(int argc, char *argv[])
 		usage();
 
 	trs = ezalloc(sizeof(struct trace_reader) * argc);
+	tes = ezalloc(sizeof(struct trace_entry) * argc);
 
 	for (i =  0; i < argc; i++) {
 		fd = open(argv[i], O_RDONLY);
@@ -300,15 +414,28 @@ int main(int argc, char *argv[])
 			err(1, "Mmaping %s", argv[i]);
 
 		trs[i].tb = &ti->tb;
-		list_head_init(&trs[i].traces);
+		tes[i].index = i;
 	}
 
+	h = heap_init(earlier_entry);
+	if (!h)
+		err(1, "Allocating memory");
+
+	if (output == OUTPUT_BINARY)
+		fwrite(TRACE_EXPORT_MAGIC, strlen(TRACE_EXPORT_MAGIC), 1, stdout);
+	else if (output == OUTPUT_JSON)
+		printf("[\n");
+
 	do {
-		load_traces(trs, argc);
-		display_traces(trs, argc);
+		load_traces(h, tes, trs, argc);
+		display_traces(h, trs);
 		if (follow)
 			usleep(poll_msecs * 1000);
 	} while (follow);
 
+	if (output == OUTPUT_JSON)
+		printf("\n]\n");
+
+	heap_free(h);
 	return 0;
 }
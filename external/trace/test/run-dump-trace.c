@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Run dump_trace over synthetic trace buffers: the merge has to come out
+ * in timestamp order whatever the output format, and following a buffer
+ * has to pick up where the last poll left off.
+ *
+ * Copyright 2020 IBM Corp.
+ */
+
+#define main dump_trace_main
+#include "../dump_trace.c"
+#undef main
+#include "../trace.c"
+
+#include <assert.h>
+
+#define BUF_SIZE	4096
+#define NR_BUFS		3
+
+static struct trace_info *tis[NR_BUFS];
+static char paths[NR_BUFS][32];
+
+static struct trace_info *new_buffer(void)
+{
+	struct trace_info *ti;
+
+	ti = ezalloc(sizeof(*ti) + BUF_SIZE + sizeof(union trace));
+	ti->tb.buf_size = cpu_to_be64(BUF_SIZE);
+	ti->tb.max_size = cpu_to_be32(sizeof(union trace));
+	return ti;
+}
+
+/* Just enough of trace_add() to make buffers that don't wrap */
+static void add(struct trace_info *ti, u64 ts, u16 cpu, u8 type, u8 len)
+{
+	u64 end = be64_to_cpu(ti->tb.end);
+	union trace t;
+
+	memset(&t, 0, sizeof(t));
+	t.hdr.timestamp = cpu_to_be64(ts);
+	t.hdr.type = type;
+	t.hdr.len_div_8 = (len + 7) / 8;
+	t.hdr.cpu = cpu_to_be16(cpu);
+	if (type == TRACE_OPAL)
+		t.opal.token = cpu_to_be64(ts);
+	if (type == TRACE_FSP_MSG)
+		t.fsp_msg.dlen = 2;
+
+	assert(end + t.hdr.len_div_8 * 8 <= BUF_SIZE);
+	memcpy(ti->tb.buf + end, &t, t.hdr.len_div_8 * 8);
+	ti->tb.last = ti->tb.end;
+	ti->tb.end = cpu_to_be64(end + t.hdr.len_div_8 * 8);
+}
+
+static const u8 types[] = { TRACE_OPAL, TRACE_FSP_MSG, TRACE_FSP_EVENT,
+			    TRACE_UART };
+static const u8 lens[] = { sizeof(struct trace_opal),
+			   sizeof(struct trace_fsp_msg),
+			   sizeof(struct trace_fsp_event),
+			   sizeof(struct trace_uart) };
+
+/* Buffer i gets timestamps i, i + NR_BUFS, ... so they interleave */
+static void fill(int first, int last)
+{
+	int n, b;
+
+	for (n = first; n < last; n++) {
+		b = n % NR_BUFS;
+		add(tis[b], n, b, types[n % 4], lens[n % 4]);
+	}
+}
+
+static void write_files(void)
+{
+	int i, fd;
+
+	for (i = 0; i < NR_BUFS; i++) {
+		strcpy(paths[i], "/tmp/run-dump-trace-XXXXXX");
+		fd = mkstemp(paths[i]);
+		assert(fd >= 0);
+		assert(write(fd, tis[i], sizeof(*tis[i]) + BUF_SIZE +
+			     sizeof(union trace)) > 0);
+		close(fd);
+	}
+}
+
+/* Run dump_trace with its stdout going to a file we hand back */
+static FILE *run(const char *opt)
+{
+	char *argv[NR_BUFS + 3];
+	int argc = 0, i, saved;
+	FILE *out = tmpfile();
+
+	assert(out);
+	argv[argc++] = "dump_trace";
+	if (opt)
+		argv[argc++] = (char *)opt;
+	for (i = 0; i < NR_BUFS; i++)
+		argv[argc++] = paths[i];
+	argv[argc] = NULL;
+
+	output = OUTPUT_TEXT;
+	json_events = 0;
+	optind = 0;
+
+	fflush(stdout);
+	saved = dup(1);
+	dup2(fileno(out), 1);
+	assert(dump_trace_main(argc, argv) == 0);
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+
+	rewind(out);
+	return out;
+}
+
+static void check_text(int count)
+{
+	FILE *out = run(NULL);
+	unsigned long ts, cpu, n = 0;
+	char line[512];
+
+	while (fgets(line, sizeof(line), out)) {
+		assert(sscanf(line, "%lx (+%*x) [%lx]", &ts, &cpu) == 2);
+		assert(ts == n && cpu == n % NR_BUFS);
+		n++;
+	}
+	assert(n == count);
+	fclose(out);
+}
+
+static void check_binary(int count)
+{
+	FILE *out = run("-b");
+	char magic[8];
+	union trace t;
+	int n = 0;
+
+	assert(fread(magic, 8, 1, out) == 1);
+	assert(memcmp(magic, TRACE_EXPORT_MAGIC, 8) == 0);
+	while (fread(&t.hdr, sizeof(t.hdr), 1, out) == 1) {
+		assert(be64_to_cpu(t.hdr.timestamp) == n);
+		assert(t.hdr.type == types[n % 4]);
+		assert(fread((char *)&t + sizeof(t.hdr),
+			     t.hdr.len_div_8 * 8 - sizeof(t.hdr), 1, out) == 1);
+		n++;
+	}
+	assert(n == count);
+	fclose(out);
+}
+
+/* Every event's timestamp, in the order they came out */
+static int json_timestamps(FILE *out, double *ts, int max)
+{
+	char line[512], *p;
+	int n = 0;
+
+	while (fgets(line, sizeof(line), out)) {
+		p = strstr(line, "\"ts\":");
+		if (!p)
+			continue;
+		assert(n < max);
+		ts[n++] = strtod(p + 5, NULL);
+	}
+	return n;
+}
+
+static void check_json(int count)
+{
+	FILE *out = run("-j");
+	char line[512];
+	double ts[64];
+	int i;
+
+	assert(fgets(line, sizeof(line), out) && strcmp(line, "[\n") == 0);
+	assert(json_timestamps(out, ts, 64) == count);
+	for (i = 0; i < count; i++)
+		assert(ts[i] * 512 > i - 0.5 && ts[i] * 512 < i + 0.5);
+	fclose(out);
+}
+
+/* Two polls of the same buffers, with more added in between */
+static void check_follow(void)
+{
+	struct trace_reader trs[NR_BUFS];
+	struct trace_entry tes[NR_BUFS];
+	struct heap *h = heap_init(earlier_entry);
+	int i, saved, n;
+	FILE *out = tmpfile();
+	double ts[64];
+
+	memset(trs, 0, sizeof(trs));
+	memset(tes, 0, sizeof(tes));
+	for (i = 0; i < NR_BUFS; i++) {
+		tis[i] = new_buffer();
+		trs[i].tb = &tis[i]->tb;
+		tes[i].index = i;
+	}
+
+	output = OUTPUT_JSON;
+	json_events = 0;
+	fflush(stdout);
+	saved = dup(1);
+	dup2(fileno(out), 1);
+
+	fill(0, 10);
+	load_traces(h, tes, trs, NR_BUFS);
+	display_traces(h, trs);
+	assert(h->len == 0);
+
+	/* Nothing new, nothing out */
+	load_traces(h, tes, trs, NR_BUFS);
+	display_traces(h, trs);
+
+	fill(10, 25);
+	load_traces(h, tes, trs, NR_BUFS);
+	display_traces(h, trs);
+
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+
+	rewind(out);
+	n = json_timestamps(out, ts, 64);
+	assert(n == 25);
+	for (i = 0; i < n; i++)
+		assert(ts[i] * 512 > i - 0.5 && ts[i] * 512 < i + 0.5);
+
+	fclose(out);
+	heap_free(h);
+	for (i = 0; i < NR_BUFS; i++)
+		free(tis[i]);
+}
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < NR_BUFS; i++)
+		tis[i] = new_buffer();
+	fill(0, 40);
+	write_files();
+
+	check_text(40);
+	check_binary(40);
+	check_json(40);
+
+	for (i = 0; i < NR_BUFS; i++) {
+		unlink(paths[i]);
+		free(tis[i]);
+	}
+
+	check_follow();
+	return 0;
+}
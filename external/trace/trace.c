@@ -11,6 +11,8 @@
 #include "trace.h"
 #include <trace_types.h>
 #include <errno.h>
+#include <assert.h>
+#include <string.h>
 
 #if defined(__powerpc__) || defined(__powerpc64__)
 #define rmb() lwsync()
@@ -55,6 +57,8 @@ bool trace_get(union trace *t, struct trace_reader *tr)
 	if (trace_empty(tr))
 		return false;
 
+	rmb(); /* read barrier, so we read the record after seeing tb->end. */
+
 again:
 	/*
 	 * The actual buffer is slightly larger than tbsize, so this
@@ -1708,6 +1708,8 @@ int parse_hdat(bool is_opal)
 
 	prlog(PR_DEBUG, "Parsing HDAT...\n");
 
+	dt_prop_arena_begin();
+
 	fixup_spira();
 
 	update_spirah_addr();
@@ -1731,8 +1733,10 @@ int parse_hdat(bool is_opal)
 	dt_init_led_node();
 
 	/* Parse PCIA */
-	if (!pcia_parse())
+	if (!pcia_parse()) {
+		dt_prop_arena_end();
 		return -1;
+	}
 
 	/* IPL params */
 	add_iplparams();
@@ -1777,6 +1781,8 @@ int parse_hdat(bool is_opal)
 	if (proc_gen >= proc_gen_p9)
 		node_stb_parse();
 
+	dt_prop_arena_end();
+
 	prlog(PR_DEBUG, "Parsing HDAT...done\n");
 
 	return 0;
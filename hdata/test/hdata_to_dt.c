@@ -81,6 +81,14 @@ void cpu_process_local_jobs(void);
 struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 				       const char *name,
 				       void (*func)(void *data), void *data);
+uint8_t get_available_nr_cores_in_chip(uint32_t chip_id);
+struct cpu_job_group;
+struct cpu_job_group *cpu_job_group_alloc(void);
+bool cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id,
+		       const char *name,
+		       void (*func)(void *data), void *data);
+void cpu_job_group_submit(struct cpu_job_group *grp);
+unsigned long cpu_job_group_wait(struct cpu_job_group *grp);
 static inline struct cpu_job *cpu_queue_job(struct cpu_thread *cpu,
 					    const char *name,
 					    void (*func)(void *data),
@@ -117,6 +117,51 @@ void cpu_process_local_jobs(void)
 {
 }
 
+uint8_t get_available_nr_cores_in_chip(uint32_t chip_id);
+uint8_t __attrconst get_available_nr_cores_in_chip(uint32_t chip_id)
+{
+	(void)chip_id;
+	return 1;
+}
+
+/* Jobs run as they're added, so there's never anything to wait for */
+struct cpu_job_group {
+	int unused;
+};
+
+struct cpu_job_group *cpu_job_group_alloc(void);
+struct cpu_job_group *cpu_job_group_alloc(void)
+{
+	return calloc(1, sizeof(struct cpu_job_group));
+}
+
+bool cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id,
+		       const char *name,
+		       void (*func)(void *data), void *data);
+bool cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id,
+		       const char *name,
+		       void (*func)(void *data), void *data)
+{
+	(void)grp;
+	(void)chip_id;
+	(void)name;
+	(func)(data);
+	return true;
+}
+
+void cpu_job_group_submit(struct cpu_job_group *grp);
+void cpu_job_group_submit(struct cpu_job_group *grp)
+{
+	(void)grp;
+}
+
+unsigned long cpu_job_group_wait(struct cpu_job_group *grp);
+unsigned long cpu_job_group_wait(struct cpu_job_group *grp)
+{
+	free(grp);
+	return 0;
+}
+
 /* Add any stub functions required for linking here. */
 static void stub_function(void)
 {
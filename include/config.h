@@ -36,6 +36,9 @@
 /* Enable lock dependency checker */
 #define DEADLOCK_CHECKER	1
 
+/* Enable lock contention statistics, dumped to the console at OS boot */
+//#define LOCK_STATS		1
+
 /* Enable OPAL entry point tracing */
 //#define OPAL_TRACE_ENTRY	1
 
@@ -7,6 +7,7 @@
 #include <processor.h>
 #include <ccan/list/list.h>
 #include <lock.h>
+#include <mem_region.h>
 #include <device.h>
 #include <opal.h>
 #include <stack.h>
@@ -62,6 +63,7 @@ struct cpu_thread {
 	uint32_t			hbrt_spec_wakeup; /* primary only */
 	uint64_t			save_l2_fir_action1;
 	uint64_t			current_token;
+	struct opal_call_latency_cpu	*opal_latency;
 #ifdef STACK_CHECK_ENABLED
 	int64_t				stack_bot_mark;
 	uint64_t			stack_bot_pc;
@@ -74,6 +76,10 @@ struct cpu_thread {
 	struct list_head		job_queue;
 	uint32_t			job_count;
 	bool				job_has_no_return;
+	struct cpu_job			*wait_job;	/* sleeping in cpu_wait_job() */
+
+	/* Small object cache in front of the heap, see core/malloc.c */
+	struct malloc_cache		malloc_cache;
 	/*
 	 * Per-core mask tracking for threads in HMI handler and
 	 * a cleanup done bit.
@@ -265,6 +271,22 @@ extern struct cpu_job *cpu_queue_job_on_node(uint32_t chip_id,
 				       const char *name,
 				       void (*func)(void *data), void *data);
 
+/*
+ * Job groups: add any number of jobs, optionally with a chip to run
+ * them on (-1 for anywhere), submit them all in one go and then wait
+ * for the lot. Idle threads steal queued group jobs from busy ones.
+ * cpu_job_group_wait() frees the group and its jobs, and returns how
+ * long they took in microseconds.
+ */
+struct cpu_job_group;
+
+extern struct cpu_job_group *cpu_job_group_alloc(void);
+extern bool cpu_job_group_add(struct cpu_job_group *grp, int32_t chip_id,
+			      const char *name,
+			      void (*func)(void *data), void *data);
+extern void cpu_job_group_submit(struct cpu_job_group *grp);
+extern bool cpu_job_group_done(struct cpu_job_group *grp);
+extern unsigned long cpu_job_group_wait(struct cpu_job_group *grp);
 
 /* Poll job status, returns true if completed */
 extern bool cpu_poll_job(struct cpu_job *job);
@@ -272,15 +294,22 @@ extern bool cpu_poll_job(struct cpu_job *job);
 /* Synchronously wait for a job to complete, this will
  * continue handling the FSP mailbox if called from the
  * boot CPU. Set free_it to free it automatically.
+ * It spins briefly, then sleeps until the CPU that completes
+ * the job wakes it up, or it's time to run the pollers.
  */
 extern void cpu_wait_job(struct cpu_job *job, bool free_it);
 
+/* Print how long cpu_wait_job() has spent waiting, and saved doing so */
+extern void cpu_wait_job_report(void);
+
 /* Called by init to process jobs */
 extern void cpu_process_jobs(void);
 /* Fallback to running jobs synchronously for global jobs */
 extern void cpu_process_local_jobs(void);
 /* Check if there's any job pending */
 bool cpu_check_jobs(struct cpu_thread *cpu);
+/* Take a group job queued on another CPU, returns true if we got one */
+bool cpu_steal_job(struct cpu_thread *cpu);
 
 /* OPAL sreset vector in place at 0x100 */
 void cpu_set_sreset_enable(bool sreset_enabled);
@@ -25,6 +25,8 @@ struct dt_property {
 	char prop[/* len */];
 };
 
+struct dt_prop_hash;
+
 struct dt_node {
 	const char *name;
 	struct list_node list;
@@ -32,6 +34,15 @@ struct dt_node {
 	struct list_head children;
 	struct dt_node *parent;
 	u32 phandle;
+	/* Private to device.c, speeds up finding properties of big nodes */
+	struct dt_prop_hash *prop_hash;
+	/*
+	 * Private to fdt.c, flattened size of this subtree. Only good while
+	 * flat_gen matches dt_flat_gen, device.c zeroes it on changes.
+	 */
+	u32 flat_gen;
+	u32 flat_struct;
+	u32 flat_strings;
 };
 
 /* This is shared with device_tree.c .. make it static when
@@ -39,6 +50,9 @@ struct dt_node {
  */
 extern u32 last_phandle;
 
+/* Bumped to throw away every cached flattened size */
+extern u32 dt_flat_gen;
+
 extern struct dt_node *dt_root;
 extern struct dt_node *dt_chosen;
 
@@ -128,6 +142,13 @@ void dt_check_del_prop(struct dt_node *node, const char *name);
 /* Warning: moves *prop! */
 void dt_resize_property(struct dt_property **prop, size_t len);
 
+/*
+ * Carve the properties added in between out of big chunks rather than
+ * malloc()ing each one. For building lots of tree at once at boot.
+ */
+void dt_prop_arena_begin(void);
+void dt_prop_arena_end(void);
+
 void dt_property_set_cell(struct dt_property *prop, u32 index, u32 val);
 u32 dt_property_get_cell(const struct dt_property *prop, u32 index);
 
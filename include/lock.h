@@ -38,8 +38,40 @@ struct lock {
 
 	/* linkage in per-cpu list of owned locks */
 	struct list_node list;
+
+#ifdef LOCK_STATS
+	/* Statistics record of the current owner, and when it got the lock */
+	struct lock_stats *stats;
+	uint64_t acquired_tb;
+#endif
 };
 
+#ifdef LOCK_STATS
+/*
+ * Contention statistics, one record per lock and call site of lock().
+ * A record is only updated by the holder of its lock. Times are in
+ * timebase ticks.
+ */
+struct lock_stats {
+	struct lock	*lock;
+	const char	*caller;
+	uint64_t	count;
+	uint64_t	contended;
+	uint64_t	spin_tb;
+	uint64_t	max_spin_tb;
+	uint64_t	max_hold_tb;
+};
+
+extern struct lock_stats *lock_stats_acquired(struct lock *l,
+					      const char *caller,
+					      bool contended,
+					      uint64_t spin_tb);
+extern void lock_stats_released(struct lock *l, uint64_t hold_tb);
+extern void lock_stats_dump(bool reset);
+#else
+static inline void lock_stats_dump(bool reset __unused) { }
+#endif
+
 /* Initializer... not ideal but works for now. If we need different
  * values for the fields and/or start getting warnings we'll have to
  * play macro tricks
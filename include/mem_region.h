@@ -28,6 +28,12 @@ enum mem_region_type {
 	REGION_OS,
 };
 
+/*
+ * Free blocks smaller than 1 << MEM_REGION_FREE_BINS longs are kept in
+ * power-of-two size class bins, anything larger goes on free_list.
+ */
+#define MEM_REGION_FREE_BINS	16
+
 /* An area of physical memory. */
 struct mem_region {
 	struct list_node list;
@@ -36,6 +42,8 @@ struct mem_region {
 	struct dt_node *node;
 	enum mem_region_type type;
 	struct list_head free_list;
+	struct list_head free_bins[MEM_REGION_FREE_BINS];
+	unsigned long free_bins_map;
 	struct lock free_list_lock;
 };
 
@@ -49,6 +57,8 @@ void mem_free(struct mem_region *region, void *mem,
 bool mem_resize(struct mem_region *region, void *mem, size_t len,
 		const char *location);
 size_t mem_allocated_size(const void *ptr);
+const char *mem_alloc_location(const void *ptr);
+void mem_set_alloc_location(void *ptr, const char *location);
 bool mem_check(const struct mem_region *region);
 bool mem_check_all(void);
 void mem_region_release_unused(void);
@@ -60,6 +70,22 @@ void mem_dump_allocs(void);
 /* Specifically for working on the heap. */
 extern struct mem_region skiboot_heap;
 
+/*
+ * Per-CPU cache of small heap objects, one stack of free objects for each
+ * size class, used by malloc() so the hot paths don't all serialise on the
+ * heap lock. Only ever touched by the owning CPU.
+ */
+#define MALLOC_CACHE_CLASSES	4	/* 32, 64, 128 and 256 bytes */
+#define MALLOC_CACHE_DEPTH	16
+#define MALLOC_CACHE_BATCH	(MALLOC_CACHE_DEPTH / 2)
+
+struct malloc_cache {
+	unsigned int	count[MALLOC_CACHE_CLASSES];
+	void		*objs[MALLOC_CACHE_CLASSES][MALLOC_CACHE_DEPTH];
+};
+
+void malloc_cache_enable(void);
+
 void mem_region_init(void);
 void mem_region_add_dt_reserved(void);
 
@@ -227,7 +227,9 @@
 #define OPAL_SECVAR_ENQUEUE_UPDATE		178
 #define OPAL_PHB_SET_OPTION			179
 #define OPAL_PHB_GET_OPTION			180
-#define OPAL_LAST				180
+#define OPAL_CALL_LATENCY_RESET			181
+#define OPAL_PCI_CONFIG_BATCH			182
+#define OPAL_LAST				182
 
 #define QUIESCE_HOLD			1 /* Spin all calls at entry */
 #define QUIESCE_REJECT			2 /* Fail all calls with OPAL_BUSY */
@@ -1254,6 +1256,52 @@ struct opal_mpipl_fadump {
 	struct	opal_mpipl_region region[];
 };
 
+/*
+ * OPAL call latency histograms, exported read-only to the OS as the
+ * "opal_call_latency" firmware export, all fields big endian. The header
+ * is followed by nr_cpus records, each an opal_call_latency_cpu with
+ * nr_tokens histograms of nr_buckets counters: bucket n counts calls
+ * that took between 2^n and 2^(n+1) - 1 timebase ticks, the last bucket
+ * anything longer. The counts are firmware's, so step through them using
+ * nr_tokens and nr_buckets, never OPAL_LAST. OPAL_CALL_LATENCY_RESET
+ * clears the counters.
+ */
+#define OPAL_CALL_LATENCY_MAGIC		0x4f43414c	/* "OCAL" */
+
+struct opal_call_latency_cpu {
+	__be32	pir;
+	__be32	reserved;
+	__be32	hist[];		/* [nr_tokens][nr_buckets] */
+};
+
+struct opal_call_latency {
+	__be32	magic;
+	__be16	nr_tokens;
+	__be16	nr_buckets;
+	__be32	nr_cpus;
+	__be32	reserved;
+	__be64	tb_hz;
+	__be64	reset_tb;	/* Timebase when the counters were cleared */
+};
+
+/*
+ * One PCI config space access for OPAL_PCI_CONFIG_BATCH, all fields big
+ * endian. data is the value to write, or where the value read goes, in
+ * its low bytes. rc is the OPAL return code of this access alone.
+ */
+#define OPAL_PCI_CFG_OP_WRITE		0x01
+#define OPAL_PCI_CFG_BATCH_MAX		1024
+
+struct opal_pci_cfg_op {
+	__be16	bdfn;
+	__be16	offset;
+	u8	size;		/* 1, 2 or 4 bytes */
+	u8	flags;		/* OPAL_PCI_CFG_OP_* */
+	__be16	reserved;
+	__be32	data;
+	__be32	rc;
+};
+
 #endif /* __ASSEMBLY__ */
 
 #endif /* __OPAL_API_H */
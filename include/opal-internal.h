@@ -48,6 +48,7 @@ extern uint64_t opal_pending_events;
 extern struct dt_node *opal_node;
 
 extern void opal_table_init(void);
+extern void opal_latency_init(void);
 extern void opal_update_pending_evt(uint64_t evt_mask, uint64_t evt_values);
 __be64 opal_dynamic_event_alloc(void);
 void opal_dynamic_event_free(__be64 event);
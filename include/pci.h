@@ -32,6 +32,7 @@
 	      PCI_DEV(_bdfn), PCI_FUNC(_bdfn), ## a)
 
 struct pci_device;
+struct pci_cap_cache;
 struct pci_cfg_reg_filter;
 
 typedef int64_t (*pci_cfg_reg_func)(void *dev,
@@ -92,6 +93,7 @@ struct pci_device {
 		void		*data;
 		pci_cap_free_data_func free_func;
 	} cap[64];
+	struct pci_cap_cache	*cap_cache;	/* Used by pci_find_(e)cap() */
 	uint32_t		mps;		/* Max payload size capability */
 
 	uint32_t		pcrf_start;
@@ -361,6 +363,27 @@ extern bool pci_tracing;
 
 void pci_nvram_init(void);
 
+/*
+ * A bdfn-indexed table, each bus's devfns allocated when the first device
+ * on it goes in. If that fails it's marked incomplete, and lookups have to
+ * fall back to walking the devices.
+ */
+struct pci_bdfn_map {
+	void			**bus[256];
+	bool			incomplete;
+};
+
+static inline void *pci_bdfn_map_get(const struct pci_bdfn_map *map,
+				     uint16_t bdfn)
+{
+	void **devfns = map->bus[PCI_BUS_NUM(bdfn)];
+
+	return devfns ? devfns[bdfn & 0xff] : NULL;
+}
+
+extern void pci_bdfn_map_set(struct pci_bdfn_map *map, uint16_t bdfn,
+			     void *dev);
+
 struct phb {
 	struct dt_node		*dt_node;
 	int			opal_id;
@@ -369,6 +392,8 @@ struct phb {
 	struct lock		lock;
 	struct list_head	devices;
 	struct list_head	virt_devices;
+	struct pci_bdfn_map	dev_map;
+	struct pci_bdfn_map	virt_map;
 	const struct phb_ops	*ops;
 	struct pci_lsi_state	lstate;
 	uint32_t		mps;
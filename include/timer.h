@@ -22,7 +22,10 @@ typedef void (*timer_func_t)(struct timer *t, void *data, uint64_t now);
  * be freed from the callback itself.
  */
 struct timer {
-	struct list_node	link;
+	struct list_node	link;		/* TIMER_POLL list */
+	struct timer		*child;		/* pairing heap of the rest */
+	struct timer		*next;
+	struct timer		*prev;		/* parent if first child */
 	uint64_t		target;
 	timer_func_t		expiry;
 	void *			user_data;
@@ -5,7 +5,6 @@
 #define __TRACE_H
 #include <ccan/short_types/short_types.h>
 #include <stddef.h>
-#include <lock.h>
 #include <trace_types.h>
 
 
@@ -14,9 +13,18 @@ struct cpu_thread;
 /* Here's one we prepared earlier. */
 void init_boot_tracebuf(struct cpu_thread *boot_cpu);
 
+/* Where tb sits in trace_info, part of what's exposed to the kernel */
+#define TRACE_INFO_TB_OFFSET	40
+
 struct trace_info {
-	/* Lock for writers. Exposed to kernel. */
-	struct lock lock;
+	/*
+	 * Next free position << 8 | writers still filling in. This was a
+	 * struct lock, and readers expect tb where it used to follow one.
+	 */
+	union {
+		u64 reserve;
+		u8 pad[TRACE_INFO_TB_OFFSET];
+	};
 	/* Exposed to kernel. */
 	struct tracebuf tb;
 };
@@ -17,7 +17,13 @@
 #define TRACE_FSP_EVENT	5	/* FSP driver event */
 #define TRACE_UART	6	/* UART driver traces */
 
-/* One per cpu, plus one for NMIs */
+/*
+ * One per core. Writers never lock: everything below end is complete,
+ * and before a writer overwrites old entries it moves start past them.
+ * So a reader copies out the entry at its position, then re-reads start;
+ * if that has passed the entry, the copy may be torn and is discarded as
+ * an overflow.
+ */
 struct tracebuf {
 	/* Size used to get buffer offset */
 	__be64 buf_size;
@@ -43,6 +43,7 @@ static inline void *memcpy_null(void *dest, const void *src, size_t n)
 	return memcpy(dest, src, n);
 }
 void *memcpy_from_ci(void *destpp, const void *srcpp, size_t len);
+void memcpy_enable_vsx(void);
 
 static inline int ffs(unsigned long val)
 {
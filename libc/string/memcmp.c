@@ -11,6 +11,7 @@
  *****************************************************************************/
 
 #include <stddef.h>
+#include <ccan/short_types/short_types.h>
 
 int memcmp(const void *ptr1, const void *ptr2, size_t n);
 int memcmp(const void *ptr1, const void *ptr2, size_t n)
@@ -18,6 +19,34 @@ int memcmp(const void *ptr1, const void *ptr2, size_t n)
 	const unsigned char *p1 = ptr1;
 	const unsigned char *p2 = ptr2;
 
+	/* Align the first buffer, then skip the equal part a word at a time */
+	while (n >= 32 && ((unsigned long)p1 & 7)) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
+		p1 += 1;
+		p2 += 1;
+		n -= 1;
+	}
+
+	while (n >= 32) {
+		const uint64_t *w1 = (const uint64_t *)p1;
+		const uint64_t *w2 = (const uint64_t *)p2;
+
+		if ((w1[0] ^ w2[0]) | (w1[1] ^ w2[1]) |
+		    (w1[2] ^ w2[2]) | (w1[3] ^ w2[3]))
+			break;
+		p1 += 32;
+		p2 += 32;
+		n -= 32;
+	}
+
+	while (n >= 8 && *(const uint64_t *)p1 == *(const uint64_t *)p2) {
+		p1 += 8;
+		p2 += 8;
+		n -= 8;
+	}
+
+	/* Whatever differs is in the next few bytes, if anywhere */
 	while (n-- > 0) {
 		if (*p1 != *p2)
 			return (*p1 - *p2);
@@ -10,13 +10,140 @@
  *     IBM Corporation - initial implementation
  *****************************************************************************/
 
+#define CACHE_LINE_SIZE 128
+
+/* Copies at least this big are worth turning VSX on for */
+#define MEMCPY_VSX_MIN 4096
+
 #include <stddef.h>
 #include <ccan/short_types/short_types.h>
 
+void memcpy_enable_vsx(void);
 void *memcpy(void *dest, const void *src, size_t n);
+
+#if defined(__powerpc__) || defined(__powerpc64__)
+static int memcpy_vsx;
+
+/* Called once we know the CPU has VSX */
+void memcpy_enable_vsx(void)
+{
+	memcpy_vsx = 1;
+}
+
+/*
+ * Copy whole cache lines through vs32-vs39. We're built without VMX/VSX
+ * and those registers can hold the OS's state during an OPAL call, so
+ * they are only turned on in the MSR for the copy, and both they and
+ * the MSR are put back afterwards.
+ */
+static void memcpy_vsx_lines(void *dest, const void *src, size_t lines)
+{
+	uint64_t save[16] __attribute__((aligned(16)));
+	unsigned long msr, tmp;
+
+	asm volatile(
+		"	mfmsr	%[msr]\n"
+		"	oris	%[tmp],%[msr],0x0280\n"	/* MSR_VEC | MSR_VSX */
+		"	mtmsrd	%[tmp]\n"
+		"	isync\n"
+		"	stxvd2x	32,0,%[save]\n"
+		"	stxvd2x	33,%[o16],%[save]\n"
+		"	stxvd2x	34,%[o32],%[save]\n"
+		"	stxvd2x	35,%[o48],%[save]\n"
+		"	stxvd2x	36,%[o64],%[save]\n"
+		"	stxvd2x	37,%[o80],%[save]\n"
+		"	stxvd2x	38,%[o96],%[save]\n"
+		"	stxvd2x	39,%[o112],%[save]\n"
+		"	mtctr	%[lines]\n"
+		"1:	lxvd2x	32,0,%[src]\n"
+		"	lxvd2x	33,%[o16],%[src]\n"
+		"	lxvd2x	34,%[o32],%[src]\n"
+		"	lxvd2x	35,%[o48],%[src]\n"
+		"	lxvd2x	36,%[o64],%[src]\n"
+		"	lxvd2x	37,%[o80],%[src]\n"
+		"	lxvd2x	38,%[o96],%[src]\n"
+		"	lxvd2x	39,%[o112],%[src]\n"
+		"	stxvd2x	32,0,%[dest]\n"
+		"	stxvd2x	33,%[o16],%[dest]\n"
+		"	stxvd2x	34,%[o32],%[dest]\n"
+		"	stxvd2x	35,%[o48],%[dest]\n"
+		"	stxvd2x	36,%[o64],%[dest]\n"
+		"	stxvd2x	37,%[o80],%[dest]\n"
+		"	stxvd2x	38,%[o96],%[dest]\n"
+		"	stxvd2x	39,%[o112],%[dest]\n"
+		"	addi	%[src],%[src],128\n"
+		"	addi	%[dest],%[dest],128\n"
+		"	bdnz	1b\n"
+		"	lxvd2x	32,0,%[save]\n"
+		"	lxvd2x	33,%[o16],%[save]\n"
+		"	lxvd2x	34,%[o32],%[save]\n"
+		"	lxvd2x	35,%[o48],%[save]\n"
+		"	lxvd2x	36,%[o64],%[save]\n"
+		"	lxvd2x	37,%[o80],%[save]\n"
+		"	lxvd2x	38,%[o96],%[save]\n"
+		"	lxvd2x	39,%[o112],%[save]\n"
+		"	mtmsrd	%[msr]\n"
+		"	isync\n"
+		: [msr] "=&r"(msr), [tmp] "=&r"(tmp),
+		  [src] "+b"(src), [dest] "+b"(dest)
+		: [save] "b"(save), [lines] "r"(lines),
+		  [o16] "b"(16ul), [o32] "b"(32ul), [o48] "b"(48ul),
+		  [o64] "b"(64ul), [o80] "b"(80ul), [o96] "b"(96ul),
+		  [o112] "b"(112ul)
+		: "ctr", "memory");
+}
+#else
+void memcpy_enable_vsx(void)
+{
+}
+#endif
+
+/* Four doublewords at a time, all loaded before any is stored */
+static inline void copy_32(uint64_t *d, const uint64_t *s)
+{
+	uint64_t a = s[0], b = s[1], c = s[2], e = s[3];
+
+	d[0] = a;
+	d[1] = b;
+	d[2] = c;
+	d[3] = e;
+}
+
 void *memcpy(void *dest, const void *src, size_t n)
 {
 	void *ret = dest;
+	size_t lines;
+
+	/*
+	 * Align the destination of anything but short copies, unaligned
+	 * loads are cheaper than unaligned stores.
+	 */
+	while (n >= CACHE_LINE_SIZE && ((unsigned long)dest & 7)) {
+		*(uint8_t *)dest = *(uint8_t *)src;
+		dest += 1;
+		src += 1;
+		n -= 1;
+	}
+
+#if defined(__powerpc__) || defined(__powerpc64__)
+	if (memcpy_vsx && n >= MEMCPY_VSX_MIN) {
+		lines = n / CACHE_LINE_SIZE;
+		memcpy_vsx_lines(dest, src, lines);
+		dest += lines * CACHE_LINE_SIZE;
+		src += lines * CACHE_LINE_SIZE;
+		n -= lines * CACHE_LINE_SIZE;
+	}
+#endif
+
+	for (lines = n / CACHE_LINE_SIZE; lines; lines--) {
+		copy_32(dest, src);
+		copy_32(dest + 32, src + 32);
+		copy_32(dest + 64, src + 64);
+		copy_32(dest + 96, src + 96);
+		dest += CACHE_LINE_SIZE;
+		src += CACHE_LINE_SIZE;
+		n -= CACHE_LINE_SIZE;
+	}
 
 	while (n >= 8) {
 		*(uint64_t *)dest = *(uint64_t *)src;
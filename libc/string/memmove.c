@@ -11,26 +11,55 @@
  *****************************************************************************/
 
 #include <stddef.h>
+#include <ccan/short_types/short_types.h>
 
 void *memcpy(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n)
 {
 	/* Do the buffers overlap in a bad way? */
-	if (src < dest && src + n >= dest) {
-		char *cdest;
-		const char *csrc;
-		int i;
+	if (src < dest && src + n > dest) {
+		unsigned char *cdest;
+		const unsigned char *csrc;
 
-		/* Copy from end to start */
-		cdest = dest + n - 1;
-		csrc = src + n - 1;
-		for (i = 0; i < n; i++) {
-			*cdest-- = *csrc--;
+		/*
+		 * Copy from end to start, aligning the end of the destination
+		 * first if there's much to do. Each word is loaded before
+		 * anything below it is stored, so this works however close
+		 * the buffers are.
+		 */
+		cdest = dest + n;
+		csrc = src + n;
+		while (n >= 32 && ((unsigned long)cdest & 7)) {
+			*--cdest = *--csrc;
+			n--;
+		}
+		while (n >= 32) {
+			const uint64_t *s = (const uint64_t *)(csrc - 32);
+			uint64_t *d = (uint64_t *)(cdest - 32);
+			uint64_t a = s[3], b = s[2], c = s[1], e = s[0];
+
+			d[3] = a;
+			d[2] = b;
+			d[1] = c;
+			d[0] = e;
+			cdest -= 32;
+			csrc -= 32;
+			n -= 32;
+		}
+		while (n >= 8) {
+			cdest -= 8;
+			csrc -= 8;
+			*(uint64_t *)cdest = *(const uint64_t *)csrc;
+			n -= 8;
+		}
+		while (n > 0) {
+			*--cdest = *--csrc;
+			n--;
 		}
 		return dest;
 	} else {
-		/* Normal copy is possible */
+		/* Normal copy is possible, memcpy() works forwards */
 		return memcpy(dest, src, n);
 	}
 }
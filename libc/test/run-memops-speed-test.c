@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * This file is built with the skiboot libc memory functions, renamed so
+ * they don't take over from the system ones, along with the simple loops
+ * they replaced to compare them against.
+ */
+
+#include <config.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define memcpy skiboot_memcpy
+#define memcmp skiboot_memcmp
+#define memmove skiboot_memmove
+#define memcpy_enable_vsx skiboot_memcpy_enable_vsx
+
+#include "../string/memcpy.c"
+#include "../string/memcmp.c"
+#include "../string/memmove.c"
+
+#undef memcpy
+#undef memcmp
+#undef memmove
+
+void *simple_memcpy(void *dest, const void *src, size_t n);
+int simple_memcmp(const void *ptr1, const void *ptr2, size_t n);
+void *simple_memmove(void *dest, const void *src, size_t n);
+
+void *simple_memcpy(void *dest, const void *src, size_t n)
+{
+	void *ret = dest;
+
+	while (n >= 8) {
+		*(uint64_t *)dest = *(uint64_t *)src;
+		dest += 8;
+		src += 8;
+		n -= 8;
+	}
+
+	while (n > 0) {
+		*(uint8_t *)dest = *(uint8_t *)src;
+		dest += 1;
+		src += 1;
+		n -= 1;
+	}
+
+	return ret;
+}
+
+int simple_memcmp(const void *ptr1, const void *ptr2, size_t n)
+{
+	const unsigned char *p1 = ptr1;
+	const unsigned char *p2 = ptr2;
+
+	while (n-- > 0) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
+		p1 += 1;
+		p2 += 1;
+	}
+
+	return 0;
+}
+
+void *simple_memmove(void *dest, const void *src, size_t n)
+{
+	if (src < dest && src + n >= dest) {
+		char *cdest;
+		const char *csrc;
+		int i;
+
+		cdest = dest + n - 1;
+		csrc = src + n - 1;
+		for (i = 0; i < n; i++) {
+			*cdest-- = *csrc--;
+		}
+		return dest;
+	} else {
+		return simple_memcpy(dest, src, n);
+	}
+}
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright 2020 IBM Corp.
+ *
+ * Check the skiboot memcpy(), memcmp() and memmove() against the system
+ * ones over a spread of sizes and alignments, then time them against the
+ * simple loops they replaced.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+void *skiboot_memcpy(void *dest, const void *src, size_t n);
+int skiboot_memcmp(const void *ptr1, const void *ptr2, size_t n);
+void *skiboot_memmove(void *dest, const void *src, size_t n);
+void *simple_memcpy(void *dest, const void *src, size_t n);
+int simple_memcmp(const void *ptr1, const void *ptr2, size_t n);
+void *simple_memmove(void *dest, const void *src, size_t n);
+
+#define BUFSZ		(64 * 1024 + 512)
+#define BENCH_BYTES	(4 * 1024 * 1024)
+
+static unsigned char *a, *b, *ref;
+
+static int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+static void fill(unsigned char *p, size_t n, unsigned int seed)
+{
+	while (n--) {
+		seed = seed * 1103515245 + 12345;
+		*p++ = seed >> 16;
+	}
+}
+
+/* Only look at as much as a check could touch, and a bit past it */
+#define WINDOW(n)	((n) + 128)
+
+static void check_memcpy(size_t n, size_t da, size_t sa)
+{
+	fill(a, WINDOW(n), n + da);
+	fill(b, WINDOW(n), n + sa + 1);
+	memcpy(ref, b, WINDOW(n));
+	memcpy(ref + da, a + sa, n);
+
+	assert(skiboot_memcpy(b + da, a + sa, n) == b + da);
+	assert(memcmp(b, ref, WINDOW(n)) == 0);
+}
+
+static void check_memcmp(size_t n, size_t da, size_t sa)
+{
+	size_t diff;
+
+	fill(a + sa, n, n);
+	memcpy(b + da, a + sa, n);
+	assert(skiboot_memcmp(b + da, a + sa, n) == 0);
+
+	/* Make each byte in turn the first difference, for short ones */
+	for (diff = 0; diff < n; diff += n < 64 ? 1 : 61) {
+		b[da + diff] ^= 0x80;
+		assert(sign(skiboot_memcmp(b + da, a + sa, n)) ==
+		       sign(memcmp(b + da, a + sa, n)));
+		assert(sign(skiboot_memcmp(a + sa, b + da, n)) ==
+		       sign(memcmp(a + sa, b + da, n)));
+		b[da + diff] ^= 0x80;
+	}
+}
+
+static void check_memmove(size_t n, size_t dist, int up)
+{
+	size_t src = up ? 64 : 64 + dist;
+	size_t dest = up ? 64 + dist : 64;
+
+	fill(a, WINDOW(n + dist), n + dist);
+	memcpy(ref, a, WINDOW(n + dist));
+	memmove(ref + dest, ref + src, n);
+
+	assert(skiboot_memmove(a + dest, a + src, n) == a + dest);
+	assert(memcmp(a, ref, WINDOW(n + dist)) == 0);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* MB/s copying or comparing n bytes with the given alignments */
+static unsigned long bench(int op, int simple, size_t n, size_t da, size_t sa)
+{
+	unsigned long i, loops = BENCH_BYTES / n;
+	uint64_t start, ns;
+
+	memcpy(b + da, a + sa, n);
+	start = now_ns();
+	for (i = 0; i < loops; i++) {
+		switch (op) {
+		case 0:
+			(simple ? simple_memcpy : skiboot_memcpy)(b + da,
+								  a + sa, n);
+			break;
+		case 1:
+			assert(!(simple ? simple_memcmp : skiboot_memcmp)(b + da,
+							      a + sa, n));
+			break;
+		case 2:
+			(simple ? simple_memmove : skiboot_memmove)(a + da + 8,
+								    a + sa, n);
+			break;
+		}
+	}
+	ns = now_ns() - start;
+
+	return ns ? loops * n * 1000 / ns : 0;
+}
+
+int main(void)
+{
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+	static const size_t aligns[][2] = { { 0, 0 }, { 0, 3 }, { 5, 0 },
+					    { 7, 1 } };
+	static const char *ops[] = { "memcpy", "memcmp", "memmove" };
+	size_t n, da, sa, i, j;
+	int op, up;
+
+	a = malloc(BUFSZ);
+	b = malloc(BUFSZ);
+	ref = malloc(BUFSZ);
+	assert(a && b && ref);
+
+	for (n = 0; n < 300; n++) {
+		for (da = 0; da < 8; da++) {
+			for (sa = 0; sa < 8; sa++) {
+				check_memcpy(n, da, sa);
+				check_memcmp(n, da, sa);
+			}
+		}
+		for (da = 0; da < 40; da++)
+			for (up = 0; up < 2; up++)
+				check_memmove(n, da, up);
+	}
+	check_memcpy(65536, 0, 0);
+	check_memcpy(65536, 3, 5);
+	check_memcmp(65536, 1, 0);
+	check_memmove(65536, 1, 1);
+	check_memmove(65536, 100, 0);
+
+	fill(a, BUFSZ, 42);
+	printf("%-8s %6s %5s %12s %12s\n", "op", "size", "align",
+	       "simple MB/s", "new MB/s");
+	for (op = 0; op < 3; op++) {
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			for (j = 0; j < sizeof(aligns) / sizeof(aligns[0]); j++) {
+				da = aligns[j][0];
+				sa = aligns[j][1];
+				printf("%-8s %6zu %2zu/%zu %12lu %12lu\n",
+				       ops[op], sizes[i], da, sa,
+				       bench(op, 1, sizes[i], da, sa),
+				       bench(op, 0, sizes[i], da, sa));
+			}
+		}
+	}
+
+	free(a);
+	free(b);
+	free(ref);
+	return 0;
+}
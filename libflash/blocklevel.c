@@ -17,6 +17,9 @@
 
 #define PROT_REALLOC_NUM 25
 
+/* Most data blocklevel_read() reads and strips the ECC from in one go */
+#define ECC_READ_CHUNK 0x10000
+
 /* This function returns tristate values.
  * 1  - The region is ECC protected
  * 0  - The region is not ECC protected
@@ -100,11 +103,36 @@ int blocklevel_raw_read(struct blocklevel_device *bl, uint64_t pos, void *buf, u
 	return rc;
 }
 
+/*
+ * Read one ECC word at ecc_pos and copy len bytes of it, starting skip
+ * bytes in, to dst. Used for the ragged ends of a blocklevel_read().
+ */
+static int ecc_read_word(struct blocklevel_device *bl, uint64_t ecc_pos,
+		uint8_t *dst, uint64_t skip, uint64_t len)
+{
+	struct ecc64 raw;
+	uint64_t data;
+	int rc;
+
+	rc = blocklevel_raw_read(bl, ecc_pos, &raw, sizeof(raw));
+	if (rc)
+		return rc;
+
+	if (memcpy_from_ecc(&data, &raw, sizeof(data))) {
+		errno = EBADF;
+		return FLASH_ERR_ECC_INVALID;
+	}
+
+	memcpy(dst, ((uint8_t *)&data) + skip, len);
+
+	return 0;
+}
+
 int blocklevel_read(struct blocklevel_device *bl, uint64_t pos, void *buf, uint64_t len)
 {
 	int rc, ecc_protection;
-	struct ecc64 *buffer;
-	uint64_t ecc_pos, ecc_start, ecc_diff, ecc_len;
+	uint64_t ecc_pos, ecc_start, ecc_diff, words, raw_len, bytes;
+	uint8_t *dst = buf;
 
 	FL_DBG("%s: 0x%" PRIx64 "\t%p\t0x%" PRIx64 "\n", __func__, pos, buf, len);
 	if (!bl || !buf) {
@@ -135,34 +163,56 @@ int blocklevel_read(struct blocklevel_device *bl, uint64_t pos, void *buf, uint6
 
 	ecc_pos = ecc_buffer_align(ecc_start, pos);
 	ecc_diff = pos - ecc_pos;
-	ecc_len = ecc_buffer_size(len + ecc_diff);
 
 	FL_DBG("%s: adjusted_pos: 0x%" PRIx64 ", ecc_pos: 0x%" PRIx64
-			", ecc_diff: 0x%" PRIx64 ", ecc_len: 0x%" PRIx64 "\n",
-			__func__, pos, ecc_pos, ecc_diff, ecc_len);
-	buffer = malloc(ecc_len);
-	if (!buffer) {
-		errno = ENOMEM;
-		rc = FLASH_ERR_MALLOC_FAILED;
-		goto out;
-	}
+			", ecc_diff: 0x%" PRIx64 "\n",
+			__func__, pos, ecc_pos, ecc_diff);
 
-	rc = blocklevel_raw_read(bl, ecc_pos, buffer, ecc_len);
-	if (rc)
-		goto out;
+	/* Finish off the ECC word the read starts in the middle of */
+	if (ecc_diff) {
+		bytes = MIN(len, BYTES_PER_ECC - ecc_diff);
+		rc = ecc_read_word(bl, ecc_pos, dst, ecc_diff, bytes);
+		if (rc)
+			return rc;
+
+		ecc_pos += sizeof(struct ecc64);
+		dst += bytes;
+		len -= bytes;
+	}
 
 	/*
-	 * Could optimise and simply call memcpy_from_ecc() if ecc_diff
-	 * == 0 but _unaligned checks and bascially does that for us
+	 * Read whole words straight into buf and strip the ECC in place,
+	 * rather than going through a copy of the whole raw region.
+	 * Stripping turns nine bytes into eight, so it never overtakes what
+	 * it has still to read, but the raw words have to fit in what's
+	 * left of buf. That's eight ninths of the remainder each time round,
+	 * so the reads get shorter towards the end and the last word goes
+	 * through the stack.
 	 */
-	if (memcpy_from_ecc_unaligned(buf, buffer, len, ecc_diff)) {
-		errno = EBADF;
-		rc = FLASH_ERR_ECC_INVALID;
+	while (len >= sizeof(struct ecc64)) {
+		words = MIN(len / sizeof(struct ecc64),
+			    ECC_READ_CHUNK / BYTES_PER_ECC);
+		raw_len = words * sizeof(struct ecc64);
+		bytes = words * BYTES_PER_ECC;
+
+		rc = blocklevel_raw_read(bl, ecc_pos, dst, raw_len);
+		if (rc)
+			return rc;
+
+		if (memcpy_from_ecc((uint64_t *)dst, (struct ecc64 *)dst, bytes)) {
+			errno = EBADF;
+			return FLASH_ERR_ECC_INVALID;
+		}
+
+		ecc_pos += raw_len;
+		dst += bytes;
+		len -= bytes;
 	}
 
-out:
-	free(buffer);
-	return rc;
+	if (len)
+		return ecc_read_word(bl, ecc_pos, dst, 0, len);
+
+	return 0;
 }
 
 int blocklevel_raw_write(struct blocklevel_device *bl, uint64_t pos,
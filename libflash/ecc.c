@@ -14,6 +14,9 @@
 #include "libflash.h"
 #include "ecc.h"
 
+/* Words memcpy_{to,from}_ecc() handle per iteration */
+#define ECC_BLOCK_WORDS	4
+
 /* Bit field identifiers for syndrome calculations. */
 enum eccbitfields
 {
@@ -42,9 +45,10 @@ enum eccbitfields
  *  Note: To make the math easier (and less shifts in resulting code),
  *        row0 = ECC7.  HW numbering is MSB, order here is LSB.
  *
- *  These values come from the HW design of the ECC algorithm.
+ *  These values come from the HW design of the ECC algorithm.  The
+ *  code uses ecctable below, this is what it was generated from.
  */
-static uint64_t eccmatrix[] = {
+static const uint64_t eccmatrix[] __attribute__((unused)) = {
         0x0000e8423c0f99ffull,
         0x00e8423c0f99ff00ull,
         0xe8423c0f99ff0000ull,
@@ -55,6 +59,292 @@ static uint64_t eccmatrix[] = {
         0xff0000e8423c0f99ull
 };
 
+/*
+ * Byte-sliced form of eccmatrix.
+ *
+ *  The ECC is linear in the data, so the ECC of a word is the XOR of
+ *  the ECC each of its bytes would have on its own in that position:
+ *
+ *    ecctable[n][b] = eccgenerate(b << (8 * n))
+ *
+ *  where byte 0 is the least significant.  test-ecc checks every entry
+ *  against eccmatrix.
+ */
+static const uint8_t ecctable[8][256] = {
+	{
+		0x00, 0xc1, 0x51, 0x90, 0x61, 0xa0, 0x30, 0xf1,
+		0xe9, 0x28, 0xb8, 0x79, 0x88, 0x49, 0xd9, 0x18,
+		0xa1, 0x60, 0xf0, 0x31, 0xc0, 0x01, 0x91, 0x50,
+		0x48, 0x89, 0x19, 0xd8, 0x29, 0xe8, 0x78, 0xb9,
+		0x29, 0xe8, 0x78, 0xb9, 0x48, 0x89, 0x19, 0xd8,
+		0xc0, 0x01, 0x91, 0x50, 0xa1, 0x60, 0xf0, 0x31,
+		0x88, 0x49, 0xd9, 0x18, 0xe9, 0x28, 0xb8, 0x79,
+		0x61, 0xa0, 0x30, 0xf1, 0x00, 0xc1, 0x51, 0x90,
+		0x19, 0xd8, 0x48, 0x89, 0x78, 0xb9, 0x29, 0xe8,
+		0xf0, 0x31, 0xa1, 0x60, 0x91, 0x50, 0xc0, 0x01,
+		0xb8, 0x79, 0xe9, 0x28, 0xd9, 0x18, 0x88, 0x49,
+		0x51, 0x90, 0x00, 0xc1, 0x30, 0xf1, 0x61, 0xa0,
+		0x30, 0xf1, 0x61, 0xa0, 0x51, 0x90, 0x00, 0xc1,
+		0xd9, 0x18, 0x88, 0x49, 0xb8, 0x79, 0xe9, 0x28,
+		0x91, 0x50, 0xc0, 0x01, 0xf0, 0x31, 0xa1, 0x60,
+		0x78, 0xb9, 0x29, 0xe8, 0x19, 0xd8, 0x48, 0x89,
+		0x89, 0x48, 0xd8, 0x19, 0xe8, 0x29, 0xb9, 0x78,
+		0x60, 0xa1, 0x31, 0xf0, 0x01, 0xc0, 0x50, 0x91,
+		0x28, 0xe9, 0x79, 0xb8, 0x49, 0x88, 0x18, 0xd9,
+		0xc1, 0x00, 0x90, 0x51, 0xa0, 0x61, 0xf1, 0x30,
+		0xa0, 0x61, 0xf1, 0x30, 0xc1, 0x00, 0x90, 0x51,
+		0x49, 0x88, 0x18, 0xd9, 0x28, 0xe9, 0x79, 0xb8,
+		0x01, 0xc0, 0x50, 0x91, 0x60, 0xa1, 0x31, 0xf0,
+		0xe8, 0x29, 0xb9, 0x78, 0x89, 0x48, 0xd8, 0x19,
+		0x90, 0x51, 0xc1, 0x00, 0xf1, 0x30, 0xa0, 0x61,
+		0x79, 0xb8, 0x28, 0xe9, 0x18, 0xd9, 0x49, 0x88,
+		0x31, 0xf0, 0x60, 0xa1, 0x50, 0x91, 0x01, 0xc0,
+		0xd8, 0x19, 0x89, 0x48, 0xb9, 0x78, 0xe8, 0x29,
+		0xb9, 0x78, 0xe8, 0x29, 0xd8, 0x19, 0x89, 0x48,
+		0x50, 0x91, 0x01, 0xc0, 0x31, 0xf0, 0x60, 0xa1,
+		0x18, 0xd9, 0x49, 0x88, 0x79, 0xb8, 0x28, 0xe9,
+		0xf1, 0x30, 0xa0, 0x61, 0x90, 0x51, 0xc1, 0x00,
+	},
+	{
+		0x00, 0x83, 0xa2, 0x21, 0xc2, 0x41, 0x60, 0xe3,
+		0xd3, 0x50, 0x71, 0xf2, 0x11, 0x92, 0xb3, 0x30,
+		0x43, 0xc0, 0xe1, 0x62, 0x81, 0x02, 0x23, 0xa0,
+		0x90, 0x13, 0x32, 0xb1, 0x52, 0xd1, 0xf0, 0x73,
+		0x52, 0xd1, 0xf0, 0x73, 0x90, 0x13, 0x32, 0xb1,
+		0x81, 0x02, 0x23, 0xa0, 0x43, 0xc0, 0xe1, 0x62,
+		0x11, 0x92, 0xb3, 0x30, 0xd3, 0x50, 0x71, 0xf2,
+		0xc2, 0x41, 0x60, 0xe3, 0x00, 0x83, 0xa2, 0x21,
+		0x32, 0xb1, 0x90, 0x13, 0xf0, 0x73, 0x52, 0xd1,
+		0xe1, 0x62, 0x43, 0xc0, 0x23, 0xa0, 0x81, 0x02,
+		0x71, 0xf2, 0xd3, 0x50, 0xb3, 0x30, 0x11, 0x92,
+		0xa2, 0x21, 0x00, 0x83, 0x60, 0xe3, 0xc2, 0x41,
+		0x60, 0xe3, 0xc2, 0x41, 0xa2, 0x21, 0x00, 0x83,
+		0xb3, 0x30, 0x11, 0x92, 0x71, 0xf2, 0xd3, 0x50,
+		0x23, 0xa0, 0x81, 0x02, 0xe1, 0x62, 0x43, 0xc0,
+		0xf0, 0x73, 0x52, 0xd1, 0x32, 0xb1, 0x90, 0x13,
+		0x13, 0x90, 0xb1, 0x32, 0xd1, 0x52, 0x73, 0xf0,
+		0xc0, 0x43, 0x62, 0xe1, 0x02, 0x81, 0xa0, 0x23,
+		0x50, 0xd3, 0xf2, 0x71, 0x92, 0x11, 0x30, 0xb3,
+		0x83, 0x00, 0x21, 0xa2, 0x41, 0xc2, 0xe3, 0x60,
+		0x41, 0xc2, 0xe3, 0x60, 0x83, 0x00, 0x21, 0xa2,
+		0x92, 0x11, 0x30, 0xb3, 0x50, 0xd3, 0xf2, 0x71,
+		0x02, 0x81, 0xa0, 0x23, 0xc0, 0x43, 0x62, 0xe1,
+		0xd1, 0x52, 0x73, 0xf0, 0x13, 0x90, 0xb1, 0x32,
+		0x21, 0xa2, 0x83, 0x00, 0xe3, 0x60, 0x41, 0xc2,
+		0xf2, 0x71, 0x50, 0xd3, 0x30, 0xb3, 0x92, 0x11,
+		0x62, 0xe1, 0xc0, 0x43, 0xa0, 0x23, 0x02, 0x81,
+		0xb1, 0x32, 0x13, 0x90, 0x73, 0xf0, 0xd1, 0x52,
+		0x73, 0xf0, 0xd1, 0x52, 0xb1, 0x32, 0x13, 0x90,
+		0xa0, 0x23, 0x02, 0x81, 0x62, 0xe1, 0xc0, 0x43,
+		0x30, 0xb3, 0x92, 0x11, 0xf2, 0x71, 0x50, 0xd3,
+		0xe3, 0x60, 0x41, 0xc2, 0x21, 0xa2, 0x83, 0x00,
+	},
+	{
+		0x00, 0x07, 0x45, 0x42, 0x85, 0x82, 0xc0, 0xc7,
+		0xa7, 0xa0, 0xe2, 0xe5, 0x22, 0x25, 0x67, 0x60,
+		0x86, 0x81, 0xc3, 0xc4, 0x03, 0x04, 0x46, 0x41,
+		0x21, 0x26, 0x64, 0x63, 0xa4, 0xa3, 0xe1, 0xe6,
+		0xa4, 0xa3, 0xe1, 0xe6, 0x21, 0x26, 0x64, 0x63,
+		0x03, 0x04, 0x46, 0x41, 0x86, 0x81, 0xc3, 0xc4,
+		0x22, 0x25, 0x67, 0x60, 0xa7, 0xa0, 0xe2, 0xe5,
+		0x85, 0x82, 0xc0, 0xc7, 0x00, 0x07, 0x45, 0x42,
+		0x64, 0x63, 0x21, 0x26, 0xe1, 0xe6, 0xa4, 0xa3,
+		0xc3, 0xc4, 0x86, 0x81, 0x46, 0x41, 0x03, 0x04,
+		0xe2, 0xe5, 0xa7, 0xa0, 0x67, 0x60, 0x22, 0x25,
+		0x45, 0x42, 0x00, 0x07, 0xc0, 0xc7, 0x85, 0x82,
+		0xc0, 0xc7, 0x85, 0x82, 0x45, 0x42, 0x00, 0x07,
+		0x67, 0x60, 0x22, 0x25, 0xe2, 0xe5, 0xa7, 0xa0,
+		0x46, 0x41, 0x03, 0x04, 0xc3, 0xc4, 0x86, 0x81,
+		0xe1, 0xe6, 0xa4, 0xa3, 0x64, 0x63, 0x21, 0x26,
+		0x26, 0x21, 0x63, 0x64, 0xa3, 0xa4, 0xe6, 0xe1,
+		0x81, 0x86, 0xc4, 0xc3, 0x04, 0x03, 0x41, 0x46,
+		0xa0, 0xa7, 0xe5, 0xe2, 0x25, 0x22, 0x60, 0x67,
+		0x07, 0x00, 0x42, 0x45, 0x82, 0x85, 0xc7, 0xc0,
+		0x82, 0x85, 0xc7, 0xc0, 0x07, 0x00, 0x42, 0x45,
+		0x25, 0x22, 0x60, 0x67, 0xa0, 0xa7, 0xe5, 0xe2,
+		0x04, 0x03, 0x41, 0x46, 0x81, 0x86, 0xc4, 0xc3,
+		0xa3, 0xa4, 0xe6, 0xe1, 0x26, 0x21, 0x63, 0x64,
+		0x42, 0x45, 0x07, 0x00, 0xc7, 0xc0, 0x82, 0x85,
+		0xe5, 0xe2, 0xa0, 0xa7, 0x60, 0x67, 0x25, 0x22,
+		0xc4, 0xc3, 0x81, 0x86, 0x41, 0x46, 0x04, 0x03,
+		0x63, 0x64, 0x26, 0x21, 0xe6, 0xe1, 0xa3, 0xa4,
+		0xe6, 0xe1, 0xa3, 0xa4, 0x63, 0x64, 0x26, 0x21,
+		0x41, 0x46, 0x04, 0x03, 0xc4, 0xc3, 0x81, 0x86,
+		0x60, 0x67, 0x25, 0x22, 0xe5, 0xe2, 0xa0, 0xa7,
+		0xc7, 0xc0, 0x82, 0x85, 0x42, 0x45, 0x07, 0x00,
+	},
+	{
+		0x00, 0x0e, 0x8a, 0x84, 0x0b, 0x05, 0x81, 0x8f,
+		0x4f, 0x41, 0xc5, 0xcb, 0x44, 0x4a, 0xce, 0xc0,
+		0x0d, 0x03, 0x87, 0x89, 0x06, 0x08, 0x8c, 0x82,
+		0x42, 0x4c, 0xc8, 0xc6, 0x49, 0x47, 0xc3, 0xcd,
+		0x49, 0x47, 0xc3, 0xcd, 0x42, 0x4c, 0xc8, 0xc6,
+		0x06, 0x08, 0x8c, 0x82, 0x0d, 0x03, 0x87, 0x89,
+		0x44, 0x4a, 0xce, 0xc0, 0x4f, 0x41, 0xc5, 0xcb,
+		0x0b, 0x05, 0x81, 0x8f, 0x00, 0x0e, 0x8a, 0x84,
+		0xc8, 0xc6, 0x42, 0x4c, 0xc3, 0xcd, 0x49, 0x47,
+		0x87, 0x89, 0x0d, 0x03, 0x8c, 0x82, 0x06, 0x08,
+		0xc5, 0xcb, 0x4f, 0x41, 0xce, 0xc0, 0x44, 0x4a,
+		0x8a, 0x84, 0x00, 0x0e, 0x81, 0x8f, 0x0b, 0x05,
+		0x81, 0x8f, 0x0b, 0x05, 0x8a, 0x84, 0x00, 0x0e,
+		0xce, 0xc0, 0x44, 0x4a, 0xc5, 0xcb, 0x4f, 0x41,
+		0x8c, 0x82, 0x06, 0x08, 0x87, 0x89, 0x0d, 0x03,
+		0xc3, 0xcd, 0x49, 0x47, 0xc8, 0xc6, 0x42, 0x4c,
+		0x4c, 0x42, 0xc6, 0xc8, 0x47, 0x49, 0xcd, 0xc3,
+		0x03, 0x0d, 0x89, 0x87, 0x08, 0x06, 0x82, 0x8c,
+		0x41, 0x4f, 0xcb, 0xc5, 0x4a, 0x44, 0xc0, 0xce,
+		0x0e, 0x00, 0x84, 0x8a, 0x05, 0x0b, 0x8f, 0x81,
+		0x05, 0x0b, 0x8f, 0x81, 0x0e, 0x00, 0x84, 0x8a,
+		0x4a, 0x44, 0xc0, 0xce, 0x41, 0x4f, 0xcb, 0xc5,
+		0x08, 0x06, 0x82, 0x8c, 0x03, 0x0d, 0x89, 0x87,
+		0x47, 0x49, 0xcd, 0xc3, 0x4c, 0x42, 0xc6, 0xc8,
+		0x84, 0x8a, 0x0e, 0x00, 0x8f, 0x81, 0x05, 0x0b,
+		0xcb, 0xc5, 0x41, 0x4f, 0xc0, 0xce, 0x4a, 0x44,
+		0x89, 0x87, 0x03, 0x0d, 0x82, 0x8c, 0x08, 0x06,
+		0xc6, 0xc8, 0x4c, 0x42, 0xcd, 0xc3, 0x47, 0x49,
+		0xcd, 0xc3, 0x47, 0x49, 0xc6, 0xc8, 0x4c, 0x42,
+		0x82, 0x8c, 0x08, 0x06, 0x89, 0x87, 0x03, 0x0d,
+		0xc0, 0xce, 0x4a, 0x44, 0xcb, 0xc5, 0x41, 0x4f,
+		0x8f, 0x81, 0x05, 0x0b, 0x84, 0x8a, 0x0e, 0x00,
+	},
+	{
+		0x00, 0x1c, 0x15, 0x09, 0x16, 0x0a, 0x03, 0x1f,
+		0x9e, 0x82, 0x8b, 0x97, 0x88, 0x94, 0x9d, 0x81,
+		0x1a, 0x06, 0x0f, 0x13, 0x0c, 0x10, 0x19, 0x05,
+		0x84, 0x98, 0x91, 0x8d, 0x92, 0x8e, 0x87, 0x9b,
+		0x92, 0x8e, 0x87, 0x9b, 0x84, 0x98, 0x91, 0x8d,
+		0x0c, 0x10, 0x19, 0x05, 0x1a, 0x06, 0x0f, 0x13,
+		0x88, 0x94, 0x9d, 0x81, 0x9e, 0x82, 0x8b, 0x97,
+		0x16, 0x0a, 0x03, 0x1f, 0x00, 0x1c, 0x15, 0x09,
+		0x91, 0x8d, 0x84, 0x98, 0x87, 0x9b, 0x92, 0x8e,
+		0x0f, 0x13, 0x1a, 0x06, 0x19, 0x05, 0x0c, 0x10,
+		0x8b, 0x97, 0x9e, 0x82, 0x9d, 0x81, 0x88, 0x94,
+		0x15, 0x09, 0x00, 0x1c, 0x03, 0x1f, 0x16, 0x0a,
+		0x03, 0x1f, 0x16, 0x0a, 0x15, 0x09, 0x00, 0x1c,
+		0x9d, 0x81, 0x88, 0x94, 0x8b, 0x97, 0x9e, 0x82,
+		0x19, 0x05, 0x0c, 0x10, 0x0f, 0x13, 0x1a, 0x06,
+		0x87, 0x9b, 0x92, 0x8e, 0x91, 0x8d, 0x84, 0x98,
+		0x98, 0x84, 0x8d, 0x91, 0x8e, 0x92, 0x9b, 0x87,
+		0x06, 0x1a, 0x13, 0x0f, 0x10, 0x0c, 0x05, 0x19,
+		0x82, 0x9e, 0x97, 0x8b, 0x94, 0x88, 0x81, 0x9d,
+		0x1c, 0x00, 0x09, 0x15, 0x0a, 0x16, 0x1f, 0x03,
+		0x0a, 0x16, 0x1f, 0x03, 0x1c, 0x00, 0x09, 0x15,
+		0x94, 0x88, 0x81, 0x9d, 0x82, 0x9e, 0x97, 0x8b,
+		0x10, 0x0c, 0x05, 0x19, 0x06, 0x1a, 0x13, 0x0f,
+		0x8e, 0x92, 0x9b, 0x87, 0x98, 0x84, 0x8d, 0x91,
+		0x09, 0x15, 0x1c, 0x00, 0x1f, 0x03, 0x0a, 0x16,
+		0x97, 0x8b, 0x82, 0x9e, 0x81, 0x9d, 0x94, 0x88,
+		0x13, 0x0f, 0x06, 0x1a, 0x05, 0x19, 0x10, 0x0c,
+		0x8d, 0x91, 0x98, 0x84, 0x9b, 0x87, 0x8e, 0x92,
+		0x9b, 0x87, 0x8e, 0x92, 0x8d, 0x91, 0x98, 0x84,
+		0x05, 0x19, 0x10, 0x0c, 0x13, 0x0f, 0x06, 0x1a,
+		0x81, 0x9d, 0x94, 0x88, 0x97, 0x8b, 0x82, 0x9e,
+		0x1f, 0x03, 0x0a, 0x16, 0x09, 0x15, 0x1c, 0x00,
+	},
+	{
+		0x00, 0x38, 0x2a, 0x12, 0x2c, 0x14, 0x06, 0x3e,
+		0x3d, 0x05, 0x17, 0x2f, 0x11, 0x29, 0x3b, 0x03,
+		0x34, 0x0c, 0x1e, 0x26, 0x18, 0x20, 0x32, 0x0a,
+		0x09, 0x31, 0x23, 0x1b, 0x25, 0x1d, 0x0f, 0x37,
+		0x25, 0x1d, 0x0f, 0x37, 0x09, 0x31, 0x23, 0x1b,
+		0x18, 0x20, 0x32, 0x0a, 0x34, 0x0c, 0x1e, 0x26,
+		0x11, 0x29, 0x3b, 0x03, 0x3d, 0x05, 0x17, 0x2f,
+		0x2c, 0x14, 0x06, 0x3e, 0x00, 0x38, 0x2a, 0x12,
+		0x23, 0x1b, 0x09, 0x31, 0x0f, 0x37, 0x25, 0x1d,
+		0x1e, 0x26, 0x34, 0x0c, 0x32, 0x0a, 0x18, 0x20,
+		0x17, 0x2f, 0x3d, 0x05, 0x3b, 0x03, 0x11, 0x29,
+		0x2a, 0x12, 0x00, 0x38, 0x06, 0x3e, 0x2c, 0x14,
+		0x06, 0x3e, 0x2c, 0x14, 0x2a, 0x12, 0x00, 0x38,
+		0x3b, 0x03, 0x11, 0x29, 0x17, 0x2f, 0x3d, 0x05,
+		0x32, 0x0a, 0x18, 0x20, 0x1e, 0x26, 0x34, 0x0c,
+		0x0f, 0x37, 0x25, 0x1d, 0x23, 0x1b, 0x09, 0x31,
+		0x31, 0x09, 0x1b, 0x23, 0x1d, 0x25, 0x37, 0x0f,
+		0x0c, 0x34, 0x26, 0x1e, 0x20, 0x18, 0x0a, 0x32,
+		0x05, 0x3d, 0x2f, 0x17, 0x29, 0x11, 0x03, 0x3b,
+		0x38, 0x00, 0x12, 0x2a, 0x14, 0x2c, 0x3e, 0x06,
+		0x14, 0x2c, 0x3e, 0x06, 0x38, 0x00, 0x12, 0x2a,
+		0x29, 0x11, 0x03, 0x3b, 0x05, 0x3d, 0x2f, 0x17,
+		0x20, 0x18, 0x0a, 0x32, 0x0c, 0x34, 0x26, 0x1e,
+		0x1d, 0x25, 0x37, 0x0f, 0x31, 0x09, 0x1b, 0x23,
+		0x12, 0x2a, 0x38, 0x00, 0x3e, 0x06, 0x14, 0x2c,
+		0x2f, 0x17, 0x05, 0x3d, 0x03, 0x3b, 0x29, 0x11,
+		0x26, 0x1e, 0x0c, 0x34, 0x0a, 0x32, 0x20, 0x18,
+		0x1b, 0x23, 0x31, 0x09, 0x37, 0x0f, 0x1d, 0x25,
+		0x37, 0x0f, 0x1d, 0x25, 0x1b, 0x23, 0x31, 0x09,
+		0x0a, 0x32, 0x20, 0x18, 0x26, 0x1e, 0x0c, 0x34,
+		0x03, 0x3b, 0x29, 0x11, 0x2f, 0x17, 0x05, 0x3d,
+		0x3e, 0x06, 0x14, 0x2c, 0x12, 0x2a, 0x38, 0x00,
+	},
+	{
+		0x00, 0x70, 0x54, 0x24, 0x58, 0x28, 0x0c, 0x7c,
+		0x7a, 0x0a, 0x2e, 0x5e, 0x22, 0x52, 0x76, 0x06,
+		0x68, 0x18, 0x3c, 0x4c, 0x30, 0x40, 0x64, 0x14,
+		0x12, 0x62, 0x46, 0x36, 0x4a, 0x3a, 0x1e, 0x6e,
+		0x4a, 0x3a, 0x1e, 0x6e, 0x12, 0x62, 0x46, 0x36,
+		0x30, 0x40, 0x64, 0x14, 0x68, 0x18, 0x3c, 0x4c,
+		0x22, 0x52, 0x76, 0x06, 0x7a, 0x0a, 0x2e, 0x5e,
+		0x58, 0x28, 0x0c, 0x7c, 0x00, 0x70, 0x54, 0x24,
+		0x46, 0x36, 0x12, 0x62, 0x1e, 0x6e, 0x4a, 0x3a,
+		0x3c, 0x4c, 0x68, 0x18, 0x64, 0x14, 0x30, 0x40,
+		0x2e, 0x5e, 0x7a, 0x0a, 0x76, 0x06, 0x22, 0x52,
+		0x54, 0x24, 0x00, 0x70, 0x0c, 0x7c, 0x58, 0x28,
+		0x0c, 0x7c, 0x58, 0x28, 0x54, 0x24, 0x00, 0x70,
+		0x76, 0x06, 0x22, 0x52, 0x2e, 0x5e, 0x7a, 0x0a,
+		0x64, 0x14, 0x30, 0x40, 0x3c, 0x4c, 0x68, 0x18,
+		0x1e, 0x6e, 0x4a, 0x3a, 0x46, 0x36, 0x12, 0x62,
+		0x62, 0x12, 0x36, 0x46, 0x3a, 0x4a, 0x6e, 0x1e,
+		0x18, 0x68, 0x4c, 0x3c, 0x40, 0x30, 0x14, 0x64,
+		0x0a, 0x7a, 0x5e, 0x2e, 0x52, 0x22, 0x06, 0x76,
+		0x70, 0x00, 0x24, 0x54, 0x28, 0x58, 0x7c, 0x0c,
+		0x28, 0x58, 0x7c, 0x0c, 0x70, 0x00, 0x24, 0x54,
+		0x52, 0x22, 0x06, 0x76, 0x0a, 0x7a, 0x5e, 0x2e,
+		0x40, 0x30, 0x14, 0x64, 0x18, 0x68, 0x4c, 0x3c,
+		0x3a, 0x4a, 0x6e, 0x1e, 0x62, 0x12, 0x36, 0x46,
+		0x24, 0x54, 0x70, 0x00, 0x7c, 0x0c, 0x28, 0x58,
+		0x5e, 0x2e, 0x0a, 0x7a, 0x06, 0x76, 0x52, 0x22,
+		0x4c, 0x3c, 0x18, 0x68, 0x14, 0x64, 0x40, 0x30,
+		0x36, 0x46, 0x62, 0x12, 0x6e, 0x1e, 0x3a, 0x4a,
+		0x6e, 0x1e, 0x3a, 0x4a, 0x36, 0x46, 0x62, 0x12,
+		0x14, 0x64, 0x40, 0x30, 0x4c, 0x3c, 0x18, 0x68,
+		0x06, 0x76, 0x52, 0x22, 0x5e, 0x2e, 0x0a, 0x7a,
+		0x7c, 0x0c, 0x28, 0x58, 0x24, 0x54, 0x70, 0x00,
+	},
+	{
+		0x00, 0xe0, 0xa8, 0x48, 0xb0, 0x50, 0x18, 0xf8,
+		0xf4, 0x14, 0x5c, 0xbc, 0x44, 0xa4, 0xec, 0x0c,
+		0xd0, 0x30, 0x78, 0x98, 0x60, 0x80, 0xc8, 0x28,
+		0x24, 0xc4, 0x8c, 0x6c, 0x94, 0x74, 0x3c, 0xdc,
+		0x94, 0x74, 0x3c, 0xdc, 0x24, 0xc4, 0x8c, 0x6c,
+		0x60, 0x80, 0xc8, 0x28, 0xd0, 0x30, 0x78, 0x98,
+		0x44, 0xa4, 0xec, 0x0c, 0xf4, 0x14, 0x5c, 0xbc,
+		0xb0, 0x50, 0x18, 0xf8, 0x00, 0xe0, 0xa8, 0x48,
+		0x8c, 0x6c, 0x24, 0xc4, 0x3c, 0xdc, 0x94, 0x74,
+		0x78, 0x98, 0xd0, 0x30, 0xc8, 0x28, 0x60, 0x80,
+		0x5c, 0xbc, 0xf4, 0x14, 0xec, 0x0c, 0x44, 0xa4,
+		0xa8, 0x48, 0x00, 0xe0, 0x18, 0xf8, 0xb0, 0x50,
+		0x18, 0xf8, 0xb0, 0x50, 0xa8, 0x48, 0x00, 0xe0,
+		0xec, 0x0c, 0x44, 0xa4, 0x5c, 0xbc, 0xf4, 0x14,
+		0xc8, 0x28, 0x60, 0x80, 0x78, 0x98, 0xd0, 0x30,
+		0x3c, 0xdc, 0x94, 0x74, 0x8c, 0x6c, 0x24, 0xc4,
+		0xc4, 0x24, 0x6c, 0x8c, 0x74, 0x94, 0xdc, 0x3c,
+		0x30, 0xd0, 0x98, 0x78, 0x80, 0x60, 0x28, 0xc8,
+		0x14, 0xf4, 0xbc, 0x5c, 0xa4, 0x44, 0x0c, 0xec,
+		0xe0, 0x00, 0x48, 0xa8, 0x50, 0xb0, 0xf8, 0x18,
+		0x50, 0xb0, 0xf8, 0x18, 0xe0, 0x00, 0x48, 0xa8,
+		0xa4, 0x44, 0x0c, 0xec, 0x14, 0xf4, 0xbc, 0x5c,
+		0x80, 0x60, 0x28, 0xc8, 0x30, 0xd0, 0x98, 0x78,
+		0x74, 0x94, 0xdc, 0x3c, 0xc4, 0x24, 0x6c, 0x8c,
+		0x48, 0xa8, 0xe0, 0x00, 0xf8, 0x18, 0x50, 0xb0,
+		0xbc, 0x5c, 0x14, 0xf4, 0x0c, 0xec, 0xa4, 0x44,
+		0x98, 0x78, 0x30, 0xd0, 0x28, 0xc8, 0x80, 0x60,
+		0x6c, 0x8c, 0xc4, 0x24, 0xdc, 0x3c, 0x74, 0x94,
+		0xdc, 0x3c, 0x74, 0x94, 0x6c, 0x8c, 0xc4, 0x24,
+		0x28, 0xc8, 0x80, 0x60, 0x98, 0x78, 0x30, 0xd0,
+		0x0c, 0xec, 0xa4, 0x44, 0xbc, 0x5c, 0x14, 0xf4,
+		0xf8, 0x18, 0x50, 0xb0, 0x48, 0xa8, 0xe0, 0x00,
+	},
+};
+
 /**
  * Syndrome calculation matrix.
  *
@@ -107,13 +397,14 @@ static enum eccbitfields syndromematrix[] = {
  */
 static uint8_t eccgenerate(uint64_t data)
 {
-	int i;
-	uint8_t result = 0;
-
-	for (i = 0; i < 8; i++)
-		result |= __builtin_parityll(eccmatrix[i] & data) << i;
-
-	return result;
+	return ecctable[0][data & 0xff] ^
+	       ecctable[1][(data >> 8) & 0xff] ^
+	       ecctable[2][(data >> 16) & 0xff] ^
+	       ecctable[3][(data >> 24) & 0xff] ^
+	       ecctable[4][(data >> 32) & 0xff] ^
+	       ecctable[5][(data >> 40) & 0xff] ^
+	       ecctable[6][(data >> 48) & 0xff] ^
+	       ecctable[7][data >> 56];
 }
 
 /**
@@ -195,6 +486,9 @@ static uint64_t whole_ecc_structs(uint64_t i)
  * @len:	number of bytes of data to copy (without ecc).
  *                   Must be 8 byte aligned.
  *
+ * dst may be the same as src to strip the ECC in place, each word is
+ * read before anything is written over it.
+ *
  * @return:	Success or error
  *
  * @retval: 0 - success
@@ -214,7 +508,36 @@ int memcpy_from_ecc(uint64_t *dst, struct ecc64 *src, uint64_t len)
 	/* Handle in chunks of 8 bytes, so adjust the length */
 	len >>= 3;
 
-	for (i = 0; i < len; i++) {
+	/*
+	 * Almost everything we read is clean, so check a few words at once
+	 * and only go a word at a time to correct (or complain) when any of
+	 * them doesn't match its ECC.
+	 */
+	for (i = 0; i + ECC_BLOCK_WORDS <= len; i += ECC_BLOCK_WORDS) {
+		struct ecc64 *s = src + i;
+		uint8_t bad;
+		int j, rc;
+
+		bad = (eccgenerate(be64_to_cpu(s[0].data)) ^ s[0].ecc) |
+		      (eccgenerate(be64_to_cpu(s[1].data)) ^ s[1].ecc) |
+		      (eccgenerate(be64_to_cpu(s[2].data)) ^ s[2].ecc) |
+		      (eccgenerate(be64_to_cpu(s[3].data)) ^ s[3].ecc);
+		if (!bad) {
+			dst[0] = s[0].data;
+			dst[1] = s[1].data;
+			dst[2] = s[2].data;
+			dst[3] = s[3].data;
+		} else {
+			for (j = 0; j < ECC_BLOCK_WORDS; j++) {
+				rc = eccbyte(dst + j, s + j);
+				if (rc)
+					return rc;
+			}
+		}
+		dst += ECC_BLOCK_WORDS;
+	}
+
+	for (; i < len; i++) {
 		int rc;
 		rc = eccbyte(dst, src + i);
 		if (rc)
@@ -338,7 +661,21 @@ int memcpy_to_ecc(struct ecc64 *dst, const uint64_t *src, uint64_t len)
 	/* Handle in chunks of 8 bytes, so adjust the length */
 	len >>= 3;
 
-	for (i = 0; i < len; i++) {
+	for (i = 0; i + ECC_BLOCK_WORDS <= len; i += ECC_BLOCK_WORDS) {
+		uint64_t d0 = src[i], d1 = src[i + 1];
+		uint64_t d2 = src[i + 2], d3 = src[i + 3];
+
+		dst[i].ecc = eccgenerate(be64_to_cpu(d0));
+		dst[i].data = d0;
+		dst[i + 1].ecc = eccgenerate(be64_to_cpu(d1));
+		dst[i + 1].data = d1;
+		dst[i + 2].ecc = eccgenerate(be64_to_cpu(d2));
+		dst[i + 2].data = d2;
+		dst[i + 3].ecc = eccgenerate(be64_to_cpu(d3));
+		dst[i + 3].data = d3;
+	}
+
+	for (; i < len; i++) {
 		ecc_word.ecc = eccgenerate(be64_to_cpu(*(src + i)));
 		ecc_word.data = *(src + i);
 
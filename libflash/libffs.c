@@ -23,6 +23,9 @@ struct ffs_handle {
 	/* The converted header knows how big this is */
 	struct __ffs_hdr *cache;
 	struct blocklevel_device *bl;
+	/* Open addressed hash of partition names, entry index + 1 */
+	uint32_t		*name_index;
+	uint32_t		name_index_mask;
 };
 
 static uint32_t ffs_checksum(void* data, size_t size)
@@ -57,6 +60,54 @@ static int ffs_num_entries(struct ffs_hdr *hdr)
 	return hdr->count;
 }
 
+/* FNV-1a over at most the FFS_PART_NAME_MAX characters names compare on */
+static uint32_t ffs_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < FFS_PART_NAME_MAX && name[i]; i++) {
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * Index the partition names so ffs_lookup_part() doesn't have to compare
+ * against every one of them. If there are duplicate names the first one
+ * wins, as it would with a linear search. Failing to allocate the index
+ * isn't fatal, lookups just go back to searching.
+ */
+static void ffs_build_name_index(struct ffs_handle *ffs)
+{
+	uint32_t i, size = 8, slot;
+
+	while (size < ffs->hdr.count * 2)
+		size <<= 1;
+
+	ffs->name_index = calloc(size, sizeof(*ffs->name_index));
+	if (!ffs->name_index)
+		return;
+	ffs->name_index_mask = size - 1;
+
+	for (i = 0; i < ffs->hdr.count; i++) {
+		const char *name = ffs->hdr.entries[i]->name;
+
+		slot = ffs_name_hash(name) & ffs->name_index_mask;
+		while (ffs->name_index[slot]) {
+			if (!strncmp(name,
+				     ffs->hdr.entries[ffs->name_index[slot] - 1]->name,
+				     FFS_PART_NAME_MAX))
+				break;
+			slot = (slot + 1) & ffs->name_index_mask;
+		}
+		if (!ffs->name_index[slot])
+			ffs->name_index[slot] = i + 1;
+	}
+}
+
 static int ffs_check_convert_header(struct ffs_hdr *dst, struct __ffs_hdr *src)
 {
 	if (be32_to_cpu(src->magic) != FFS_MAGIC)
@@ -420,6 +471,8 @@ int ffs_init(uint32_t offset, uint32_t max_size, struct blocklevel_device *bl,
 		}
 	}
 
+	ffs_build_name_index(f);
+
 out:
 	if (rc == 0)
 		*ffs = f;
@@ -454,15 +507,40 @@ void ffs_close(struct ffs_handle *ffs)
 	if (ffs->cache)
 		free(ffs->cache);
 
+	free(ffs->name_index);
 	free(ffs);
 }
 
+int ffs_toc_info(struct ffs_handle *ffs, uint32_t *offset, uint32_t *size)
+{
+	if (offset)
+		*offset = ffs->toc_offset;
+	if (size)
+		*size = ffs->hdr.size;
+	return 0;
+}
+
 int ffs_lookup_part(struct ffs_handle *ffs, const char *name,
 		    uint32_t *part_idx)
 {
 	struct ffs_entry **ents = ffs->hdr.entries;
+	uint32_t slot;
 	int i;
 
+	if (ffs->name_index) {
+		slot = ffs_name_hash(name) & ffs->name_index_mask;
+		while (ffs->name_index[slot]) {
+			i = ffs->name_index[slot] - 1;
+			if (!strncmp(name, ents[i]->name, FFS_PART_NAME_MAX)) {
+				if (part_idx)
+					*part_idx = i;
+				return 0;
+			}
+			slot = (slot + 1) & ffs->name_index_mask;
+		}
+		return FFS_ERR_PART_NOT_FOUND;
+	}
+
 	for (i = 0;
 			i < ffs->hdr.count &&
 			strncmp(name, ents[i]->name, FFS_PART_NAME_MAX);
@@ -116,6 +116,12 @@ bool ffs_equal(struct ffs_handle *one, struct ffs_handle *two);
 
 void ffs_close(struct ffs_handle *ffs);
 
+/*
+ * Where the partition table ffs was read from is on flash, anything
+ * writing to that range makes the handle stale.
+ */
+int ffs_toc_info(struct ffs_handle *ffs, uint32_t *offset, uint32_t *size);
+
 int ffs_lookup_part(struct ffs_handle *ffs, const char *name,
 		    uint32_t *part_idx);
 
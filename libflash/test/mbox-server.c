@@ -62,6 +62,8 @@ static struct {
 	uint32_t win_base;
 	uint32_t win_size;
 	bool win_dirty;
+
+	uint64_t read_bytes; /* read by the client through windows */
 } server_state;
 
 
@@ -101,6 +103,7 @@ int64_t lpc_read(enum OpalLPCAddressType __unused addr_type, uint32_t addr,
 	if (!check_window(addr, sz) || server_state.win_type == WIN_CLOSED)
 		return 1;
 	memcpy(data, server_state.lpc_base + addr, sz);
+	server_state.read_bytes += sz;
 	return 0;
 }
 
@@ -426,6 +429,11 @@ uint32_t mbox_server_total_size(void)
 	return server_state.lpc_size;
 }
 
+uint64_t mbox_server_read_bytes(void)
+{
+	return server_state.read_bytes;
+}
+
 uint32_t mbox_server_erase_granule(void)
 {
 	return server_state.erase_granule;
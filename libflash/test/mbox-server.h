@@ -5,6 +5,7 @@
 
 uint32_t mbox_server_total_size(void);
 uint32_t mbox_server_erase_granule(void);
+uint64_t mbox_server_read_bytes(void);
 int mbox_server_version(void);
 void mbox_server_memset(int c);
 int mbox_server_memcmp(int off, const void *buf, size_t len);
@@ -113,6 +113,47 @@ static void print_ptr(void *ptr, int len)
 	putchar('\n');
 }
 
+/*
+ * blocklevel_read() strips the ECC in the caller's buffer, check every
+ * start and length in the first len bytes of data come back right and
+ * that nothing past the end of the read gets touched.
+ */
+static int ecc_read_sweep(struct blocklevel_device *bl, const char *data,
+		uint64_t len)
+{
+	uint8_t out[0x100 + 16];
+	uint64_t pos, n, i;
+	int rc;
+
+	for (pos = 0; pos < len; pos++) {
+		for (n = 1; pos + n <= len; n++) {
+			memset(out, 0xaa, sizeof(out));
+			rc = blocklevel_read(bl, pos, out, n);
+			if (rc) {
+				ERR("Couldn't blocklevel_read(0x%" PRIx64 ", 0x%" PRIx64 ") rc=%d\n",
+						pos, n, rc);
+				return 1;
+			}
+			if (memcmp(out, &data[pos], n)) {
+				ERR("blocklevel_read(0x%" PRIx64 ", 0x%" PRIx64 ") didn't match\n",
+						pos, n);
+				print_ptr(out, n);
+				print_ptr((void *)&data[pos], n);
+				return 1;
+			}
+			for (i = n; i < sizeof(out); i++) {
+				if (out[i] != 0xaa) {
+					ERR("blocklevel_read(0x%" PRIx64 ", 0x%" PRIx64 ") wrote past the end at 0x%" PRIx64 "\n",
+							pos, n, i);
+					return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
 int main(void)
 {
 	struct blocklevel_device bl_mem = { 0 };
@@ -657,6 +698,14 @@ int main(void)
 		goto out;
 	}
 
+	rc = blocklevel_write(bl, 0, data, 0x100);
+	if (rc) {
+		ERR("Couldn't blocklevel_write(0, 0x100) to reset\n");
+		goto out;
+	}
+
+	rc = ecc_read_sweep(bl, data, 0x100);
+
 out:
 	free(buf);
 	free(data);
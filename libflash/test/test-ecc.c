@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <libflash/ecc.h>
 
@@ -16,6 +17,9 @@
 
 #define NUM_ECC_ROWS 320
 
+#define BENCH_WORDS	(64 * 1024)
+#define BENCH_LOOPS	16
+
 /*
  * Note this data is big endian as this is what the ecc code expects.
  * The ECC code returns IBM bit numbers assuming the word was in CPU
@@ -352,6 +356,139 @@ struct ecc64 ecc_data[] = {
 
 };
 
+/* What eccgenerate() used to be, to check the table and time it against */
+static uint8_t eccgenerate_parity(uint64_t data)
+{
+	int i;
+	uint8_t result = 0;
+
+	for (i = 0; i < 8; i++)
+		result |= __builtin_parityll(eccmatrix[i] & data) << i;
+
+	return result;
+}
+
+/* And the one word at a time memcpy_from_ecc() on top of it */
+static int memcpy_from_ecc_parity(uint64_t *dst, struct ecc64 *src,
+				  uint64_t len)
+{
+	uint64_t i;
+
+	for (i = 0; i < len / 8; i++) {
+		uint64_t data = be64toh(src[i].data);
+		uint8_t badbit;
+
+		badbit = syndromematrix[eccgenerate_parity(data) ^ src[i].ecc];
+		if (badbit == UE)
+			return badbit;
+		if (badbit < 64)
+			data = eccflipbit(data, badbit);
+		dst[i] = htobe64(data);
+	}
+
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long mb_per_sec(uint64_t bytes, uint64_t ns)
+{
+	return ns ? bytes * 1000 / ns : 0;
+}
+
+/*
+ * Check the table driven code against the parity based code it replaced
+ * over a buffer of random words, some with a bit flipped, then time both.
+ */
+static void test_ecc_bench(void)
+{
+	uint64_t *data, *out, *ref, start, ns_old, ns_new;
+	struct ecc64 *ecc;
+	int i, j;
+
+	data = malloc(BENCH_WORDS * sizeof(*data));
+	out = malloc(BENCH_WORDS * sizeof(*out));
+	ref = malloc(BENCH_WORDS * sizeof(*ref));
+	ecc = malloc(BENCH_WORDS * sizeof(*ecc));
+	if (!data || !out || !ref || !ecc) {
+		ERR("malloc failed during ecc benchmark\n");
+		exit(1);
+	}
+
+	srandom(42);
+	for (i = 0; i < BENCH_WORDS; i++)
+		data[i] = (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^
+			  random();
+
+	if (memcpy_to_ecc(ecc, data, BENCH_WORDS * sizeof(*data))) {
+		ERR("memcpy_to_ecc failed on benchmark buffer\n");
+		exit(1);
+	}
+	for (i = 0; i < BENCH_WORDS; i++) {
+		if (ecc[i].data != data[i] ||
+		    ecc[i].ecc != eccgenerate_parity(be64toh(data[i]))) {
+			ERR("memcpy_to_ecc disagrees on word %d\n", i);
+			exit(1);
+		}
+	}
+
+	/* Every slow path should give the same answer as before */
+	for (i = 0; i < BENCH_WORDS; i += 1021)
+		ecc[i].data ^= htobe64(1ull << (i % 64));
+	if (memcpy_from_ecc(out, ecc, BENCH_WORDS * sizeof(*out)) ||
+	    memcpy_from_ecc_parity(ref, ecc, BENCH_WORDS * sizeof(*ref))) {
+		ERR("memcpy_from_ecc failed on benchmark buffer\n");
+		exit(1);
+	}
+	if (memcmp(out, data, BENCH_WORDS * sizeof(*out)) ||
+	    memcmp(ref, data, BENCH_WORDS * sizeof(*ref))) {
+		ERR("memcpy_from_ecc didn't correct benchmark buffer\n");
+		exit(1);
+	}
+	for (i = 0; i < BENCH_WORDS; i += 1021)
+		ecc[i].data ^= htobe64(1ull << (i % 64));
+
+	start = now_ns();
+	for (j = 0; j < BENCH_LOOPS; j++)
+		memcpy_from_ecc_parity(ref, ecc, BENCH_WORDS * sizeof(*ref));
+	ns_old = now_ns() - start;
+
+	start = now_ns();
+	for (j = 0; j < BENCH_LOOPS; j++)
+		memcpy_from_ecc(out, ecc, BENCH_WORDS * sizeof(*out));
+	ns_new = now_ns() - start;
+
+	printf("memcpy_from_ecc(): %lu MB/s, was %lu MB/s\n",
+	       mb_per_sec(BENCH_LOOPS * BENCH_WORDS * sizeof(*out), ns_new),
+	       mb_per_sec(BENCH_LOOPS * BENCH_WORDS * sizeof(*out), ns_old));
+
+	start = now_ns();
+	for (j = 0; j < BENCH_LOOPS; j++)
+		for (i = 0; i < BENCH_WORDS; i++)
+			ecc[i].ecc = eccgenerate_parity(be64toh(data[i]));
+	ns_old = now_ns() - start;
+
+	start = now_ns();
+	for (j = 0; j < BENCH_LOOPS; j++)
+		memcpy_to_ecc(ecc, data, BENCH_WORDS * sizeof(*data));
+	ns_new = now_ns() - start;
+
+	printf("memcpy_to_ecc(): %lu MB/s, was %lu MB/s\n",
+	       mb_per_sec(BENCH_LOOPS * BENCH_WORDS * sizeof(*data), ns_new),
+	       mb_per_sec(BENCH_LOOPS * BENCH_WORDS * sizeof(*data), ns_old));
+
+	free(data);
+	free(out);
+	free(ref);
+	free(ecc);
+}
+
 int main(void)
 {
 	int i;
@@ -361,6 +498,22 @@ int main(void)
 	uint64_t *buf;
 	struct ecc64 *ret_buf;
 
+	int n, b;
+
+	printf("Checking ecctable against eccmatrix\n");
+	for (n = 0; n < 8; n++) {
+		for (b = 0; b < 256; b++) {
+			uint64_t word = (uint64_t)b << (8 * n);
+
+			if (ecctable[n][b] != eccgenerate_parity(word)) {
+				ERR("ecctable[%d][0x%02x] is 0x%02x, expecting 0x%02x\n",
+				    n, b, ecctable[n][b],
+				    eccgenerate_parity(word));
+				exit(1);
+			}
+		}
+	}
+
 	/*
 	 * Test that eccgenerate() still works, but skip the first 64 because they
 	 * have intentional bitflips
@@ -506,5 +659,8 @@ int main(void)
 		ERR("ecc_buffer_align(0, 50) not 45 -> %ld\n", ecc_buffer_align(0, 50));
 		exit(1);
 	}
+
+	printf("ECC throughput\n");
+	test_ecc_bench();
 	return 0;
 }
@@ -27,6 +27,10 @@ void mbox_init(void)
 #include "../ecc.c"
 #include "../blocklevel.c"
 
+/* Build libffs the way skiboot does, the test has skiboot's types */
+#define __SKIBOOT__
+#include "../libffs.c"
+
 #undef pr_fmt
 #define pr_fmt(fmt) "MBOX-PROXY: " fmt
 
@@ -271,6 +275,258 @@ out:
 	return rc;
 }
 
+/*
+ * Lay a partition table down on the server and check that once it has
+ * been read, looking partitions up doesn't go back to the flash. Reading
+ * it over again for every lookup costs the whole table every time.
+ */
+/* Lay down a TOC with names[i] in the (i + 1)th erase block */
+static int write_toc(struct blocklevel_device *bl, const char * const *names,
+		     int count)
+{
+	uint32_t granule = mbox_server_erase_granule();
+	struct ffs_entry *ent;
+	struct ffs_hdr *hdr;
+	int i, rc;
+
+	rc = ffs_hdr_new(granule, mbox_server_total_size() / granule,
+			 NULL, &hdr);
+	if (rc) {
+		ERR("ffs_hdr_new() failed with err %d\n", rc);
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		rc = ffs_entry_new(names[i], (i + 1) * granule, granule, &ent);
+		if (!rc)
+			rc = ffs_entry_add(hdr, ent);
+		ffs_entry_put(ent);
+		if (rc) {
+			ERR("Couldn't add %s to the TOC: %d\n", names[i], rc);
+			ffs_hdr_free(hdr);
+			return 1;
+		}
+	}
+	rc = ffs_hdr_finalise(bl, hdr);
+	ffs_hdr_free(hdr);
+	if (rc) {
+		ERR("ffs_hdr_finalise() failed with err %d\n", rc);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Every name is found where write_toc() put it */
+static int check_lookups(struct ffs_handle *ffs, const char * const *names,
+			 int count)
+{
+	uint32_t granule = mbox_server_erase_granule();
+	uint32_t idx, start;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (ffs_lookup_part(ffs, names[i], &idx) ||
+		    ffs_part_info(ffs, idx, NULL, &start, NULL, NULL, NULL) ||
+		    start != (i + 1) * granule) {
+			ERR("Lookup of %s failed\n", names[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int run_toc_test(struct blocklevel_device *bl)
+{
+	static const char * const names[] = { "HBB", "HBEL", "GUARD", "NVRAM",
+		"BOOTKERNEL", "ROOTFS", "CAPP", "VERSION", "IMA_CATALOG",
+		"BOOTKERNFW" };
+	uint64_t before, toc_bytes, reread_bytes;
+	struct ffs_handle *ffs;
+	uint32_t idx;
+	int i, rc;
+
+	if (write_toc(bl, names, ARRAY_SIZE(names)))
+		return 1;
+
+	before = mbox_server_read_bytes();
+	rc = ffs_init(0, mbox_server_total_size(), bl, &ffs, 0);
+	if (rc) {
+		ERR("ffs_init() failed with err %d\n", rc);
+		return 1;
+	}
+	toc_bytes = mbox_server_read_bytes() - before;
+
+	before = mbox_server_read_bytes();
+	rc = check_lookups(ffs, names, ARRAY_SIZE(names));
+	if (!rc &&
+	    ffs_lookup_part(ffs, "NOTTHERE", &idx) != FFS_ERR_PART_NOT_FOUND) {
+		ERR("Found a partition that isn't there\n");
+		rc = 1;
+	}
+	ffs_close(ffs);
+	if (rc)
+		return 1;
+	if (mbox_server_read_bytes() != before) {
+		ERR("Lookups in a cached TOC read %" PRIu64 " bytes\n",
+		    mbox_server_read_bytes() - before);
+		return 1;
+	}
+
+	/* What keeping the handle saves: a whole TOC read per lookup */
+	before = mbox_server_read_bytes();
+	for (i = 0; i < ARRAY_SIZE(names); i++) {
+		rc = ffs_init(0, mbox_server_total_size(), bl, &ffs, 0);
+		if (rc) {
+			ERR("ffs_init() failed with err %d\n", rc);
+			return 1;
+		}
+		rc = ffs_lookup_part(ffs, names[i], &idx);
+		ffs_close(ffs);
+		if (rc) {
+			ERR("Lookup of %s failed\n", names[i]);
+			return 1;
+		}
+	}
+	reread_bytes = mbox_server_read_bytes() - before;
+	if (!toc_bytes || reread_bytes != ARRAY_SIZE(names) * toc_bytes) {
+		ERR("Re-reading the TOC %d times read %" PRIu64
+		    " bytes, once read %" PRIu64 "\n", (int)ARRAY_SIZE(names),
+		    reread_bytes, toc_bytes);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Names that all want the same slot in the index have to probe past it */
+static int run_toc_collision_test(struct blocklevel_device *bl)
+{
+	static char buf[7][FFS_PART_NAME_MAX + 1];
+	const char *names[7];
+	struct ffs_handle *ffs;
+	uint32_t want, idx;
+	int n = 0, i, rc;
+
+	/* Six entries get an index of 16 slots */
+	for (i = 0; n < ARRAY_SIZE(names); i++) {
+		snprintf(buf[n], sizeof(buf[n]), "PART%d", i);
+		if (!n)
+			want = ffs_name_hash(buf[0]) & 15;
+		if ((ffs_name_hash(buf[n]) & 15) == want) {
+			names[n] = buf[n];
+			n++;
+		}
+	}
+
+	/* The last one is left out, and has to probe past all the others */
+	if (write_toc(bl, names, ARRAY_SIZE(names) - 1))
+		return 1;
+	rc = ffs_init(0, mbox_server_total_size(), bl, &ffs, 0);
+	if (rc) {
+		ERR("ffs_init() failed with err %d\n", rc);
+		return 1;
+	}
+	if (!ffs->name_index || ffs->name_index_mask != 15) {
+		ERR("Name index isn't 16 slots\n");
+		rc = 1;
+	}
+	if (!rc)
+		rc = check_lookups(ffs, names, ARRAY_SIZE(names) - 1);
+	if (!rc && ffs_lookup_part(ffs, names[ARRAY_SIZE(names) - 1], &idx) !=
+	    FFS_ERR_PART_NOT_FOUND) {
+		ERR("Found colliding %s that isn't there\n",
+		    names[ARRAY_SIZE(names) - 1]);
+		rc = 1;
+	}
+	ffs_close(ffs);
+
+	return rc;
+}
+
+/* Rename one entry on flash to the same name as another */
+static int make_duplicate(struct blocklevel_device *bl, const char *from,
+			  const char *to)
+{
+	static char toc[64 * 1024];
+	struct __ffs_hdr *hdr = (struct __ffs_hdr *)toc;
+	struct __ffs_entry *ent;
+	uint32_t i, size;
+	int rc;
+
+	rc = blocklevel_read(bl, 0, toc, sizeof(*hdr));
+	size = be32_to_cpu(hdr->size) * be32_to_cpu(hdr->block_size);
+	if (!rc && size > sizeof(toc))
+		size = sizeof(toc);
+	if (!rc)
+		rc = blocklevel_read(bl, 0, toc, size);
+	if (rc) {
+		ERR("Couldn't read the TOC back: %d\n", rc);
+		return 1;
+	}
+
+	for (i = 0; i < be32_to_cpu(hdr->entry_count); i++) {
+		ent = &hdr->entries[i];
+		if (strncmp(ent->name, from, FFS_PART_NAME_MAX))
+			continue;
+		strncpy(ent->name, to, FFS_PART_NAME_MAX);
+		ent->checksum = 0;
+		ent->checksum = ffs_entry_checksum(ent);
+		return blocklevel_smart_write(bl, 0, toc, size) ? 1 : 0;
+	}
+
+	ERR("No %s in the TOC\n", from);
+	return 1;
+}
+
+/* A duplicated name finds the first entry, index or no index */
+static int run_toc_duplicate_test(struct blocklevel_device *bl)
+{
+	static const char * const names[] = { "HBB", "HBEL", "GUARD", "NVRAM",
+		"BOOTKERNEL" };
+	uint32_t *name_index;
+	struct ffs_handle *ffs;
+	uint32_t idx, dup_idx, start;
+	int pass, rc = 0;
+
+	if (write_toc(bl, names, ARRAY_SIZE(names)) ||
+	    make_duplicate(bl, "NVRAM", "HBEL"))
+		return 1;
+	if (ffs_init(0, mbox_server_total_size(), bl, &ffs, 0)) {
+		ERR("ffs_init() failed\n");
+		return 1;
+	}
+
+	name_index = ffs->name_index;
+	for (pass = 0; !rc && pass < 2; pass++) {
+		/* Second time round search the way we do without an index */
+		if (pass)
+			ffs->name_index = NULL;
+
+		if (ffs_lookup_part(ffs, "HBEL", &idx) ||
+		    ffs_part_info(ffs, idx, NULL, &start, NULL, NULL, NULL) ||
+		    start != 2 * mbox_server_erase_granule()) {
+			ERR("Duplicate HBEL didn't find the first one\n");
+			rc = 1;
+		}
+		if (!rc && !pass)
+			dup_idx = idx;
+		if (!rc && idx != dup_idx) {
+			ERR("Index and search disagree on HBEL\n");
+			rc = 1;
+		}
+		if (!rc && ffs_lookup_part(ffs, "NVRAM", &idx) !=
+		    FFS_ERR_PART_NOT_FOUND) {
+			ERR("Found renamed NVRAM\n");
+			rc = 1;
+		}
+	}
+	ffs->name_index = name_index;
+	ffs_close(ffs);
+
+	return rc;
+}
+
 int main(void)
 {
 	struct blocklevel_device *bl;
@@ -294,6 +550,14 @@ int main(void)
 	rc = run_flash_test(bl);
 	if (rc)
 		goto out;
+
+	rc = run_toc_test(bl);
+	if (!rc)
+		rc = run_toc_collision_test(bl);
+	if (!rc)
+		rc = run_toc_duplicate_test(bl);
+	if (rc)
+		goto out;
 	/*
 	 * Trick mbox-flash into thinking there was a reboot so we can
 	 * switch to v2
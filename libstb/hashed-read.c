@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020 IBM Corp. */
+
+#include <skiboot.h>
+#include <cpu.h>
+#include "hashed-read.h"
+
+/*
+ * Big enough that queueing a job is noise, small enough that the last
+ * chunk's hash doesn't take long after the read finishes.
+ */
+#define HASHED_READ_CHUNK	(1024 * 1024)
+
+static void hashed_read_job(void *data)
+{
+	struct hashed_read *h = data;
+
+	mbedtls_sha512_update(&h->ctx, h->chunk, h->chunk_len);
+}
+
+static void hashed_read_wait(struct hashed_read *h)
+{
+	if (h->job) {
+		cpu_wait_job(h->job, true);
+		h->job = NULL;
+	}
+}
+
+void hashed_read_init(struct hashed_read *h)
+{
+	mbedtls_sha512_init(&h->ctx);
+	mbedtls_sha512_starts(&h->ctx, 0); /* SHA512 = 0 */
+	h->len = 0;
+	h->job = NULL;
+}
+
+int hashed_read(struct hashed_read *h, hashed_read_fn read, void *priv,
+		uint64_t pos, void *buf, uint64_t len)
+{
+	uint64_t chunk;
+	int rc;
+
+	while (len) {
+		chunk = MIN(len, HASHED_READ_CHUNK);
+
+		rc = read(priv, pos, buf, chunk);
+
+		/* The hash has to be fed in order, one job at a time */
+		hashed_read_wait(h);
+		if (rc)
+			return rc;
+
+		h->chunk = buf;
+		h->chunk_len = chunk;
+		h->len += chunk;
+		h->job = cpu_queue_job(NULL, "hashed_read", hashed_read_job, h);
+		if (!h->job)
+			return OPAL_NO_MEM;
+
+		pos += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+uint64_t hashed_read_finish(struct hashed_read *h, uint8_t *digest)
+{
+	hashed_read_wait(h);
+	mbedtls_sha512_finish(&h->ctx, digest);
+	mbedtls_sha512_free(&h->ctx);
+
+	return h->len;
+}
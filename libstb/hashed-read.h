@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020 IBM Corp. */
+
+#ifndef __HASHED_READ_H
+#define __HASHED_READ_H
+
+#include <stdint.h>
+#include <libstb/mbedtls/sha512.h>
+
+struct cpu_job;
+
+typedef int (*hashed_read_fn)(void *priv, uint64_t pos, void *buf,
+			      uint64_t len);
+
+/*
+ * SHA512 of data as it's read, so loading a resource doesn't need a
+ * second pass over it to measure it.
+ */
+struct hashed_read {
+	mbedtls_sha512_context	ctx;
+	uint64_t		len;
+	/* What the hashing job has been given */
+	const void		*chunk;
+	uint64_t		chunk_len;
+	struct cpu_job		*job;
+};
+
+void hashed_read_init(struct hashed_read *h);
+
+/*
+ * hashed_read - read with @read and add what was read to the hash
+ * @h    : hash state
+ * @read : does the actual reading
+ * @priv : passed to @read
+ * @pos, @buf, @len : what to read where
+ *
+ * The read is done in chunks, and each chunk is hashed on another CPU
+ * while the next one is read. Consecutive calls hash the concatenation
+ * of what they read.
+ *
+ * returns: 0, whatever @read failed with or OPAL_NO_MEM
+ */
+int hashed_read(struct hashed_read *h, hashed_read_fn read, void *priv,
+		uint64_t pos, void *buf, uint64_t len);
+
+/* Returns the number of bytes hashed and puts the SHA512 in @digest */
+uint64_t hashed_read_finish(struct hashed_read *h, uint8_t *digest);
+
+#endif /* __HASHED_READ_H */
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020 IBM Corp. */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../mbedtls/sha512.c"
+#include "../hashed-read.c"
+#include "../container.h"
+
+#define DATA_LEN	(3 * HASHED_READ_CHUNK + 4321)
+
+static unsigned char *flash;
+static int fail_at = -1;
+
+static int test_read(void *priv, uint64_t pos, void *buf, uint64_t len)
+{
+	assert(priv == flash);
+	if (fail_at >= 0 && pos + len > fail_at)
+		return -1;
+	memcpy(buf, flash + pos, len);
+	return 0;
+}
+
+/* Read [0, total) as pieces of @split bytes and check the hash */
+static void check_split(uint64_t total, uint64_t split)
+{
+	uint8_t want[SHA512_DIGEST_LENGTH], got[SHA512_DIGEST_LENGTH];
+	struct hashed_read h;
+	unsigned char *buf;
+	uint64_t pos, len;
+
+	buf = malloc(total + 1);
+	assert(buf);
+	buf[total] = 0x5a;
+
+	mbedtls_sha512(flash, total, want, 0);
+
+	hashed_read_init(&h);
+	for (pos = 0; pos < total; pos += len) {
+		len = total - pos < split ? total - pos : split;
+		assert(!hashed_read(&h, test_read, flash, pos, buf + pos, len));
+	}
+	assert(hashed_read_finish(&h, got) == total);
+
+	assert(memcmp(want, got, sizeof(want)) == 0);
+	assert(memcmp(buf, flash, total) == 0);
+	assert(buf[total] == 0x5a);
+	free(buf);
+}
+
+int main(void)
+{
+	uint8_t digest[SHA512_DIGEST_LENGTH];
+	struct hashed_read h;
+	unsigned char *buf;
+	unsigned int i;
+
+	flash = malloc(DATA_LEN);
+	assert(flash);
+	for (i = 0; i < DATA_LEN; i++)
+		flash[i] = i * 7 + (i >> 11);
+
+	/* Nothing read at all */
+	check_split(0, 1);
+
+	check_split(1, 1);
+	check_split(4096, 4096);
+	check_split(HASHED_READ_CHUNK, HASHED_READ_CHUNK);
+	check_split(HASHED_READ_CHUNK + 1, HASHED_READ_CHUNK);
+	check_split(DATA_LEN, DATA_LEN);
+	check_split(DATA_LEN, 4096);
+	check_split(DATA_LEN, HASHED_READ_CHUNK - 1);
+	check_split(DATA_LEN, HASHED_READ_CHUNK + 17);
+
+	/* A failed read is passed back, and what came before it hashed */
+	buf = malloc(DATA_LEN);
+	assert(buf);
+	fail_at = HASHED_READ_CHUNK + 100;
+	hashed_read_init(&h);
+	assert(hashed_read(&h, test_read, flash, 0, buf, DATA_LEN) == -1);
+	assert(hashed_read_finish(&h, digest) == HASHED_READ_CHUNK);
+	free(buf);
+
+	free(flash);
+	return 0;
+}
@@ -158,20 +158,16 @@ out_free:
 	return (failed) ? -1 : 0;
 }
 
-int trustedboot_measure(enum resource_id id, void *buf, size_t len)
+/*
+ * Checks shared by the measure functions. Returns the PCR the resource
+ * should be extended into, or -1 if it can't be measured.
+ */
+static TPM_Pcr measure_pcr(enum resource_id id, const char **name)
 {
-	uint8_t digest[SHA512_DIGEST_LENGTH];
-	void *buf_aux;
-	size_t len_aux;
-	const char *name;
 	TPM_Pcr pcr;
-	int rc = -1;
-
-	if (!trusted_mode)
-		return 1;
 
-	name = flash_map_resource_name(id);
-	if (!name) {
+	*name = flash_map_resource_name(id);
+	if (!*name) {
 		/**
 		 * @fwts-label ResourceNotMeasuredUnknown
 		 * @fwts-advice This is a bug in the trustedboot_measure()
@@ -189,7 +185,7 @@ int trustedboot_measure(enum resource_id id, void *buf, size_t len)
 
 	if (boot_services_exited) {
 		prlog(PR_ERR, "%s NOT MEASURED. Already exited from boot "
-		      "services\n", name);
+		      "services\n", *name);
 		return -1;
 	}
 	pcr = map_pcr(id);
@@ -199,9 +195,51 @@ int trustedboot_measure(enum resource_id id, void *buf, size_t len)
 		 * @fwts-advice This is a bug. The resource cannot be measured
 		 * because it is not mapped to a PCR in the resources[] array.
 		 */
-		prlog(PR_ERR, "%s NOT MEASURED, it's not mapped to a PCR\n", name);
+		prlog(PR_ERR, "%s NOT MEASURED, it's not mapped to a PCR\n", *name);
 		return -1;
 	}
+
+	return pcr;
+}
+
+static int measure_extend(TPM_Pcr pcr, const char *name, uint8_t *digest)
+{
+#ifdef STB_DEBUG
+	stb_print_data(digest, TPM_ALG_SHA256_SIZE);
+#endif
+	/*
+	 * Extend the given PCR number in both sha256 and sha1 banks with the
+	 * sha512 hash calculated. The hash is truncated accordingly to fit the
+	 * PCR.
+	 */
+	return tpm_extendl(pcr,
+			   TPM_ALG_SHA256, digest, TPM_ALG_SHA256_SIZE,
+			   TPM_ALG_SHA1,   digest, TPM_ALG_SHA1_SIZE,
+			   EV_COMPACT_HASH, name);
+}
+
+bool trustedboot_measuring(enum resource_id id)
+{
+	return trusted_mode && trusted_init && !boot_services_exited &&
+		map_pcr(id) != -1;
+}
+
+int trustedboot_measure(enum resource_id id, void *buf, size_t len)
+{
+	uint8_t digest[SHA512_DIGEST_LENGTH];
+	void *buf_aux;
+	size_t len_aux;
+	const char *name;
+	TPM_Pcr pcr;
+	int rc = -1;
+
+	if (!trusted_mode)
+		return 1;
+
+	pcr = measure_pcr(id, &name);
+	if (pcr == -1)
+		return -1;
+
 	if (!buf) {
 		/**
 		 * @fwts-label ResourceNotMeasuredNull
@@ -238,16 +276,22 @@ int trustedboot_measure(enum resource_id id, void *buf, size_t len)
 		return -1;
 	}
 
-#ifdef STB_DEBUG
-	stb_print_data(digest, TPM_ALG_SHA256_SIZE);
-#endif
-	/*
-	 * Extend the given PCR number in both sha256 and sha1 banks with the
-	 * sha512 hash calculated. The hash is truncated accordingly to fit the
-	 * PCR.
-	 */
-	return tpm_extendl(pcr,
-			   TPM_ALG_SHA256, digest, TPM_ALG_SHA256_SIZE,
-			   TPM_ALG_SHA1,   digest, TPM_ALG_SHA1_SIZE,
-			   EV_COMPACT_HASH, name);
+	return measure_extend(pcr, name, digest);
+}
+
+int trustedboot_measure_digest(enum resource_id id, uint8_t *digest)
+{
+	const char *name;
+	TPM_Pcr pcr;
+
+	if (!trusted_mode)
+		return 1;
+
+	pcr = measure_pcr(id, &name);
+	if (pcr == -1)
+		return -1;
+
+	prlog(PR_NOTICE, "%s hash calculated while loading\n", name);
+
+	return measure_extend(pcr, name, digest);
 }
@@ -35,4 +35,15 @@ int trustedboot_exit_boot_services(void);
  */
 int trustedboot_measure(enum resource_id id, void *buf, size_t len);
 
+/**
+ * trustedboot_measure_digest - measure a resource the caller has hashed
+ * @id     : resource id
+ * @digest : SHA512 of the resource, without any STB container header
+ *
+ * As trustedboot_measure(), for loaders that hash the resource as they
+ * read it. trustedboot_measuring() says whether it's worth doing that.
+ */
+int trustedboot_measure_digest(enum resource_id id, uint8_t *digest);
+bool trustedboot_measuring(enum resource_id id);
+
 #endif /* __TRUSTEDBOOT_H */
@@ -0,0 +1,265 @@
+// SPDX-License-Identifier: Apache-2.0
+/* Copyright 2020 IBM Corp. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../xz_crc32.c"
+#include "../xz_dec_lzma2.c"
+#include "../xz_dec_stream.c"
+
+#define NR_LINES	320
+
+/*
+ * make_data() output, compressed with:
+ *   xz --check=crc32 --block-size=4096
+ * which gives four Blocks, the last one short.
+ */
+static const uint8_t blocks_xz[] = {
+	0xfd, 0x37, 0x7a, 0x58, 0x5a, 0x00, 0x00, 0x01, 0x69, 0x22, 0xde, 0x36,
+	0x03, 0xc0, 0x9c, 0x03, 0x80, 0x20, 0x21, 0x01, 0x16, 0x00, 0x00, 0x00,
+	0x6b, 0x27, 0x9c, 0x57, 0xe0, 0x0f, 0xff, 0x01, 0x94, 0x5d, 0x00, 0x18,
+	0x69, 0x0a, 0x84, 0x07, 0x73, 0xa7, 0x8d, 0x6c, 0x59, 0xb3, 0xd8, 0xfb,
+	0xef, 0x4a, 0x54, 0xa3, 0x91, 0x2a, 0xba, 0x06, 0x02, 0x7f, 0x68, 0xd1,
+	0x1e, 0x75, 0x24, 0x61, 0x33, 0xaa, 0x8e, 0x4e, 0x81, 0x30, 0xce, 0x48,
+	0xbd, 0xf3, 0x48, 0xb7, 0x5b, 0x3d, 0xd7, 0x41, 0x64, 0x53, 0x0b, 0x5f,
+	0xee, 0x90, 0xea, 0x0d, 0xd8, 0xb3, 0xab, 0x52, 0x60, 0x08, 0x31, 0xe9,
+	0x6d, 0x59, 0x91, 0x45, 0x4d, 0xa0, 0x11, 0x54, 0x18, 0x57, 0x5d, 0xb0,
+	0x8b, 0xf4, 0xcd, 0xdf, 0x29, 0x93, 0xd8, 0x1f, 0xf9, 0x08, 0x72, 0xb2,
+	0xef, 0x19, 0x5a, 0xa3, 0xf5, 0x82, 0x90, 0x12, 0xf2, 0xf4, 0x7b, 0x3e,
+	0x82, 0x9f, 0x23, 0x45, 0x82, 0xd8, 0xf2, 0x94, 0xe7, 0x30, 0x2f, 0xe7,
+	0xea, 0x6a, 0x56, 0x43, 0xa3, 0x63, 0xaf, 0xe2, 0x39, 0x05, 0x64, 0xc5,
+	0xc4, 0xe5, 0xc9, 0x90, 0x0a, 0x04, 0xa2, 0xa3, 0xd1, 0xe7, 0xb0, 0x7b,
+	0x31, 0xfb, 0x39, 0xc8, 0x80, 0x0e, 0x7a, 0xa3, 0x29, 0x6b, 0xaf, 0xa7,
+	0x7d, 0xdf, 0x35, 0x9a, 0x69, 0x14, 0x8d, 0x42, 0x4d, 0x0f, 0x27, 0x88,
+	0x74, 0x8e, 0x24, 0x7a, 0xa6, 0x3e, 0x5e, 0x63, 0x96, 0x20, 0x40, 0x56,
+	0x7a, 0x7d, 0x4b, 0x79, 0xd4, 0xf4, 0xb3, 0xfe, 0x62, 0x8f, 0x43, 0x07,
+	0xb4, 0x6e, 0x7f, 0x3b, 0xc3, 0x8c, 0x2f, 0xd7, 0x00, 0x3d, 0x9b, 0x9d,
+	0xaf, 0x52, 0x5b, 0x44, 0x62, 0xa8, 0x19, 0x21, 0xd6, 0xba, 0xec, 0xb5,
+	0x78, 0xfc, 0x93, 0xaa, 0x35, 0x71, 0xc7, 0x83, 0x2e, 0xd5, 0x57, 0xf0,
+	0x19, 0x6b, 0x7d, 0x65, 0x20, 0xc2, 0xda, 0xee, 0xbe, 0xa8, 0x2e, 0xbd,
+	0xe3, 0x8f, 0x05, 0xee, 0x76, 0xb1, 0x70, 0xa1, 0x4c, 0x94, 0x59, 0xbc,
+	0x8d, 0x1e, 0xa3, 0x18, 0xdf, 0x4e, 0xa6, 0x0f, 0x18, 0x72, 0x4f, 0xbd,
+	0xf1, 0x38, 0x84, 0x51, 0x07, 0x5c, 0x00, 0x84, 0xa5, 0xde, 0x7d, 0xe2,
+	0xfc, 0x5d, 0x5e, 0x0c, 0x04, 0x6f, 0x4e, 0xf6, 0x05, 0xaf, 0xaa, 0x63,
+	0xe3, 0x05, 0x41, 0xa5, 0x8a, 0x2e, 0x14, 0xb6, 0xb7, 0x44, 0x91, 0x20,
+	0x0e, 0x75, 0xc8, 0x25, 0xe4, 0x2a, 0x0e, 0xed, 0x7a, 0xa4, 0xab, 0x2d,
+	0xb9, 0xd8, 0x4f, 0x97, 0xed, 0x42, 0x73, 0xa4, 0x29, 0xa0, 0x8f, 0x8f,
+	0xc3, 0x41, 0xca, 0x34, 0x92, 0xdf, 0x70, 0xfe, 0x88, 0x1b, 0x77, 0x19,
+	0xd9, 0x7c, 0xb2, 0x01, 0x74, 0xb8, 0x69, 0xe7, 0x01, 0x42, 0x20, 0xce,
+	0x5a, 0xcf, 0x99, 0xfe, 0x20, 0x84, 0x10, 0x26, 0x93, 0x27, 0x85, 0x75,
+	0xae, 0xe3, 0x9d, 0x17, 0x33, 0x78, 0xa1, 0x49, 0x59, 0x68, 0x96, 0x6f,
+	0x05, 0x0b, 0xd3, 0x4c, 0xcf, 0x95, 0x27, 0x64, 0x0e, 0xf5, 0xc3, 0xa9,
+	0x6b, 0x6f, 0xbe, 0x86, 0x1f, 0xfd, 0xa4, 0x27, 0x24, 0x16, 0xfe, 0xd0,
+	0xf7, 0xa7, 0x68, 0xbc, 0x31, 0x47, 0xe5, 0x5f, 0x17, 0x69, 0x6f, 0xd8,
+	0x8f, 0x8e, 0x8e, 0xe8, 0x96, 0xc4, 0x0c, 0x00, 0x43, 0x8b, 0x14, 0xf6,
+	0x03, 0xc0, 0xa1, 0x03, 0x80, 0x20, 0x21, 0x01, 0x16, 0x00, 0x00, 0x00,
+	0xe3, 0x2e, 0x91, 0xca, 0xe0, 0x0f, 0xff, 0x01, 0x99, 0x5d, 0x00, 0x3a,
+	0x08, 0x0b, 0x07, 0xe1, 0x29, 0x0c, 0x94, 0xd4, 0xca, 0xec, 0x72, 0x74,
+	0x50, 0x85, 0xf8, 0x8f, 0x1c, 0x09, 0x51, 0xdc, 0x50, 0x8f, 0x7a, 0xdd,
+	0xea, 0xd5, 0x39, 0xce, 0x82, 0x40, 0x76, 0x82, 0xc7, 0xbd, 0xd8, 0x04,
+	0x4f, 0xe2, 0x1c, 0x53, 0x8b, 0xa7, 0xa0, 0x03, 0xce, 0xe5, 0x14, 0x7c,
+	0x9f, 0x14, 0x0a, 0x0b, 0x3d, 0x59, 0xbb, 0xd5, 0x35, 0x82, 0x17, 0xec,
+	0xee, 0x71, 0x1c, 0x92, 0xd7, 0x70, 0x89, 0x79, 0xfb, 0xe9, 0x14, 0xb7,
+	0x5c, 0xc3, 0x22, 0x17, 0x49, 0x15, 0x9c, 0x32, 0x7a, 0x3d, 0x10, 0x95,
+	0x85, 0xa9, 0x60, 0x49, 0x78, 0xb9, 0x59, 0x7e, 0x87, 0xc5, 0xa9, 0xe0,
+	0xce, 0x74, 0x22, 0x2e, 0xec, 0x1e, 0x69, 0xfb, 0x98, 0xec, 0x37, 0x25,
+	0xfb, 0x2f, 0xdf, 0xd8, 0x4d, 0x87, 0x05, 0xa5, 0xc3, 0xc1, 0x43, 0x7b,
+	0x32, 0xab, 0xb7, 0xa2, 0x2b, 0xb3, 0x73, 0x29, 0x45, 0x81, 0x29, 0x44,
+	0xd5, 0x8c, 0xb7, 0x67, 0x83, 0x6d, 0x4e, 0x18, 0x06, 0x82, 0x49, 0x4e,
+	0x3b, 0x2e, 0xa3, 0xf4, 0x5b, 0x0c, 0x13, 0xc1, 0x4b, 0x3c, 0x86, 0x16,
+	0x10, 0xf7, 0xd5, 0x99, 0x7a, 0xf6, 0xe1, 0x5c, 0xa6, 0x12, 0x77, 0x9f,
+	0x23, 0x98, 0x5b, 0x5f, 0xe7, 0x59, 0xd4, 0x5e, 0x3d, 0x9e, 0xc4, 0x6a,
+	0x58, 0x7d, 0x80, 0xa9, 0x42, 0xed, 0xe5, 0x3e, 0x89, 0x94, 0xf4, 0x69,
+	0x23, 0x04, 0x37, 0x24, 0xbd, 0x86, 0x7a, 0x01, 0x83, 0xb9, 0x8c, 0x1f,
+	0xc0, 0xd2, 0x4c, 0x7e, 0xb9, 0x29, 0xcc, 0xbd, 0xd5, 0xf3, 0x9a, 0x0b,
+	0xcf, 0xd2, 0x29, 0xfe, 0x8d, 0xc5, 0x0b, 0xfb, 0xd7, 0x17, 0x07, 0xd4,
+	0x5b, 0x13, 0xfd, 0x74, 0x21, 0xd5, 0x21, 0x63, 0x7b, 0x23, 0x51, 0x68,
+	0xb0, 0xec, 0x8e, 0x03, 0x28, 0x50, 0xcd, 0xf3, 0xd8, 0x53, 0x3a, 0x00,
+	0x10, 0x9a, 0x57, 0x1e, 0x72, 0xb7, 0xeb, 0xa2, 0x31, 0xf5, 0x72, 0xc6,
+	0xc4, 0x84, 0x6e, 0x83, 0xfd, 0xf5, 0x68, 0x5b, 0x7e, 0x4c, 0xee, 0x33,
+	0x97, 0xe3, 0x8a, 0x72, 0xdb, 0xc4, 0x03, 0x1a, 0xe5, 0xe1, 0xf2, 0x84,
+	0xf1, 0x92, 0xe2, 0x34, 0xd9, 0x9f, 0xec, 0xcb, 0x8d, 0x3f, 0xd0, 0x86,
+	0xb5, 0x64, 0x56, 0x0b, 0xc1, 0xf8, 0x1f, 0x82, 0x47, 0xf2, 0x6a, 0xd3,
+	0xfb, 0xbf, 0xe7, 0x6f, 0x29, 0x0a, 0x17, 0x00, 0x77, 0xe2, 0x9c, 0xcd,
+	0x37, 0xa9, 0xbb, 0x84, 0x1f, 0xf3, 0xc7, 0xbe, 0x36, 0x8a, 0x3d, 0x55,
+	0xa5, 0x1c, 0x00, 0x9a, 0xd5, 0x1d, 0xb3, 0x1b, 0xe8, 0x74, 0x97, 0x56,
+	0x6b, 0x5f, 0xa3, 0x0e, 0x83, 0x60, 0x10, 0x5d, 0xb5, 0x4f, 0x66, 0xe7,
+	0x09, 0x60, 0x06, 0x59, 0x25, 0x0e, 0xdd, 0xf9, 0x0b, 0x1a, 0x7d, 0x60,
+	0x65, 0x95, 0xad, 0x85, 0x18, 0xef, 0xed, 0x6e, 0x70, 0x51, 0x1b, 0x6c,
+	0x47, 0xa7, 0xd1, 0x72, 0xba, 0x51, 0x2a, 0x1c, 0xdb, 0x87, 0x2c, 0xf3,
+	0xe1, 0xaa, 0x3d, 0xad, 0xc4, 0x57, 0x66, 0xe9, 0xfe, 0x10, 0xd7, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x4a, 0xe6, 0x42, 0x02, 0x03, 0xc0, 0x9b, 0x03,
+	0x80, 0x20, 0x21, 0x01, 0x16, 0x00, 0x00, 0x00, 0x12, 0x3c, 0x40, 0xb5,
+	0xe0, 0x0f, 0xff, 0x01, 0x93, 0x5d, 0x00, 0x35, 0x88, 0x0a, 0x86, 0x94,
+	0x5c, 0x55, 0x65, 0x0c, 0x09, 0xe4, 0x62, 0x13, 0x1f, 0xe7, 0x15, 0x7c,
+	0x98, 0xaa, 0xf7, 0x2b, 0xd9, 0xe2, 0x5d, 0x83, 0xa2, 0xb2, 0x48, 0x4e,
+	0x7c, 0x1b, 0xdd, 0x3f, 0xc5, 0xd3, 0x93, 0x9b, 0xb6, 0x96, 0x18, 0x0d,
+	0x86, 0x47, 0x15, 0xd2, 0x62, 0x2b, 0xcd, 0xc4, 0x4e, 0xc6, 0xb8, 0x1f,
+	0xb4, 0xdc, 0xd7, 0x2a, 0xc0, 0x9d, 0xb0, 0x2b, 0x6e, 0x31, 0x9d, 0x8c,
+	0x7a, 0x0c, 0x78, 0xb7, 0xe6, 0x74, 0xae, 0x3b, 0x80, 0xa7, 0x0d, 0x4e,
+	0xfc, 0x54, 0xe6, 0x86, 0xaf, 0xa4, 0x4e, 0x6e, 0xcd, 0x1c, 0x02, 0xa1,
+	0xc1, 0x2e, 0xc3, 0xb0, 0xcc, 0x6d, 0xac, 0x7f, 0x80, 0xc3, 0x34, 0x4d,
+	0x81, 0xa2, 0xdb, 0x87, 0x8a, 0x1f, 0x4f, 0x16, 0x7f, 0x03, 0x2d, 0x94,
+	0x51, 0x22, 0xec, 0x11, 0xc7, 0x07, 0x96, 0x7e, 0x3e, 0x76, 0xbe, 0xea,
+	0x6b, 0x76, 0xc1, 0xb9, 0xec, 0x71, 0xec, 0x0c, 0x58, 0xf4, 0x33, 0xe1,
+	0xc4, 0xfd, 0xcb, 0xa6, 0xe3, 0x7f, 0xe8, 0xa5, 0x68, 0x3e, 0x96, 0xb5,
+	0xdb, 0xb2, 0x14, 0x9a, 0x1c, 0x4c, 0x5c, 0x57, 0xc5, 0x20, 0x1a, 0x40,
+	0xcc, 0x2d, 0x93, 0x8b, 0x8f, 0x17, 0x41, 0x4b, 0xbd, 0x22, 0x9f, 0x6a,
+	0xce, 0xcd, 0x23, 0x5f, 0xda, 0x6d, 0x09, 0xb2, 0x95, 0xc9, 0x00, 0x3b,
+	0x31, 0x8c, 0x7a, 0xfe, 0x71, 0xb6, 0x24, 0x51, 0x65, 0x55, 0xab, 0xd0,
+	0xe1, 0x29, 0xb5, 0xa0, 0xa2, 0x74, 0xd9, 0xe6, 0xf8, 0xba, 0x70, 0x43,
+	0x30, 0xac, 0xcd, 0xd2, 0xc7, 0xde, 0x51, 0xaa, 0x39, 0xa4, 0xaf, 0x22,
+	0xf4, 0xfa, 0x5f, 0x5e, 0x93, 0x0a, 0x00, 0x12, 0x05, 0xe6, 0xa7, 0x22,
+	0xd2, 0x87, 0x2f, 0x84, 0x10, 0x91, 0xa1, 0x77, 0x6f, 0xc9, 0x2b, 0x70,
+	0x5c, 0xc7, 0x84, 0x61, 0x98, 0x09, 0x85, 0xca, 0xaa, 0x96, 0x84, 0x54,
+	0x1c, 0x87, 0x78, 0x5e, 0x2e, 0x19, 0x8c, 0xcb, 0x75, 0x66, 0xa3, 0xe5,
+	0x48, 0xa6, 0x17, 0x6f, 0xf2, 0x8b, 0x83, 0x32, 0x0a, 0xeb, 0x3f, 0xa9,
+	0x30, 0x70, 0xc1, 0xc2, 0x73, 0x2e, 0x66, 0x11, 0xa7, 0xcc, 0x48, 0x60,
+	0xb7, 0xd1, 0x46, 0xe0, 0x59, 0x87, 0xd7, 0xb2, 0xbd, 0x76, 0x6c, 0x5b,
+	0x0f, 0x1a, 0x7f, 0x2a, 0x54, 0x25, 0xae, 0x8a, 0x3c, 0xc5, 0xe0, 0xf0,
+	0xe6, 0xb6, 0xbf, 0xea, 0x79, 0x7a, 0xbf, 0x57, 0xcd, 0x29, 0x83, 0x24,
+	0xb9, 0xf9, 0xca, 0x88, 0x1e, 0x5e, 0xc7, 0xbc, 0x53, 0x3c, 0xa9, 0xd4,
+	0xa4, 0x6d, 0xca, 0x83, 0xc7, 0xb5, 0xed, 0x38, 0xa0, 0x78, 0x69, 0xac,
+	0xae, 0x2e, 0x0d, 0xd8, 0x98, 0xab, 0x3b, 0xe6, 0xa1, 0xc6, 0xbb, 0x6c,
+	0x6b, 0xea, 0x11, 0x8c, 0x66, 0xf8, 0x14, 0x8e, 0x66, 0x18, 0xa2, 0x31,
+	0x56, 0x32, 0x0a, 0x6d, 0x27, 0x8a, 0xc1, 0x8e, 0x7d, 0x79, 0x9d, 0xfc,
+	0x41, 0x1f, 0x87, 0x8c, 0x97, 0x99, 0x12, 0x61, 0xe7, 0x83, 0x5d, 0xe4,
+	0x47, 0x00, 0x00, 0x00, 0xab, 0x5b, 0x9e, 0x19, 0x03, 0xc0, 0x93, 0x02,
+	0x9d, 0x10, 0x21, 0x01, 0x16, 0x00, 0x00, 0x00, 0x0d, 0xe9, 0x31, 0xfe,
+	0xe0, 0x08, 0x1c, 0x01, 0x0b, 0x5d, 0x00, 0x10, 0x1d, 0x88, 0x26, 0xee,
+	0x40, 0xc2, 0x5c, 0x30, 0x6a, 0x94, 0x00, 0xfe, 0x9b, 0x6c, 0x7f, 0xf3,
+	0xa9, 0x49, 0x54, 0x54, 0x4a, 0x6e, 0x24, 0xda, 0xb4, 0x4e, 0xdb, 0x4e,
+	0x88, 0x0d, 0x0d, 0x9c, 0x43, 0xe3, 0xea, 0x64, 0xd2, 0xc5, 0xbe, 0xd0,
+	0x9b, 0xd3, 0x65, 0xa6, 0x2b, 0xc8, 0xaa, 0x2a, 0x12, 0x65, 0xa1, 0x6d,
+	0x30, 0xc4, 0xbe, 0x24, 0x74, 0xfe, 0x34, 0x11, 0x01, 0x1d, 0xe9, 0x75,
+	0x02, 0x5d, 0x68, 0xa9, 0xed, 0x13, 0x7c, 0x30, 0xb3, 0x0e, 0xd8, 0xf1,
+	0x48, 0x97, 0xed, 0x1c, 0xa9, 0x42, 0x61, 0x78, 0xf1, 0x0a, 0x3f, 0x72,
+	0xbd, 0x68, 0x5d, 0x96, 0x57, 0x7c, 0x46, 0x4e, 0x26, 0xe6, 0xe8, 0x66,
+	0x13, 0x90, 0xaf, 0xa1, 0xb6, 0x07, 0x9e, 0xea, 0xf7, 0x2b, 0x41, 0xe7,
+	0x7c, 0x98, 0xb1, 0x83, 0xa3, 0x00, 0x12, 0x5c, 0xd8, 0x37, 0xf2, 0x14,
+	0x65, 0xfc, 0x63, 0x84, 0x77, 0xec, 0xcd, 0x27, 0xe6, 0x75, 0x0f, 0xe8,
+	0x7d, 0x35, 0x52, 0xd6, 0x4c, 0x99, 0x0e, 0x64, 0x29, 0x87, 0x7b, 0xb3,
+	0x08, 0xc1, 0x0d, 0x4e, 0x0d, 0x37, 0x4c, 0xe4, 0x21, 0x21, 0xe0, 0xa4,
+	0x16, 0x42, 0x20, 0xaa, 0x3d, 0x23, 0xf1, 0x00, 0x3d, 0x9e, 0x83, 0x1e,
+	0x50, 0x97, 0xac, 0x29, 0x2f, 0x73, 0x2b, 0x3b, 0x12, 0x9e, 0x7f, 0x47,
+	0xf8, 0x67, 0xef, 0xa6, 0x66, 0x38, 0x7d, 0x73, 0x7f, 0x8c, 0xbf, 0xe2,
+	0xde, 0xd1, 0xc4, 0x6a, 0xc1, 0x88, 0x6e, 0x6a, 0x92, 0x05, 0xff, 0x26,
+	0x34, 0x59, 0xae, 0x7e, 0xf6, 0xde, 0x02, 0xd9, 0xea, 0xf2, 0xbf, 0xb7,
+	0x3c, 0x9c, 0xcb, 0xae, 0x70, 0x15, 0xc6, 0x8e, 0x10, 0x25, 0x47, 0xf5,
+	0xd7, 0x43, 0x06, 0x21, 0x4f, 0x9c, 0x23, 0xa4, 0x8f, 0x08, 0x42, 0xa6,
+	0xb0, 0xce, 0x2d, 0xa5, 0x3b, 0x2d, 0x89, 0x0c, 0xc5, 0x01, 0x83, 0x63,
+	0xc5, 0x55, 0x18, 0xf4, 0x54, 0xc2, 0xb0, 0xf1, 0x85, 0x40, 0x00, 0x00,
+	0x96, 0xc3, 0x06, 0xfc, 0x00, 0x04, 0xb0, 0x03, 0x80, 0x20, 0xb5, 0x03,
+	0x80, 0x20, 0xaf, 0x03, 0x80, 0x20, 0xa7, 0x02, 0x9d, 0x10, 0x00, 0x00,
+	0x0a, 0x6c, 0x8b, 0x9b, 0x86, 0x00, 0x08, 0x96, 0x05, 0x00, 0x00, 0x00,
+	0x00, 0x01, 0x59, 0x5a,
+};
+
+static size_t make_data(uint8_t *buf)
+{
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < NR_LINES; i++)
+		len += sprintf((char *)buf + len,
+			       "%05u: skiboot xz block test line, value %u\n",
+			       i, (unsigned int)(i * 2654435761ull % 1000));
+
+	return len;
+}
+
+static void check_whole(const uint8_t *in, size_t in_size,
+			const uint8_t *want, size_t want_len)
+{
+	struct xz_dec *s = xz_dec_init(XZ_SINGLE, 0);
+	uint8_t *out = malloc(want_len);
+	struct xz_buf b;
+
+	assert(s && out);
+	b.in = in;
+	b.in_pos = 0;
+	b.in_size = in_size;
+	b.out = out;
+	b.out_pos = 0;
+	b.out_size = want_len;
+	assert(xz_dec_run(s, &b) == XZ_STREAM_END);
+	assert(b.out_pos == want_len);
+	assert(memcmp(out, want, want_len) == 0);
+	xz_dec_end(s);
+	free(out);
+}
+
+int main(void)
+{
+	struct xz_block blocks[8];
+	uint8_t *want, *out, *in;
+	size_t want_len, count, i;
+	struct xz_dec *s;
+
+	xz_crc32_init();
+
+	want = malloc(NR_LINES * 64);
+	assert(want);
+	want_len = make_data(want);
+
+	/* The normal decoder still handles the multi-Block Stream */
+	check_whole(blocks_xz, sizeof(blocks_xz), want, want_len);
+
+	/* Just counting */
+	count = 0;
+	assert(xz_dec_index(blocks_xz, sizeof(blocks_xz), NULL, &count)
+	       == XZ_OK);
+	assert(count == 4);
+
+	count = 8;
+	assert(xz_dec_index(blocks_xz, sizeof(blocks_xz), blocks, &count)
+	       == XZ_OK);
+	assert(count == 4);
+	assert(blocks[0].in_pos == STREAM_HEADER_SIZE);
+	assert(blocks[3].out_pos + blocks[3].out_size == want_len);
+
+	/*
+	 * Each Block decodes on its own, into its own part of the output.
+	 * Go backwards so nothing relies on the previous Block being there.
+	 */
+	out = malloc(want_len + 1);
+	assert(out);
+	memset(out, 0xaa, want_len + 1);
+	s = xz_dec_init(XZ_SINGLE, 0);
+	assert(s);
+	for (i = count; i-- > 0;) {
+		assert(blocks[i].out_size == (i < 3 ? 4096 : want_len - 3 * 4096));
+		assert(xz_dec_block(s, blocks_xz, &blocks[i],
+				    out + blocks[i].out_pos) == XZ_STREAM_END);
+	}
+	assert(memcmp(out, want, want_len) == 0);
+	assert(out[want_len] == 0xaa);
+
+	/* A Block that isn't where the Index says it is fails cleanly */
+	blocks[1].in_pos += 4;
+	assert(xz_dec_block(s, blocks_xz, &blocks[1], out) != XZ_STREAM_END);
+	blocks[1].in_pos -= 4;
+	blocks[1].out_size--;
+	assert(xz_dec_block(s, blocks_xz, &blocks[1], out) != XZ_STREAM_END);
+	xz_dec_end(s);
+
+	/* Corrupt the Index and it's not used */
+	in = malloc(sizeof(blocks_xz));
+	assert(in);
+	memcpy(in, blocks_xz, sizeof(blocks_xz));
+	in[blocks[3].in_pos + blocks[3].in_size + 2] ^= 1;
+	assert(xz_dec_index(in, sizeof(blocks_xz), NULL, &count)
+	       == XZ_DATA_ERROR);
+	assert(xz_dec_index(in, 10, NULL, &count) == XZ_FORMAT_ERROR);
+	in[0] = 0;
+	assert(xz_dec_index(in, sizeof(blocks_xz), NULL, &count)
+	       == XZ_FORMAT_ERROR);
+
+	free(in);
+	free(out);
+	free(want);
+	return 0;
+}
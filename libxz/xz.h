@@ -217,6 +217,55 @@ XZ_EXTERN struct xz_dec *xz_dec_init(enum xz_mode mode, uint32_t dict_max);
  */
 XZ_EXTERN enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b);
 
+/**
+ * struct xz_block - Location of a Block in a single-Stream .xz file
+ * @in_pos:     Offset of the Block Header from the start of the Stream
+ * @in_size:    Size of the Block, including Block Padding and Check
+ * @out_pos:    Offset of the Block's data in the uncompressed Stream
+ * @out_size:   Uncompressed size of the Block
+ * @unpadded:   Unpadded Size of the Block as recorded in the Index
+ */
+struct xz_block {
+    size_t in_pos;
+    size_t in_size;
+    size_t out_pos;
+    size_t out_size;
+    uint64_t unpadded;
+};
+
+/**
+ * xz_dec_index() - Find the Blocks of a .xz Stream from its Index
+ * @in:         The whole .xz Stream
+ * @in_size:    Size of the Stream
+ * @blocks:     Where to store the Block locations, may be NULL
+ * @count:      On entry, how many entries @blocks has room for. On return,
+ *              the number of Blocks in the Stream.
+ *
+ * Only a single Stream without Stream Padding is supported, which is what
+ * xz produces for a single file. Blocks are independent of each other, so
+ * they can be decompressed separately with xz_dec_block().
+ *
+ * Returns XZ_OK on success, XZ_FORMAT_ERROR if this isn't a .xz Stream,
+ * XZ_OPTIONS_ERROR if the Stream Flags aren't supported, or XZ_DATA_ERROR
+ * if the Stream Header, Index, or Stream Footer is corrupt.
+ */
+XZ_EXTERN enum xz_ret xz_dec_index(const uint8_t *in, size_t in_size,
+                   struct xz_block *blocks, size_t *count);
+
+/**
+ * xz_dec_block() - Decompress one Block of a .xz Stream
+ * @s:          Decoder state allocated using xz_dec_init() with XZ_SINGLE
+ * @in:         The whole .xz Stream, as given to xz_dec_index()
+ * @block:      Location of the Block, from xz_dec_index()
+ * @out:        Where to put the Block's block->out_size bytes of data
+ *
+ * The Block is decoded in single-call mode, so @out must not overlap with
+ * the output of any other Block being decompressed at the same time.
+ * Returns XZ_STREAM_END on success, or an error as xz_dec_run() would.
+ */
+XZ_EXTERN enum xz_ret xz_dec_block(struct xz_dec *s, const uint8_t *in,
+                   const struct xz_block *block, uint8_t *out);
+
 /**
  * xz_dec_reset() - Reset an already allocated decoder state
  * @s:          Decoder state allocated using xz_dec_init()
@@ -793,6 +793,148 @@ XZ_EXTERN enum xz_ret xz_dec_run(struct xz_dec *s, struct xz_buf *b)
     return ret;
 }
 
+/*
+ * Decode a variable-length integer from a buffer that holds all of it.
+ * Returns false if it's truncated or not minimally encoded.
+ */
+static bool get_vli(const uint8_t *in, size_t *pos, size_t end,
+            vli_type *vli)
+{
+    uint32_t shift = 0;
+    uint8_t byte;
+
+    *vli = 0;
+    do {
+        if (*pos == end || shift == 7 * VLI_BYTES_MAX)
+            return false;
+
+        byte = in[(*pos)++];
+        *vli |= (vli_type)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return byte != 0 || shift == 7;
+}
+
+XZ_EXTERN enum xz_ret xz_dec_index(const uint8_t *in, size_t in_size,
+                   struct xz_block *blocks, size_t *count)
+{
+    const uint8_t *footer;
+    size_t index_pos, index_size, pos, end;
+    size_t in_pos, out_pos, i;
+    vli_type records, unpadded, uncompressed, size;
+
+    if (in_size < 2 * STREAM_HEADER_SIZE
+            || !memeq(in, HEADER_MAGIC, HEADER_MAGIC_SIZE))
+        return XZ_FORMAT_ERROR;
+
+    if (xz_crc32(in + HEADER_MAGIC_SIZE, 2, 0)
+            != get_le32(in + HEADER_MAGIC_SIZE + 2))
+        return XZ_DATA_ERROR;
+
+    if (in[HEADER_MAGIC_SIZE] != 0)
+        return XZ_OPTIONS_ERROR;
+
+    footer = in + in_size - STREAM_HEADER_SIZE;
+    if (!memeq(footer + 10, FOOTER_MAGIC, FOOTER_MAGIC_SIZE)
+            || xz_crc32(footer + 4, 6, 0) != get_le32(footer)
+            || footer[8] != 0
+            || footer[9] != in[HEADER_MAGIC_SIZE + 1])
+        return XZ_DATA_ERROR;
+
+    /* Backward Size is the size of the Index, in four byte units, - 1 */
+    index_size = ((size_t)get_le32(footer + 4) + 1) * 4;
+    if (index_size > in_size - 2 * STREAM_HEADER_SIZE)
+        return XZ_DATA_ERROR;
+
+    index_pos = in_size - STREAM_HEADER_SIZE - index_size;
+    end = index_pos + index_size - 4;
+    if (xz_crc32(in + index_pos, end - index_pos, 0) != get_le32(in + end))
+        return XZ_DATA_ERROR;
+
+    pos = index_pos;
+    if (in[pos++] != 0 || !get_vli(in, &pos, end, &records))
+        return XZ_DATA_ERROR;
+
+    /* The Blocks are back to back between the Stream Header and Index */
+    in_pos = STREAM_HEADER_SIZE;
+    out_pos = 0;
+    for (i = 0; i < records; i++) {
+        if (!get_vli(in, &pos, end, &unpadded)
+                || !get_vli(in, &pos, end, &uncompressed))
+            return XZ_DATA_ERROR;
+
+        size = (unpadded + 3) & ~(vli_type)3;
+        if (unpadded == 0 || size > index_pos - in_pos
+                || uncompressed > (size_t)-1 - out_pos)
+            return XZ_DATA_ERROR;
+
+        if (blocks != NULL && i < *count) {
+            blocks[i].in_pos = in_pos;
+            blocks[i].in_size = size;
+            blocks[i].out_pos = out_pos;
+            blocks[i].out_size = uncompressed;
+            blocks[i].unpadded = unpadded;
+        }
+
+        in_pos += size;
+        out_pos += uncompressed;
+    }
+
+    /* Index Padding */
+    while (pos < end)
+        if (in[pos++] != 0)
+            return XZ_DATA_ERROR;
+
+    if (in_pos != index_pos)
+        return XZ_DATA_ERROR;
+
+    *count = records;
+    return XZ_OK;
+}
+
+XZ_EXTERN enum xz_ret xz_dec_block(struct xz_dec *s, const uint8_t *in,
+                   const struct xz_block *block, uint8_t *out)
+{
+    struct xz_buf b;
+    enum xz_ret ret;
+
+    if (!DEC_IS_SINGLE(s->mode))
+        return XZ_OPTIONS_ERROR;
+
+    /* The Check type comes from the Stream Header */
+    xz_dec_reset(s);
+    memcpy(s->temp.buf, in, STREAM_HEADER_SIZE);
+    ret = dec_stream_header(s);
+    if (ret != XZ_OK)
+        return ret;
+
+    s->sequence = SEQ_BLOCK_START;
+
+    b.in = in + block->in_pos;
+    b.in_pos = 0;
+    b.in_size = block->in_size;
+    b.out = out;
+    b.out_pos = 0;
+    b.out_size = block->out_size;
+
+    /*
+     * Having used up the input, dec_main() wants the next Block or the
+     * Index, so it returns XZ_OK after a complete Block.
+     */
+    ret = dec_main(s, &b);
+    if (ret != XZ_OK)
+        return ret == XZ_STREAM_END ? XZ_DATA_ERROR : ret;
+
+    if (s->block.count != 1 || b.in_pos != b.in_size
+            || b.out_pos != b.out_size
+            || s->block.hash.unpadded != block->unpadded
+            || s->block.hash.uncompressed != block->out_size)
+        return XZ_DATA_ERROR;
+
+    return XZ_STREAM_END;
+}
+
 XZ_EXTERN struct xz_dec *xz_dec_init(enum xz_mode mode, uint32_t dict_max)
 {
     struct xz_dec *s = kmalloc(sizeof(*s), GFP_KERNEL);